@@ -27,7 +27,7 @@ int hello_world(char *method, char *uri, char *response, unsigned int maxlen)
 int main(int argc, char **argv)
 {
     if (argc < 2) {
-        ERROR("Usage: %s <port>", argv[0]);
+        ERROR("Usage: %s <port> [directory]", argv[0]);
         return 1;
     }
 
@@ -41,6 +41,12 @@ int main(int argc, char **argv)
 
     // Register resource
     two_register_resource("GET", "/", "text/plain", hello_world);
+
+    // Serve files from the directory under /files
+    if (argc > 2 && two_register_directory("/files", argv[2]) < 0) {
+        ERROR("Failed to register directory %s", argv[2]);
+        return 1;
+    }
     if (two_server_start(port) < 0) {
         ERROR("Failed to start server");
     }
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <string.h>
 
 #include "cbuf.h"
@@ -12,98 +13,148 @@ void cbuf_init(cbuf_t *cbuf, uint8_t *buf, int maxlen)
     cbuf->maxlen = maxlen;
     cbuf->len    = 0;
     cbuf->state  = CBUF_OPEN;
+
+    // use mask arithmetic for power of two sizes
+    cbuf->mask = 0;
+    if (maxlen > 1 && (maxlen & (maxlen - 1)) == 0) {
+        cbuf->mask = maxlen - 1;
+    }
 }
 
-int cbuf_push(cbuf_t *cbuf, uint8_t *src, int len)
+// memory offset for the index
+static inline unsigned int cbuf_offset(cbuf_t *cbuf, unsigned int index)
 {
-    int bytes = 0;
-    while (len > 0 && cbuf->len < cbuf->maxlen && cbuf->state == CBUF_OPEN) {
-        int copylen = MIN(len, cbuf->maxlen - cbuf->head);
-        if (cbuf->head < cbuf->tail) {
-            copylen = MIN(len, cbuf->tail - cbuf->head);
-        }
-        memcpy(cbuf->ptr + cbuf->head, src, copylen);
-
-        // Update write index
-        cbuf->head = (cbuf->head + copylen) % cbuf->maxlen;
-
-        // Update used count
-        cbuf->len += copylen;
-
-        // Update result
-        bytes += copylen;
-
-        // Update pointers
-        src += copylen;
-        len -= copylen;
+    return cbuf->mask ? index & cbuf->mask : index;
+}
+
+// move the index n bytes forward
+static inline unsigned int cbuf_advance(cbuf_t *cbuf,
+                                        unsigned int index,
+                                        int n)
+{
+    index += n;
+    if (!cbuf->mask && index >= (unsigned int)cbuf->maxlen) {
+        index -= cbuf->maxlen;
     }
+    return index;
+}
+
+// copy len bytes starting at index into dst, in at most two segments
+static void cbuf_copy_from(cbuf_t *cbuf,
+                           unsigned int index,
+                           uint8_t *dst,
+                           int len)
+{
+    unsigned int offset = cbuf_offset(cbuf, index);
+    int first           = MIN(len, cbuf->maxlen - (int)offset);
 
-    return bytes;
+    memcpy(dst, cbuf->ptr + offset, first);
+    memcpy(dst + first, cbuf->ptr, len - first);
 }
 
-int cbuf_pop(cbuf_t *cbuf, uint8_t *dst, int len)
+// copy len bytes from src starting at index, in at most two segments
+static void cbuf_copy_to(cbuf_t *cbuf,
+                         unsigned int index,
+                         uint8_t *src,
+                         int len)
 {
-    int bytes = 0;
+    unsigned int offset = cbuf_offset(cbuf, index);
+    int first           = MIN(len, cbuf->maxlen - (int)offset);
+
+    memcpy(cbuf->ptr + offset, src, first);
+    memcpy(cbuf->ptr, src + first, len - first);
+}
 
-    while (len > 0 && cbuf->len > 0) {
-        int copylen = MIN(len, cbuf->maxlen - cbuf->tail);
-        if (cbuf->tail < cbuf->head) {
-            copylen = MIN(len, cbuf->head - cbuf->tail);
-        }
+int cbuf_push(cbuf_t *cbuf, uint8_t *src, int len)
+{
+    if (cbuf->state != CBUF_OPEN) {
+        return 0;
+    }
 
-        // if dst is NULL, calls to read will only increase the read pointer
-        if (dst != NULL) {
-            memcpy(dst, cbuf->ptr + cbuf->tail, copylen);
-            dst += copylen;
-        }
+    len = MIN(len, cbuf->maxlen - cbuf->len);
+    if (len <= 0) {
+        return 0;
+    }
+    cbuf_copy_to(cbuf, cbuf->head, src, len);
 
-        // Update read pointer
-        cbuf->tail = (cbuf->tail + copylen) % cbuf->maxlen;
+    // Update write index and used count
+    cbuf->head = cbuf_advance(cbuf, cbuf->head, len);
+    cbuf->len += len;
 
-        // Update used count
-        cbuf->len -= copylen;
+    return len;
+}
 
-        // update result
-        bytes += copylen;
+int cbuf_pop(cbuf_t *cbuf, uint8_t *dst, int len)
+{
+    len = MIN(len, cbuf->len);
+    if (len <= 0) {
+        return 0;
+    }
 
-        // Update pointers
-        len -= copylen;
+    // if dst is NULL, calls to read will only increase the read pointer
+    if (dst != NULL) {
+        cbuf_copy_from(cbuf, cbuf->tail, dst, len);
     }
 
-    return bytes;
+    // Update read index and used count
+    cbuf->tail = cbuf_advance(cbuf, cbuf->tail, len);
+    cbuf->len -= len;
+
+    return len;
 }
 
 int cbuf_peek(cbuf_t *cbuf, uint8_t *dst, int len)
 {
-    int bytes   = 0;
-    int cbuflen = cbuf->len;
-    int tail    = cbuf->tail;
+    len = MIN(len, cbuf->len);
+    if (len <= 0) {
+        return 0;
+    }
 
-    while (len > 0 && cbuflen > 0) {
-        int copylen = MIN(len, cbuf->maxlen - tail);
-        if (tail < cbuf->head) {
-            copylen = MIN(len, cbuf->head - tail);
-        }
+    if (dst != NULL) {
+        cbuf_copy_from(cbuf, cbuf->tail, dst, len);
+    }
 
-        if (dst != NULL) {
-            memcpy(dst, cbuf->ptr + tail, copylen);
-            dst += copylen;
-        }
+    return len;
+}
 
-        // Update read pointer
-        tail = (tail + copylen) % cbuf->maxlen;
+int cbuf_contiguous(cbuf_t *cbuf)
+{
+    if (cbuf->state != CBUF_OPEN || cbuf->len == cbuf->maxlen) {
+        return 0;
+    }
 
-        // Update used count
-        cbuflen -= copylen;
+    // start over if the buffer is empty
+    if (cbuf->len == 0) {
+        cbuf->head = 0;
+        cbuf->tail = 0;
+    }
 
-        // update result
-        bytes += copylen;
+    // free bytes from the write index to the read index
+    // or to the end of the memory
+    unsigned int head = cbuf_offset(cbuf, cbuf->head);
+    unsigned int tail = cbuf_offset(cbuf, cbuf->tail);
+    if (head < tail) {
+        return tail - head;
+    }
+    return cbuf->maxlen - head;
+}
 
-        // Update pointers
-        len -= copylen;
+uint8_t *cbuf_reserve(cbuf_t *cbuf, int len)
+{
+    if (cbuf_contiguous(cbuf) < len) {
+        return NULL;
     }
+    return cbuf->ptr + cbuf_offset(cbuf, cbuf->head);
+}
+
+int cbuf_commit(cbuf_t *cbuf, int len)
+{
+    assert(len <= cbuf->maxlen - cbuf->len);
+
+    cbuf->head = cbuf_advance(cbuf, cbuf->head, len);
+    cbuf->len += len;
 
-    return bytes;
+    return len;
 }
 
 int cbuf_len(cbuf_t *cbuf)
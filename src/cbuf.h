@@ -16,6 +16,10 @@
  *
  * Pop operations retrieve data from the beginning of the
  * buffer and increase the available buffer size
+ *
+ * If the buffer size is a power of two, indices run freely and
+ * are mapped to the memory with a mask, otherwise they are wrapped
+ * at the end of the buffer
  **/
 
 typedef struct
@@ -25,8 +29,11 @@ typedef struct
     int len;
 
     // read and write pointer
-    int head; // write index
-    int tail; // read index
+    unsigned int head; // write index
+    unsigned int tail; // read index
+
+    // maxlen - 1 for power of two sizes, 0 otherwise
+    unsigned int mask;
 
     // end of buffer
     enum
@@ -58,6 +65,26 @@ int cbuf_pop(cbuf_t *cbuf, uint8_t *dst, int len);
  */
 int cbuf_peek(cbuf_t *cbuf, uint8_t *dst, int len);
 
+/**
+ * Reserve len contiguous bytes at the end of the buffer to write
+ * in place. Returns NULL if the free space after the last byte is
+ * shorter than len, e.g. when it wraps around the end of the memory,
+ * or the buffer has ended. Written bytes are only added to the
+ * buffer by cbuf_commit()
+ */
+uint8_t *cbuf_reserve(cbuf_t *cbuf, int len);
+
+/**
+ * Return the largest len cbuf_reserve() can currently provide
+ */
+int cbuf_contiguous(cbuf_t *cbuf);
+
+/**
+ * Add len bytes written in the memory returned by cbuf_reserve()
+ * to the end of the buffer
+ */
+int cbuf_commit(cbuf_t *cbuf, int len);
+
 /**
  * Return available read size
  */
@@ -25,3 +25,46 @@ char *content_type_allowed(char *content_type)
     }
     return NULL;
 }
+
+static struct
+{
+    char *extension;
+    char *content_type;
+} content_type_extensions[] = CONTENT_TYPE_EXTENSIONS;
+
+#define CONTENT_TYPE_EXTENSIONS_LEN                                            \
+    (sizeof(content_type_extensions) / sizeof(*content_type_extensions))
+
+char *content_type_from_path(char *path)
+{
+    char *extension = rindex(path, '.');
+    if (extension != NULL && index(extension, '/') == NULL) {
+        for (unsigned int i = 0; i < CONTENT_TYPE_EXTENSIONS_LEN; i++) {
+            if (strcasecmp(extension, content_type_extensions[i].extension) ==
+                0) {
+                return content_type_allowed(
+                  content_type_extensions[i].content_type);
+            }
+        }
+    }
+    return content_type_allowed("application/octet-stream");
+}
+
+char *allowed_content_encodings[] = CONTENT_ENCODINGS;
+
+#define CONTENT_ENCODINGS_LEN                                                  \
+    (sizeof(allowed_content_encodings) / sizeof(*allowed_content_encodings))
+
+char *content_encoding_allowed(char *content_encoding)
+{
+    if (content_encoding == NULL) {
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < CONTENT_ENCODINGS_LEN; i++) {
+        if (strcasecmp(content_encoding, allowed_content_encodings[i]) == 0) {
+            return allowed_content_encodings[i];
+        }
+    }
+    return NULL;
+}
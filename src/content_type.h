@@ -6,9 +6,29 @@
  */
 #define CONTENT_TYPES                                                          \
     {                                                                          \
-        "text/plain", "application/json", "application/cbor"                   \
+        "text/plain", "application/json", "application/cbor", "text/html",     \
+          "text/css", "application/javascript", "application/octet-stream"     \
+    }
+
+/**
+ * Content types for file extensions, files with other
+ * extensions are served as application/octet-stream
+ */
+#define CONTENT_TYPE_EXTENSIONS                                                \
+    {                                                                          \
+        { ".txt", "text/plain" }, { ".json", "application/json" },             \
+          { ".cbor", "application/cbor" }, { ".html", "text/html" },           \
+          { ".htm", "text/html" }, { ".css", "text/css" },                     \
+          { ".js", "application/javascript" }                                  \
+    }
+
+/**
+ * List of allowed content codings for precompressed resource variants
+ */
+#define CONTENT_ENCODINGS                                                      \
+    {                                                                          \
+        "gzip", "br", "deflate"                                                \
     }
-;
 
 /**
  * Get a pointer to the value of the content type in
@@ -20,4 +40,22 @@
  */
 char *content_type_allowed(char *content_type);
 
+/**
+ * Get the content type for the given file path according to its extension
+ *
+ * @param path file path
+ * @return pointer to the respective content_type in the allowed list
+ */
+char *content_type_from_path(char *path);
+
+/**
+ * Get a pointer to the value of the content coding in
+ * the content encoding list or NULL if not found
+ *
+ * @param content_encoding value to look for in the allowed list
+ * @return pointer to the respective content coding in the list or NULL if
+ * not found
+ */
+char *content_encoding_allowed(char *content_encoding);
+
 #endif
@@ -1,19 +1,39 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// needed for accept4()
+#define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 
 #ifndef CONTIKI
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #endif
 
 #include "event.h"
+#include "macros.h"
+#include "metrics.h"
 
 #define LOG_MODULE LOG_MODULE_EVENT
 #include "logging.h"
 
+#ifdef EVENT_IO_H
+// replace the socket and clock calls with another backend,
+// e.g. the simulator in tests/sim_io.h
+#include EVENT_IO_H
+#endif
+
 #ifdef CONTIKI
 // Main contiki process
 PROCESS(event_loop_process, "Event loop process");
@@ -23,44 +43,61 @@ PROCESS(event_loop_process, "Event loop process");
 // Private methods
 /////////////////////////////////////////////////////
 
-// find socket file descriptor in socket queue
-event_t *event_find(event_t *queue, event_type_t type)
+// get a free event from loop memory, or NULL if none is available
+event_t *event_alloc(event_loop_t *loop, event_sock_t *sock, event_type_t type)
 {
-    return LL_FIND(queue, LL_ELEM(event_t)->type == type);
-}
-
-// find free event in loop memory
-event_t *event_find_free(event_loop_t *loop, event_sock_t *sock)
-{
-    return LL_MOVEP(loop->events, sock->events);
+    event_t *event = LL_POP(loop->events);
+    if (event != NULL) {
+        memset(event, 0, sizeof(event_t));
+        event->sock = sock;
+        event->type = type;
+    }
+    return event;
 }
 
-// find socket file descriptor in socket queue
-event_sock_t *event_sock_find(event_sock_t *queue,
-                              event_descriptor_t descriptor)
+// move the event back to the loop unused list
+void event_free(event_loop_t *loop, event_t *event)
 {
-    return LL_FIND(queue, LL_ELEM(event_sock_t)->descriptor == descriptor);
+    LL_PUSH(event, loop->events);
 }
 
 event_sock_t *event_sock_connect(event_sock_t *sock, event_t *event)
 {
+    event_sock_t *client = NULL;
     if (event != NULL) {
         // if this happens there is an error with the implementation
         assert(event->data.connection.cb != NULL);
 
+#ifdef CONTIKI
         // only notify of new connection if there
         // are sockets available to receive it
         if (sock->loop->sockets != NULL) {
-            return event->data.connection.cb(sock);
+            client = event->data.connection.cb(sock);
+        }
+#else
+        // accept pending connections until the backlog is empty,
+        // the budget is spent or there are no sockets available
+        for (int i = 0; i < EVENT_ACCEPT_BUDGET; i++) {
+            if (sock->loop->sockets == NULL ||
+                sock->state != EVENT_SOCK_LISTENING) {
+                break;
+            }
+
+            event_sock_t *next = event->data.connection.cb(sock);
+            if (next == NULL) {
+                break;
+            }
+            client = next;
         }
+#endif
     }
-    return NULL;
+    return client;
 }
 
 void event_sock_close(event_sock_t *sock, int status)
 {
     assert(status <= 0);
-    event_t *re = event_find(sock->events, EVENT_READ_TYPE);
+    event_t *re = sock->read_event;
     if (re != NULL) {
         // mark the buffer as closed
         cbuf_end(&re->data.read.buf);
@@ -69,7 +106,8 @@ void event_sock_close(event_sock_t *sock, int status)
         re->data.read.cb(sock, status, NULL);
     }
 
-    event_t *we = event_find(sock->events, EVENT_WRITE_TYPE);
+    // the read callback may have released the read event
+    event_t *we = sock->write_event;
     if (we != NULL) {
         // mark the buffer as closed
         cbuf_end(&we->data.write.buf);
@@ -77,14 +115,17 @@ void event_sock_close(event_sock_t *sock, int status)
         // empty the buffer
         cbuf_pop(&we->data.write.buf, NULL, cbuf_len(&we->data.write.buf));
 
+        // notify of error the first operation with a callback
+        // if we could not notify the read
+        int notify           = re == NULL;
         event_write_op_t *op = LL_POP(we->data.write.queue);
-        // notify of error if we could not notify the read
-        if (re == NULL && op != NULL) {
-            op->cb(sock, status);
-        }
 
         // remove all pending operations
         while (op != NULL) {
+            if (notify && op->cb != NULL) {
+                op->cb(sock, status);
+                notify = 0;
+            }
             LL_PUSH(op, sock->loop->writes);
             op = LL_POP(we->data.write.queue);
         }
@@ -113,27 +154,37 @@ void event_sock_read(event_sock_t *sock, event_t *event)
         event_sock_close(sock, count == 0 ? 0 : -errno);
         return;
     }
+
+    // nothing to read yet
+    if (count < 0) {
+        return;
+    }
 #endif
     DEBUG("received %d bytes from remote endpoint", count);
     // push data into buffer
-    cbuf_push(&event->data.read.buf, buf, count);
+    if (cbuf_push(&event->data.read.buf, buf, count) > 0) {
+        event->data.read.ready = 1;
+    }
+    METRICS_ADD(BYTES_IN, count);
+    METRICS_MAX(READ_BUF_MAX, cbuf_len(&event->data.read.buf));
 }
 
-void event_sock_handle_read(event_sock_t *sock, event_t *event)
+int event_sock_handle_read(event_sock_t *sock, event_t *event)
 {
     assert(sock != NULL);
     if (event == NULL) {
-        return;
+        return 0;
     }
 
-    int buflen = cbuf_len(&event->data.read.buf);
+    int readlen = 0;
+    int buflen  = cbuf_len(&event->data.read.buf);
     if (buflen > 0) {
         // else notify about the new data
         uint8_t read_buf[buflen];
         cbuf_peek(&event->data.read.buf, read_buf, buflen);
 
         DEBUG("passing %d bytes to callback", buflen);
-        int readlen = event->data.read.cb(sock, buflen, read_buf);
+        readlen = event->data.read.cb(sock, buflen, read_buf);
         DEBUG("callback used %d bytes", readlen);
 
         // remove the read bytes from the buffer
@@ -143,13 +194,40 @@ void event_sock_handle_read(event_sock_t *sock, event_t *event)
     if (cbuf_has_ended(&event->data.read.buf)) {
         // if a read terminated call the callback with -1
         event->data.read.cb(sock, -1, NULL);
+        return 0;
     }
+    return readlen;
+}
+
+// notify the writable callback if the buffer has drained
+// below the low-water mark
+void event_sock_notify_writable(event_sock_t *sock, event_t *event)
+{
+    event_writable_cb cb = event->data.write.writable_cb;
+    if (cb == NULL || sock->state != EVENT_SOCK_CONNECTED) {
+        return;
+    }
+
+    int lowat = EVENT_WRITE_LOW_WATER;
+    if (lowat <= 0) {
+        lowat = cbuf_maxlen(&event->data.write.buf) / 2;
+    }
+    if (cbuf_len(&event->data.write.buf) > lowat ||
+        event_write_space(sock) <= 0) {
+        return;
+    }
+
+    // the callback is only called once
+    event->data.write.writable_cb = NULL;
+    cb(sock);
 }
 
 void event_sock_handle_write(event_sock_t *sock,
                              event_t *event,
                              unsigned int written)
 {
+    METRICS_ADD(BYTES_OUT, written);
+
     // notify the waiting write operatinons
     event_write_op_t *op = LL_POP(event->data.write.queue);
 
@@ -161,7 +239,9 @@ void event_sock_handle_write(event_sock_t *sock,
             DEBUG("wrote %d bytes, notifying callback", op->bytes);
 
             // notify the callback
-            op->cb(sock, 0);
+            if (op->cb != NULL) {
+                op->cb(sock, 0);
+            }
 
             // free the memory
             LL_PUSH(op, sock->loop->writes);
@@ -179,8 +259,53 @@ void event_sock_handle_write(event_sock_t *sock,
     if (op != NULL) {
         LL_PUSH(op, event->data.write.queue);
     }
+
+    event_sock_notify_writable(sock, event);
 }
 
+#ifndef CONTIKI
+// Maximum number of bytes read into the stack
+// when sendfile() is not available
+#ifndef EVENT_SENDFILE_CHUNK_SIZE
+#define EVENT_SENDFILE_CHUNK_SIZE (1024)
+#endif
+
+void event_sock_sendfile(event_sock_t *sock,
+                         event_t *event,
+                         event_write_op_t *op)
+{
+#ifdef __linux__
+    off_t offset    = op->offset;
+    ssize_t written = sendfile(sock->descriptor, op->fd, &offset, op->bytes);
+#else
+    uint8_t buf[EVENT_SENDFILE_CHUNK_SIZE];
+    ssize_t written = pread(
+      op->fd, buf, MIN(op->bytes, EVENT_SENDFILE_CHUNK_SIZE), op->offset);
+    if (written > 0) {
+        written = send(sock->descriptor, buf, written, MSG_DONTWAIT);
+    }
+#endif
+    if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        event_sock_close(sock, -errno);
+        return;
+    }
+
+    // the file is shorter than expected
+    if (written == 0) {
+        event_sock_close(sock, -EIO);
+        return;
+    }
+
+    if (written > 0) {
+        DEBUG("sent %d bytes from file", (int)written);
+        op->offset += written;
+
+        // notify the operation if finished
+        event_sock_handle_write(sock, event, written);
+    }
+}
+#endif
+
 void event_sock_write(event_sock_t *sock, event_t *event)
 {
     assert(sock != NULL);
@@ -197,7 +322,26 @@ void event_sock_write(event_sock_t *sock, event_t *event)
 
     int len = MIN(cbuf_len(&event->data.write.buf), uip_mss());
 #else
-    int len     = cbuf_len(&event->data.write.buf);
+    event_write_op_t *op = event->data.write.queue;
+    if (op != NULL && op->fd >= 0) {
+        event_sock_sendfile(sock, event, op);
+        return;
+    }
+
+    // only write the buffered bytes queued before the next file
+    int len = 0;
+    for (; op != NULL && op->fd < 0; op = op->next) {
+        len += op->bytes;
+    }
+    len = MIN(len, cbuf_len(&event->data.write.buf));
+
+    // let the file data share the segment with the frame header
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_MORE
+    if (op != NULL) {
+        flags |= MSG_MORE;
+    }
+#endif
 #endif
     uint8_t buf[len];
     cbuf_peek(&event->data.write.buf, buf, len);
@@ -213,12 +357,17 @@ void event_sock_write(event_sock_t *sock, event_t *event)
     // set sending length
     event->data.write.sending = len;
 #else
-    int written = send(sock->descriptor, buf, len, MSG_DONTWAIT);
+    int written = send(sock->descriptor, buf, len, flags);
     if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
         event_sock_close(sock, -errno);
         return;
     }
 
+    // wait for the next poll
+    if (written < len) {
+        event->data.write.writable = 0;
+    }
+
     if (written > 0) {
         // remove written data from buffer
         cbuf_pop(&event->data.write.buf, NULL, written);
@@ -239,12 +388,8 @@ void event_loop_timers(event_loop_t *loop)
 
     // for each socket and event, check if elapsed time has been reached
     for (event_sock_t *sock = loop->reserved; sock != NULL; sock = sock->next) {
-        event_t *event = sock->events;
+        event_t *event = sock->timers;
         while (event != NULL) {
-            if (event->type != EVENT_TIMER_TYPE) {
-                event = event->next;
-                continue;
-            }
             struct timeval diff;
 
             // Get time difference
@@ -258,7 +403,7 @@ void event_loop_timers(event_loop_t *loop)
                 event->data.timer.start = now;
                 if (remove > 0) {
                     // remove event from list
-                    LL_DELETE(event, sock->events);
+                    LL_DELETE(event, sock->timers);
 
                     // move event to loop unused list
                     event = LL_PUSH(event, loop->events);
@@ -280,6 +425,16 @@ void event_loop_poll(event_loop_t *loop, int millis)
     fd_set write_fds  = loop->active_fds;
     struct timeval tv = { 0, millis * 1000 };
 
+    // pending connections cannot be accepted until a socket is
+    // freed, ignore them to avoid waking up immediately
+    if (loop->sockets == NULL) {
+        for (event_sock_t *s = loop->reserved; s != NULL; s = s->next) {
+            if (s->state == EVENT_SOCK_LISTENING) {
+                FD_CLR(s->descriptor, &read_fds);
+            }
+        }
+    }
+
     // poll list of file descriptors with select
     if (select(loop->nfds, &read_fds, &write_fds, NULL, &tv) < 0) {
         // if an error different from interrupt is caught
@@ -288,41 +443,89 @@ void event_loop_poll(event_loop_t *loop, int millis)
         return;
     }
 
-    for (int i = 0; i < loop->nfds; i++) {
-        event_sock_t *sock;
-        if (FD_ISSET(i, &loop->active_fds)) {
-            sock = event_sock_find(loop->reserved, i);
-        } else {
+    // accepted sockets are pushed to the head of the reserved
+    // list and are not visited until the next poll
+    for (event_sock_t *sock = loop->reserved; sock != NULL; sock = sock->next) {
+        int fd = sock->descriptor;
+        if (fd < 0 || !FD_ISSET(fd, &loop->active_fds)) {
             continue;
         }
-        assert(sock != NULL);
 
         // check read operations
-        if (FD_ISSET(i, &read_fds)) {
+        if (FD_ISSET(fd, &read_fds)) {
             if (sock->state == EVENT_SOCK_CONNECTED) {
                 // read into sock buffer if any
-                event_sock_read(sock,
-                                event_find(sock->events, EVENT_READ_TYPE));
+                event_sock_read(sock, sock->read_event);
             } else if (sock->state == EVENT_SOCK_LISTENING) {
-                event_sock_connect(
-                  sock, event_find(sock->events, EVENT_CONNECTION_TYPE));
+                event_sock_connect(sock, sock->connection_event);
             }
         }
 
-        // check write operations
-        if (FD_ISSET(i, &write_fds)) {
-            // write from buffer if possible
-            event_sock_write(sock, event_find(sock->events, EVENT_WRITE_TYPE));
+        // writes are corked until the end of the iteration
+        event_t *we = sock->write_event;
+        if (we != NULL) {
+            we->data.write.writable = FD_ISSET(fd, &write_fds) ? 1 : 0;
         }
     }
 }
 
+// write the buffered bytes of the socket if it is writable
+// and at least min bytes are waiting
+void event_sock_flush(event_sock_t *sock, int min)
+{
+    event_t *event = sock->write_event;
+    if (event == NULL || !event->data.write.writable ||
+        event->data.write.queue == NULL ||
+        cbuf_len(&event->data.write.buf) < min) {
+        return;
+    }
+    event_sock_write(sock, event);
+}
+
 void event_loop_pending(event_loop_t *loop)
 {
     for (event_sock_t *sock = loop->reserved; sock != NULL; sock = sock->next) {
-        event_t *event = event_find(sock->events, EVENT_READ_TYPE);
-        if (event != NULL) {
-            event_sock_handle_read(sock, event);
+        // notify the socket while data is being consumed, so the
+        // replies to all received frames go out in the same flush.
+        // Sockets waiting for the rest of a message are skipped
+        // until new bytes arrive
+        event_t *event = sock->read_event;
+        while (event != NULL && event->data.read.ready &&
+               sock->state == EVENT_SOCK_CONNECTED) {
+            event->data.read.ready = 0;
+            int readlen            = event_sock_handle_read(sock, event);
+
+            // the callback may have stopped reading
+            event = sock->read_event;
+            if (event == NULL || readlen <= 0) {
+                continue;
+            }
+            if (cbuf_len(&event->data.read.buf) > 0) {
+                event->data.read.ready = 1;
+            }
+
+            event_t *we = sock->write_event;
+            if (we != NULL) {
+                int hwm = EVENT_WRITE_HIGH_WATER;
+                if (hwm <= 0) {
+                    hwm = cbuf_maxlen(&we->data.write.buf) * 3 / 4;
+                }
+                event_sock_flush(sock, hwm);
+            }
+        }
+    }
+}
+
+void event_loop_flush(event_loop_t *loop)
+{
+    for (event_sock_t *sock = loop->reserved; sock != NULL; sock = sock->next) {
+        event_sock_flush(sock, 0);
+
+        // nothing left to drain, but write operations may have
+        // been freed by other sockets
+        event_t *event = sock->write_event;
+        if (event != NULL && event->data.write.queue == NULL) {
+            event_sock_notify_writable(sock, event);
         }
     }
 }
@@ -342,10 +545,10 @@ void event_sock_handle_timer(void *data)
         ctimer_stop(&event->data.timer.ctimer);
 
         // remove event from list
-        LL_DELETE(event, sock->events);
+        LL_DELETE(event, sock->timers);
 
         // move event to loop unused list
-        LL_PUSH(event, sock->loop->events);
+        event_free(sock->loop, event);
     } else {
         ctimer_restart(&event->data.timer.ctimer);
     }
@@ -404,16 +607,14 @@ void event_sock_handle_event(event_loop_t *loop, void *data)
             server->uip_conn = uip_conn;
 
             // do connect
-            sock = event_sock_connect(
-              server, event_find(server->events, EVENT_CONNECTION_TYPE));
+            sock = event_sock_connect(server, server->connection_event);
         }
 
         if (sock == NULL) { // no one accepted the socket
             uip_abort();
         } else {
             if (uip_newdata()) {
-                event_t *re = event_find(sock->events, EVENT_READ_TYPE);
-                event_sock_read(sock, re);
+                event_sock_read(sock, sock->read_event);
             }
         }
         return;
@@ -437,7 +638,7 @@ void event_sock_handle_event(event_loop_t *loop, void *data)
         return;
     }
 
-    event_t *we = event_find(sock->events, EVENT_WRITE_TYPE);
+    event_t *we = sock->write_event;
     if (uip_acked()) {
         event_sock_handle_ack(sock, we);
     }
@@ -446,7 +647,7 @@ void event_sock_handle_event(event_loop_t *loop, void *data)
         event_sock_handle_rexmit(sock, we);
     }
 
-    event_t *re = event_find(sock->events, EVENT_READ_TYPE);
+    event_t *re = sock->read_event;
     if (uip_newdata()) {
         event_sock_read(sock, re);
     }
@@ -477,32 +678,34 @@ void event_loop_close(event_loop_t *loop)
 
     while (curr != NULL) {
         // if the event is closing and we are not waiting to write
-        event_t *we = event_find(curr->events, EVENT_WRITE_TYPE);
+        event_t *we = curr->write_event;
         if (curr->state == EVENT_SOCK_CLOSING &&
             (we == NULL || we->data.write.queue == NULL)) {
 #ifndef CONTIKI
-            // prevent sock to be used in reserved
-            FD_CLR(curr->descriptor, &loop->active_fds);
+            // the socket may have never been connected
+            if (curr->descriptor >= 0) {
+                // prevent sock to be used in reserved
+                FD_CLR(curr->descriptor, &loop->active_fds);
 
-            // notify the client of socket closing
-            shutdown(curr->descriptor, SHUT_WR);
+                // notify the client of socket closing
+                shutdown(curr->descriptor, SHUT_WR);
 
-            // close the socket and update its status
-            close(curr->descriptor);
+                // close the socket and update its status
+                close(curr->descriptor);
+            }
 #else
             // tcp_markconn()
             if (curr->uip_conn != NULL) {
                 tcp_markconn(curr->uip_conn, NULL);
             }
 
-            // stop timer if any
-            event_t *timer = event_find(curr->events, EVENT_TIMER_TYPE);
-            if (timer != NULL) {
+            // stop timers if any
+            for (event_t *timer = curr->timers; timer != NULL;
+                 timer          = timer->next) {
                 ctimer_stop(&timer->data.timer.ctimer);
             }
 
-            event_t *ch = event_find(curr->events, EVENT_CONNECTION_TYPE);
-            if (ch != NULL) {
+            if (curr->connection_event != NULL) {
                 // If server socket
                 // let UIP know that we are no longer accepting connections on
                 // the specified port
@@ -528,7 +731,15 @@ void event_loop_close(event_loop_t *loop)
             }
 
             // move socket events back to the unused event list
-            for (event_t *h = curr->events; h != NULL;
+            event_t *slots[] = { curr->connection_event,
+                                 curr->read_event,
+                                 curr->write_event };
+            for (unsigned int i = 0; i < sizeof(slots) / sizeof(*slots); i++) {
+                if (slots[i] != NULL) {
+                    event_free(loop, slots[i]);
+                }
+            }
+            for (event_t *h = curr->timers; h != NULL;
                  h          = LL_PUSH(h, loop->events)) {
             }
 
@@ -558,6 +769,42 @@ int event_loop_is_alive(event_loop_t *loop)
     return loop->reserved != NULL;
 }
 
+#ifndef CONTIKI
+// Set an integer socket option unless it is 0
+void event_sock_setopt(int fd, int level, int name, int value)
+{
+    if (value == 0) {
+        return;
+    }
+    if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+        WARN("failed to set socket option %d to %d", name, value);
+    }
+}
+
+// Get an integer socket option or 0 on error
+int event_sock_getopt(int fd, int level, int name)
+{
+    int value     = 0;
+    socklen_t len = sizeof(value);
+    if (getsockopt(fd, level, name, &value, &len) < 0) {
+        return 0;
+    }
+    return value;
+}
+
+// Apply options shared by listening and client sockets. Buffer sizes
+// are set before listen() so the window scale is negotiated with them
+void event_sock_apply_opts(int fd, event_sockopts_t *opts)
+{
+    event_sock_setopt(fd, IPPROTO_TCP, TCP_NODELAY, opts->nodelay);
+    event_sock_setopt(fd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf);
+    event_sock_setopt(fd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf);
+#ifdef TCP_NOTSENT_LOWAT
+    event_sock_setopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, opts->notsent_lowat);
+#endif
+}
+#endif
+
 // Public methods
 int event_listen(event_sock_t *sock, uint16_t port, event_connection_cb cb)
 {
@@ -569,16 +816,43 @@ int event_listen(event_sock_t *sock, uint16_t port, event_connection_cb cb)
     event_loop_t *loop = sock->loop;
 
 #ifndef CONTIKI
+    // accept() must not block once the backlog is empty
+#ifdef __linux__
+    sock->descriptor =
+      socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock->descriptor < 0) {
+        return -1;
+    }
+#else
     sock->descriptor = socket(AF_INET6, SOCK_STREAM, 0);
     if (sock->descriptor < 0) {
         return -1;
     }
+    fcntl(sock->descriptor,
+          F_SETFL,
+          fcntl(sock->descriptor, F_GETFL) | O_NONBLOCK);
+    fcntl(sock->descriptor, F_SETFD, FD_CLOEXEC);
+#endif
 
     // allow address reuse to prevent "address already in use" errors
     int option = 1;
     setsockopt(
       sock->descriptor, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
 
+    // tune the socket, accepted sockets inherit most of these
+    event_sockopts_t *opts = &loop->sockopts;
+    event_sock_apply_opts(sock->descriptor, opts);
+#ifdef TCP_DEFER_ACCEPT
+    // only wake up when the client has sent the preface
+    event_sock_setopt(
+      sock->descriptor, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts->defer_accept);
+#endif
+#ifdef TCP_FASTOPEN
+    // allow the preface in the SYN for returning clients
+    event_sock_setopt(
+      sock->descriptor, IPPROTO_TCP, TCP_FASTOPEN, opts->fastopen);
+#endif
+
     /* Struct sockaddr_in6 needed for binding. Family defined for ipv6. */
     struct sockaddr_in6 sin6;
     sin6.sin6_family = AF_INET6;
@@ -590,7 +864,7 @@ int event_listen(event_sock_t *sock, uint16_t port, event_connection_cb cb)
         return -1;
     }
 
-    if (listen(sock->descriptor, EVENT_MAX_SOCKETS - 1) < 0) {
+    if (listen(sock->descriptor, EVENT_LISTEN_BACKLOG) < 0) {
         close(sock->descriptor);
         return -1;
     }
@@ -614,13 +888,11 @@ int event_listen(event_sock_t *sock, uint16_t port, event_connection_cb cb)
     sock->state = EVENT_SOCK_LISTENING;
 
     // add event event to socket
-    event_t *event = event_find_free(loop, sock);
+    event_t *event = event_alloc(loop, sock, EVENT_CONNECTION_TYPE);
     assert(event != NULL);
+    sock->connection_event = event;
 
     // set event event
-    event->type = EVENT_CONNECTION_TYPE;
-    event->sock = sock;
-    memset(&event->data.connection, 0, sizeof(event_connection_t));
     event->data.connection.cb = cb;
 
     return 0;
@@ -640,19 +912,13 @@ void event_read_start(event_sock_t *sock,
     // read can only be performed on connected sockets
     assert(sock->state == EVENT_SOCK_CONNECTED);
 
-    event_t *event = event_find(sock->events, EVENT_READ_TYPE);
-    assert(event ==
-           NULL); // read stop must be called before call to event_read_start
+    // read stop must be called before call to event_read_start
+    assert(sock->read_event == NULL);
 
     // find free event
-    event_loop_t *loop = sock->loop;
-    event              = event_find_free(loop, sock);
+    event_t *event = event_alloc(sock->loop, sock, EVENT_READ_TYPE);
     assert(event != NULL); // should we return -1 instead?
-
-    // set event event
-    event->type = EVENT_READ_TYPE;
-    event->sock = sock;
-    memset(&event->data.read, 0, sizeof(event_read_t));
+    sock->read_event = event;
 
     // initialize read buffer
     cbuf_init(&event->data.read.buf, buf, bufsize);
@@ -672,11 +938,12 @@ int event_read(event_sock_t *sock, event_read_cb cb)
     assert(sock->state == EVENT_SOCK_CONNECTED);
 
     // see if there is already a read event set
-    event_t *event = event_find(sock->events, EVENT_READ_TYPE);
+    event_t *event = sock->read_event;
     assert(event != NULL); // event_read_start() must be called before
 
-    // Update read callback
-    event->data.read.cb = cb;
+    // Update read callback and notify it of the buffered data
+    event->data.read.cb    = cb;
+    event->data.read.ready = 1;
 
     return 0;
 }
@@ -687,13 +954,13 @@ int event_read_stop(event_sock_t *sock)
     assert(sock != NULL);
     assert(sock->loop != NULL);
 
-    event_t *event = event_find(sock->events, EVENT_READ_TYPE);
+    event_t *event = sock->read_event;
     if (event == NULL) {
         return 0;
     }
 
-    // remove read event from list
-    LL_DELETE(event, sock->events);
+    // remove read event from socket
+    sock->read_event = NULL;
 
     // reset read callback
     event->data.read.cb = NULL;
@@ -707,7 +974,7 @@ int event_read_stop(event_sock_t *sock)
     memcpy(event->data.read.buf.ptr, buf, len);
 
     // move event to loop unused list
-    LL_PUSH(event, sock->loop->events);
+    event_free(sock->loop, event);
 
     return len;
 }
@@ -723,25 +990,54 @@ void event_write_enable(event_sock_t *sock, uint8_t *buf, unsigned int bufsize)
     // write can only be performed on a connected socket
     assert(sock->state == EVENT_SOCK_CONNECTED);
 
-    // see if there is writing is already enabled
-    event_t *event = event_find(sock->events, EVENT_WRITE_TYPE);
-
     // only one write event is allowed per socket
-    assert(event == NULL);
+    assert(sock->write_event == NULL);
 
     // find free event
-    event_loop_t *loop = sock->loop;
-    event              = event_find_free(loop, sock);
+    event_t *event = event_alloc(sock->loop, sock, EVENT_WRITE_TYPE);
 
     // If this fails, you need to increase the value of EVENT_MAX_EVENTS
     assert(event != NULL);
-
-    // set event event and error callback
-    event->type = EVENT_WRITE_TYPE;
-    event->sock = sock;
+    sock->write_event = event;
 
     // initialize write buffer
     cbuf_init(&event->data.write.buf, buf, bufsize);
+    event->data.write.writable_cb = NULL;
+#ifndef CONTIKI
+    event->data.write.writable = 0;
+#endif
+}
+
+// add a write operation for the last size bytes of the write buffer
+static int event_write_queue(event_sock_t *sock,
+                             unsigned int size,
+                             event_write_cb cb)
+{
+    event_loop_t *loop = sock->loop;
+    event_t *event     = sock->write_event;
+    DEBUG("queued %u bytes for writing", size);
+
+    // add a write operation to the event
+    event_write_op_t *op = LL_MOVE(loop->writes, event->data.write.queue);
+
+    // this will fail if no write operation was checked first
+    assert(op != NULL);
+
+    op->cb    = cb;
+    op->bytes = size;
+#ifndef CONTIKI
+    op->fd = -1;
+#endif
+    METRICS_MAX(WRITE_BUF_MAX, cbuf_len(&event->data.write.buf));
+    METRICS_MAX(WRITE_OPS_MAX, LL_COUNT(event->data.write.queue));
+
+    // get free operation from loop
+#ifdef CONTIKI
+    // poll the socket to perform write
+    tcpip_poll_tcp(sock->uip_conn);
+#endif
+
+    return size;
 }
 
 int event_write(event_sock_t *sock,
@@ -758,37 +1054,146 @@ int event_write(event_sock_t *sock,
     // write can only be performed on a connected socket
     assert(sock->state == EVENT_SOCK_CONNECTED);
 
+    // this will fail if called before event_write_enable
+    event_t *event = sock->write_event;
+    assert(event != NULL);
+
+    // queue the whole write or fail, the copy can wrap
+    // around the end of the buffer
+    cbuf_t *cbuf = &event->data.write.buf;
+    if (size == 0 || sock->loop->writes == NULL || cbuf_has_ended(cbuf) ||
+        cbuf_maxlen(cbuf) - cbuf_len(cbuf) < (int)size) {
+        DEBUG("not enough space to queue %u bytes for writing", size);
+        return -1;
+    }
+    cbuf_push(cbuf, bytes, size);
+
+    return event_write_queue(sock, size, cb);
+}
+
+uint8_t *event_write_reserve(event_sock_t *sock, unsigned int size)
+{
+    // check socket status
+    assert(sock != NULL);
+    assert(sock->loop != NULL);
+
+    // write can only be performed on a connected socket
+    assert(sock->state == EVENT_SOCK_CONNECTED);
+
     // find write event
-    event_loop_t *loop = sock->loop;
-    event_t *event     = event_find(sock->events, EVENT_WRITE_TYPE);
+    event_t *event = sock->write_event;
 
-    // this will fail if event_write is called before event_write_enable
+    // this will fail if called before event_write_enable
     assert(event != NULL);
 
-    // write bytes to output buffer
-    int to_write = cbuf_push(&event->data.write.buf, bytes, size);
-    DEBUG("queued %d bytes for writing", to_write);
+    // a write operation is needed to commit
+    if (size == 0 || sock->loop->writes == NULL) {
+        return NULL;
+    }
 
-    // add a write operation to the event
-    if (to_write > 0) {
-        event_write_op_t *op = LL_MOVE(loop->writes, event->data.write.queue);
+    return cbuf_reserve(&event->data.write.buf, size);
+}
 
-        // If this fails increase CONFIG_EVENT_WRITE_QUEUE_SIZE
-        assert(op != NULL);
+int event_write_commit(event_sock_t *sock,
+                       unsigned int size,
+                       event_write_cb cb)
+{
+    assert(sock != NULL);
+    assert(sock->loop != NULL);
 
-        op->cb    = cb;
-        op->bytes = to_write;
+    // this will fail if called before event_write_enable
+    event_t *event = sock->write_event;
+    assert(event != NULL);
+
+    cbuf_commit(&event->data.write.buf, size);
+    return event_write_queue(sock, size, cb);
+}
+
+int event_write_space(event_sock_t *sock)
+{
+    assert(sock != NULL);
+    assert(sock->loop != NULL);
+
+    event_t *event = sock->write_event;
+    if (event == NULL || sock->state != EVENT_SOCK_CONNECTED ||
+        cbuf_has_ended(&event->data.write.buf)) {
+        return 0;
     }
 
-    // get free operation from loop
-#ifdef CONTIKI
-    // poll the socket to perform write
-    tcpip_poll_tcp(sock->uip_conn);
-#endif
+    // keep room for a frame header and its payload
+    event_write_op_t *ops = sock->loop->writes;
+    if (ops == NULL || ops->next == NULL) {
+        return 0;
+    }
+
+    cbuf_t *cbuf = &event->data.write.buf;
+    return cbuf_maxlen(cbuf) - cbuf_len(cbuf);
+}
 
-    return to_write;
+int event_write_contiguous(event_sock_t *sock)
+{
+    if (event_write_space(sock) <= 0) {
+        return 0;
+    }
+    return cbuf_contiguous(&sock->write_event->data.write.buf);
 }
 
+void event_write_wait(event_sock_t *sock, event_writable_cb cb)
+{
+    assert(sock != NULL);
+    assert(cb != NULL);
+
+    event_t *event = sock->write_event;
+
+    // this will fail if event_write_wait is called before event_write_enable
+    assert(event != NULL);
+
+    event->data.write.writable_cb = cb;
+}
+
+#ifndef CONTIKI
+int event_sendfile(event_sock_t *sock,
+                   int fd,
+                   off_t offset,
+                   unsigned int size,
+                   event_write_cb cb)
+{
+    // check socket status
+    assert(sock != NULL);
+    assert(sock->loop != NULL);
+    assert(fd >= 0);
+    assert(cb != NULL);
+
+    // write can only be performed on a connected socket
+    assert(sock->state == EVENT_SOCK_CONNECTED);
+
+    // find write event
+    event_loop_t *loop = sock->loop;
+    event_t *event     = sock->write_event;
+
+    // this will fail if event_sendfile is called before event_write_enable
+    assert(event != NULL);
+
+    if (size == 0 || cbuf_has_ended(&event->data.write.buf)) {
+        return 0;
+    }
+
+    event_write_op_t *op = LL_MOVE(loop->writes, event->data.write.queue);
+    if (op == NULL) {
+        return -1;
+    }
+
+    op->cb     = cb;
+    op->bytes  = size;
+    op->fd     = fd;
+    op->offset = offset;
+    DEBUG("queued %u bytes from file for writing", size);
+    METRICS_MAX(WRITE_OPS_MAX, LL_COUNT(event->data.write.queue));
+
+    return size;
+}
+#endif
+
 event_t *event_timer_set(event_sock_t *sock,
                          unsigned int millis,
                          event_timer_cb cb)
@@ -799,11 +1204,10 @@ event_t *event_timer_set(event_sock_t *sock,
     assert(cb != NULL);
 
     // Get a new event
-    event_t *event = event_find_free(sock->loop, sock);
+    event_t *event = event_alloc(sock->loop, sock, EVENT_TIMER_TYPE);
     assert(event != NULL);
+    LL_PUSH(event, sock->timers);
 
-    event->type          = EVENT_TIMER_TYPE;
-    event->sock          = sock;
     event->data.timer.cb = cb;
 
 #ifndef CONTIKI
@@ -847,10 +1251,21 @@ void event_timer_stop(event_t *timer)
     ctimer_stop(&timer->data.timer.ctimer);
 #endif
     // remove event from list
-    LL_DELETE(timer, sock->events);
+    LL_DELETE(timer, sock->timers);
 
     // move event to loop unused list
-    LL_PUSH(timer, sock->loop->events);
+    event_free(sock->loop, timer);
+}
+
+uint32_t event_time_ms(void)
+{
+#ifdef CONTIKI
+    return (uint32_t)(((uint64_t)clock_time() * 1000) / CLOCK_SECOND);
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_usec / 1000);
+#endif
 }
 
 int event_accept(event_sock_t *server, event_sock_t *client)
@@ -877,14 +1292,35 @@ int event_accept(event_sock_t *server, event_sock_t *client)
     client->descriptor = server->descriptor;
 #else
     event_loop_t *loop = client->loop;
+#ifdef __linux__
+    int clifd = accept4(
+      server->descriptor, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     int clifd = accept(server->descriptor, NULL, NULL);
+    if (clifd >= 0) {
+        fcntl(clifd, F_SETFL, fcntl(clifd, F_GETFL) | O_NONBLOCK);
+        fcntl(clifd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
     if (clifd < 0) {
-        ERROR("Failed to accept new client");
+        // the backlog is empty
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ERROR("Failed to accept new client");
+        }
         return -1;
     }
 
     // update max fds value
-    loop->nfds = clifd + 1;
+    if (clifd >= loop->nfds) {
+        loop->nfds = clifd + 1;
+    }
+
+    // not every system inherits these from the listening socket
+    event_sock_setopt(clifd, IPPROTO_TCP, TCP_NODELAY, loop->sockopts.nodelay);
+#ifdef TCP_NOTSENT_LOWAT
+    event_sock_setopt(
+      clifd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, loop->sockopts.notsent_lowat);
+#endif
 
     // add socket fd to read watchlist
     FD_SET(clifd, &loop->active_fds);
@@ -911,7 +1347,7 @@ int event_close(event_sock_t *sock, event_close_cb cb)
     sock->close_cb = cb;
 
     // find write event
-    event_t *event = event_find(sock->events, EVENT_WRITE_TYPE);
+    event_t *event = sock->write_event;
     if (event != NULL) { // mark the buffer as closed
         cbuf_end(&event->data.write.buf);
     }
@@ -935,6 +1371,9 @@ void event_loop_init(event_loop_t *loop)
 #ifndef CONTIKI
     // reset active file descriptor list
     FD_ZERO(&loop->active_fds);
+
+    // small frames should not wait for delayed acks
+    loop->sockopts.nodelay = 1;
 #endif
 
     // reset socket memory
@@ -947,13 +1386,12 @@ event_sock_t *event_sock_create(event_loop_t *loop)
 {
     assert(loop != NULL);
 
-    // check that the loop is initialized
-    // and there are available clients
-    assert(loop->sockets != NULL);
-
-    // get the first unused sock
-    // and remove sock from unsed list
+    // get the first unused sock and remove sock from
+    // unsed list, there may be no sockets available
     event_sock_t *sock = LL_POP(loop->sockets);
+    if (sock == NULL) {
+        return NULL;
+    }
 
     // reset sock memory
     memset(sock, 0, sizeof(event_sock_t));
@@ -969,6 +1407,38 @@ event_sock_t *event_sock_create(event_loop_t *loop)
     return sock;
 }
 
+#ifndef CONTIKI
+void event_loop_sockopts(event_loop_t *loop, const event_sockopts_t *opts)
+{
+    assert(loop != NULL && opts != NULL);
+    loop->sockopts = *opts;
+}
+
+int event_sock_getopts(event_sock_t *sock, event_sockopts_t *opts)
+{
+    assert(sock != NULL && opts != NULL);
+    if (sock->descriptor < 0) {
+        return -1;
+    }
+
+    int fd = sock->descriptor;
+    memset(opts, 0, sizeof(event_sockopts_t));
+    opts->nodelay = event_sock_getopt(fd, IPPROTO_TCP, TCP_NODELAY);
+    opts->sndbuf  = event_sock_getopt(fd, SOL_SOCKET, SO_SNDBUF);
+    opts->rcvbuf  = event_sock_getopt(fd, SOL_SOCKET, SO_RCVBUF);
+#ifdef TCP_FASTOPEN
+    opts->fastopen = event_sock_getopt(fd, IPPROTO_TCP, TCP_FASTOPEN);
+#endif
+#ifdef TCP_DEFER_ACCEPT
+    opts->defer_accept = event_sock_getopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    opts->notsent_lowat = event_sock_getopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#endif
+    return 0;
+}
+#endif
+
 int event_sock_unused(event_loop_t *loop)
 {
     assert(loop != NULL);
@@ -1023,6 +1493,9 @@ void event_loop(event_loop_t *loop)
 
         // handle unprocessed read data
         event_loop_pending(loop);
+
+        // send the writes queued during the iteration
+        event_loop_flush(loop);
 #endif
 
         // perform close events
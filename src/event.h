@@ -5,6 +5,7 @@
 #ifndef CONTIKI
 #include <sys/select.h>
 #include <sys/time.h>
+#include <sys/types.h>
 #else
 #include "net/ipv6/tcpip.h"
 #endif
@@ -30,6 +31,31 @@
 #define EVENT_MAX_EVENTS (EVENT_MAX_SOCKETS * 3)
 #endif
 
+// Defines the number of pending connections for listening sockets
+#ifndef EVENT_LISTEN_BACKLOG
+#define EVENT_LISTEN_BACKLOG (EVENT_MAX_SOCKETS - 1)
+#endif
+
+// Defines the maximum number of connections accepted from
+// the backlog on each loop iteration
+#ifndef EVENT_ACCEPT_BUDGET
+#define EVENT_ACCEPT_BUDGET (EVENT_MAX_SOCKETS)
+#endif
+
+// Defines the number of buffered bytes that force a write before
+// the end of the loop iteration. Writes are otherwise corked until
+// all the read callbacks have run. 0 uses 3/4 of the write buffer
+#ifndef EVENT_WRITE_HIGH_WATER
+#define EVENT_WRITE_HIGH_WATER (0)
+#endif
+
+// Defines the number of buffered bytes below which a socket is
+// writable again (see event_write_wait()). 0 uses half of the
+// write buffer
+#ifndef EVENT_WRITE_LOW_WATER
+#define EVENT_WRITE_LOW_WATER (0)
+#endif
+
 // Defines the total number of write operation handlers
 #ifndef EVENT_WRITE_QUEUE_SIZE
 #define EVENT_WRITE_QUEUE_SIZE (4 * EVENT_MAX_SOCKETS)
@@ -56,6 +82,10 @@ typedef int (*event_read_cb)(struct event_sock *sock, int size, uint8_t *bytes);
 // Remaining contains the number of remaining bytes in the write buffer
 typedef void (*event_write_cb)(struct event_sock *sock, int status);
 
+// Called once, when the write buffer drains below the low-water
+// mark after event_write_wait()
+typedef void (*event_writable_cb)(struct event_sock *sock);
+
 // Will be called after all write operations are finished and
 // the socket is closed
 typedef void (*event_close_cb)(struct event_sock *sock);
@@ -90,6 +120,9 @@ typedef struct event_read
     // type variables
     cbuf_t buf;
     event_read_cb cb;
+    // bytes were received or the callback was updated since the
+    // last notification
+    uint8_t ready;
 } event_read_t;
 
 typedef struct event_write_op
@@ -97,6 +130,12 @@ typedef struct event_write_op
     struct event_write_op *next;
     unsigned int bytes;
     event_write_cb cb;
+#ifndef CONTIKI
+    // file to send from for event_sendfile operations
+    // or -1 if the bytes are in the write buffer
+    int fd;
+    off_t offset;
+#endif
 } event_write_op_t;
 
 typedef struct event_write
@@ -104,10 +143,14 @@ typedef struct event_write
     // type variables
     cbuf_t buf;
     event_write_op_t *queue;
+    event_writable_cb writable_cb;
 #ifdef CONTIKI
     // > 0 if there is data waiting
     // to be acked
     unsigned int sending;
+#else
+    // the socket was writable on the last poll
+    uint8_t writable;
 #endif
 } event_write_t;
 
@@ -159,8 +202,13 @@ typedef struct event_sock
         EVENT_SOCK_CLOSING
     } state;
 
-    // event list
-    event_t *events;
+    // events by type, NULL if not set
+    event_t *connection_event;
+    event_t *read_event;
+    event_t *write_event;
+
+    // list of timer events
+    event_t *timers;
 
     // close operation
     event_close_cb close_cb;
@@ -170,6 +218,20 @@ typedef struct event_sock
 #endif
 } event_sock_t;
 
+#ifndef CONTIKI
+// Socket options applied by event_listen() and event_accept().
+// Values set to 0 keep the system default
+typedef struct event_sockopts
+{
+    int nodelay;       // disable Nagle's algorithm (TCP_NODELAY)
+    int fastopen;      // TCP Fast Open queue length for listening sockets
+    int defer_accept;  // seconds to wait for the first bytes before accept
+    int sndbuf;        // send buffer size (SO_SNDBUF)
+    int rcvbuf;        // receive buffer size (SO_RCVBUF)
+    int notsent_lowat; // unsent bytes before writable (TCP_NOTSENT_LOWAT)
+} event_sockopts_t;
+#endif
+
 typedef struct event_loop
 {
     // list of active sockets
@@ -187,6 +249,9 @@ typedef struct event_loop
     // list of file descriptors
     fd_set active_fds;
     int nfds;
+
+    // options for new sockets
+    event_sockopts_t sockopts;
 #endif
 } event_loop_t;
 
@@ -211,7 +276,8 @@ void event_read_start(event_sock_t *sock,
                       event_read_cb cb);
 
 // Update the notification callback for read operations in the given socket
-// event_read_start MUST be called first
+// event_read_start MUST be called first. The new callback is notified of
+// the buffered bytes on the next loop iteration, even if no new data arrive
 int event_read(event_sock_t *sock, event_read_cb cb);
 
 // Stop receiving read notifications
@@ -230,12 +296,55 @@ int event_read_stop(event_sock_t *sock);
 void event_write_enable(event_sock_t *sock, uint8_t *buf, unsigned int bufsize);
 
 // Write to the output buffer, will notify the callback when all bytes are
-// written
+// written. Writes are reserve-or-fail: it returns size if all bytes
+// were queued, or -1 without queueing anything if there is not enough
+// space in the buffer, no write operation is available or the socket
+// is closing
 int event_write(event_sock_t *sock,
                 unsigned int size,
                 uint8_t *bytes,
                 event_write_cb cb);
 
+// Reserve size contiguous bytes in the write buffer, so a write can be
+// encoded in place. It returns NULL if event_write() would fail for the
+// same size or if size is larger than event_write_contiguous(). The
+// bytes are queued by event_write_commit()
+uint8_t *event_write_reserve(event_sock_t *sock, unsigned int size);
+
+// Queue size bytes written in the memory returned by event_write_reserve(),
+// will notify the callback when all bytes are written. The callback can be
+// NULL if a following write notifies the caller
+int event_write_commit(event_sock_t *sock,
+                       unsigned int size,
+                       event_write_cb cb);
+
+// Return the number of bytes that can be queued with event_write().
+// It is 0 if less than two write operations are available, so a
+// frame header and its payload can always be queued together
+int event_write_space(event_sock_t *sock);
+
+// Return the largest size event_write_reserve() can currently provide.
+// It is smaller than event_write_space() when the free space wraps
+// around the end of the buffer
+int event_write_contiguous(event_sock_t *sock);
+
+// Notify the callback once the write buffer drains below
+// EVENT_WRITE_LOW_WATER bytes and there is space for new writes
+void event_write_wait(event_sock_t *sock, event_writable_cb cb);
+
+#ifndef CONTIKI
+// Queue sending size bytes of the file descriptor fd, starting from offset,
+// after all previously queued writes. The bytes are sent to the socket
+// directly from the file (using sendfile() where available), without
+// going through the write buffer. The file must remain open until the
+// callback is notified. It returns -1 if no write operation is available
+int event_sendfile(event_sock_t *sock,
+                   int fd,
+                   off_t offset,
+                   unsigned int size,
+                   event_write_cb cb);
+#endif
+
 // Notify the callback on elapsed time
 event_t *event_timer_set(event_sock_t *sock,
                          unsigned int millis,
@@ -247,6 +356,10 @@ void event_timer_reset(event_t *timer);
 // Stop the given timer (will fail if called event other than a timer)
 void event_timer_stop(event_t *timer);
 
+// Get the current time in milliseconds. The value wraps around, so
+// it is only useful to measure intervals
+uint32_t event_time_ms(void);
+
 // Close the socket
 // will notify the callback after all write operations are finished
 int event_close(event_sock_t *sock, event_close_cb cb);
@@ -259,8 +372,18 @@ int event_accept(event_sock_t *server, event_sock_t *client);
 // Initialize a new event_loop
 void event_loop_init(event_loop_t *loop);
 
+#ifndef CONTIKI
+// Set the options for sockets created by event_listen() and
+// event_accept() from now on. By default only TCP_NODELAY is set
+void event_loop_sockopts(event_loop_t *loop, const event_sockopts_t *opts);
+
+// Read the effective options of a connected or listening socket.
+// Options not supported by the system are set to 0
+int event_sock_getopts(event_sock_t *sock, event_sockopts_t *opts);
+#endif
+
 // Obtain a new free socket from the event loop
-// it will fail if there are no more sockets available
+// it returns NULL if there are no more sockets available
 event_sock_t *event_sock_create(event_loop_t *loop);
 
 // Return number of available free sockets
@@ -8,6 +8,8 @@
 #include "buffer.h"
 #include "frames.h"
 #include "http2.h"
+#include "macros.h"
+#include "metrics.h"
 
 #define LOG_MODULE LOG_MODULE_FRAME
 #include "logging.h"
@@ -20,10 +22,6 @@
 #define FRAME_MAX_SIZE (CONFIG_FRAME_MAX_SIZE)
 #endif
 
-// reserve some static memory
-// to create frames
-static uint8_t frame_bytes[FRAME_MAX_SIZE];
-
 /*
  * Function: frame_header_to_bytes
  * Convert a frame header into an array of bytes
@@ -43,6 +41,21 @@ int frame_header_to_bytes(frame_header_t *frame_header, uint8_t *byte_array)
     return 9;
 }
 
+// queue a frame encoded with event_write_reserve() and count
+// it as sent once it is queued
+static int frame_commit(event_sock_t *socket,
+                        uint8_t type,
+                        int size,
+                        event_write_cb cb)
+{
+    (void)type;
+    int rc = event_write_commit(socket, size, cb);
+    if (rc > 0) {
+        METRICS_FRAME_OUT(type);
+    }
+    return rc;
+}
+
 void frame_parse_header(frame_header_t *header,
                         uint8_t *data,
                         unsigned int size)
@@ -64,8 +77,11 @@ int send_ping_frame(event_sock_t *socket,
                     int ack,
                     event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + 8);
+    if (frame == NULL) {
+        return -1;
+    }
 
     // Create the frame header
     frame_header_t header;
@@ -76,14 +92,14 @@ int send_ping_frame(event_sock_t *socket,
     header.stream_id = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     /*We put the payload on the reserved buffer */
-    memcpy(frame_bytes + frame_size, opaque_data, header.length);
+    memcpy(frame + frame_size, opaque_data, header.length);
     frame_size += header.length;
 
     // We write the ping to the network
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_goaway_frame(event_sock_t *socket,
@@ -91,8 +107,11 @@ int send_goaway_frame(event_sock_t *socket,
                       uint32_t last_open_stream_id,
                       event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + 8);
+    if (frame == NULL) {
+        return -1;
+    }
 
     // Create the frame header
     frame_header_t header;
@@ -103,16 +122,16 @@ int send_goaway_frame(event_sock_t *socket,
     header.reserved  = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     /*We put the payload on the buffer*/
-    buffer_put_u31(frame_bytes + frame_size, last_open_stream_id);
+    buffer_put_u31(frame + frame_size, last_open_stream_id);
     frame_size += 4;
 
-    buffer_put_u32(frame_bytes + frame_size, error_code);
+    buffer_put_u32(frame + frame_size, error_code);
     frame_size += 4;
 
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_settings_frame(event_sock_t *socket,
@@ -120,12 +139,15 @@ int send_settings_frame(event_sock_t *socket,
                         uint32_t settings_values[],
                         event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
-
     uint8_t count  = 6;
     uint16_t ids[] = { 0x1, 0x2, 0x3, 0x4, 0x5, 0x6 };
 
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + (ack ? 0 : 6 * count));
+    if (frame == NULL) {
+        return -1;
+    }
+
     // Create the frame header
     frame_header_t header;
     header.length    = ack ? 0 : (6 * count);
@@ -135,21 +157,21 @@ int send_settings_frame(event_sock_t *socket,
     header.stream_id = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     // write payload
     for (int i = 0; i < count && !ack; i++) {
         uint16_t identifier = ids[i];
-        buffer_put_u16(frame_bytes + frame_size, identifier);
+        buffer_put_u16(frame + frame_size, identifier);
         frame_size += 2;
 
         uint32_t value = settings_values[i];
-        buffer_put_u32(frame_bytes + frame_size, value);
+        buffer_put_u32(frame + frame_size, value);
         frame_size += 4;
     }
 
     // write to socket
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_headers_frame(event_sock_t *socket,
@@ -159,13 +181,18 @@ int send_headers_frame(event_sock_t *socket,
                        uint8_t end_stream,
                        event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    // the encoded size is not known in advance, reserve
+    // as much as the write buffer allows in place
+    int maxlen = MIN(FRAME_MAX_SIZE, event_write_contiguous(socket));
+    uint8_t *frame = event_write_reserve(socket, maxlen);
+    if (frame == NULL || maxlen <= 9) {
+        return -1;
+    }
 
     // try to encode hpack into the buffer, leaving
     // space for the frame header
-    int encoded_size = hpack_encode(
-      dynamic_table, headers_list, frame_bytes + 9, FRAME_MAX_SIZE - 9);
+    int encoded_size =
+      hpack_encode(dynamic_table, headers_list, frame + 9, maxlen - 9);
 
     if (encoded_size < 0) {
         return encoded_size;
@@ -181,10 +208,44 @@ int send_headers_frame(event_sock_t *socket,
     header.reserved  = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
     frame_size += encoded_size;
 
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
+}
+
+int send_header_block_frame(event_sock_t *socket,
+                            uint8_t *header_block,
+                            uint32_t size,
+                            uint32_t stream_id,
+                            uint8_t end_stream,
+                            event_write_cb cb)
+{
+    if (size + 9 > FRAME_MAX_SIZE) {
+        return -1;
+    }
+
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + size);
+    if (frame == NULL) {
+        return -1;
+    }
+
+    // Create the frame header
+    frame_header_t header;
+    header.length = size;
+    header.type   = FRAME_HEADERS_TYPE;
+    header.flags  = FRAME_FLAGS_END_HEADERS; // we never send continuation
+    header.flags |= (uint8_t)(end_stream ? FRAME_FLAGS_END_STREAM : 0x0);
+    header.stream_id = stream_id;
+    header.reserved  = 0;
+
+    // copy header data into the beginning of the frame
+    int frame_size = frame_header_to_bytes(&header, frame);
+    memcpy(frame + frame_size, header_block, size);
+    frame_size += size;
+
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_window_update_frame(event_sock_t *socket,
@@ -192,8 +253,11 @@ int send_window_update_frame(event_sock_t *socket,
                              uint32_t stream_id,
                              event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + 4);
+    if (frame == NULL) {
+        return -1;
+    }
 
     // Create the frame header
     frame_header_t header;
@@ -204,14 +268,14 @@ int send_window_update_frame(event_sock_t *socket,
     header.flags     = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     /*Then we put the payload*/
-    buffer_put_u31(frame_bytes + frame_size, window_size_increment);
+    buffer_put_u31(frame + frame_size, window_size_increment);
     frame_size += header.length;
 
     // write to the socket
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_rst_stream_frame(event_sock_t *socket,
@@ -219,8 +283,11 @@ int send_rst_stream_frame(event_sock_t *socket,
                           uint32_t stream_id,
                           event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + 4);
+    if (frame == NULL) {
+        return -1;
+    }
 
     // Create the frame header
     frame_header_t header;
@@ -231,14 +298,14 @@ int send_rst_stream_frame(event_sock_t *socket,
     header.reserved  = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     /*Then we put the payload*/
-    buffer_put_u32(frame_bytes + frame_size, error_code);
+    buffer_put_u32(frame + frame_size, error_code);
     frame_size += header.length;
 
     // write to the socket
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
 }
 
 int send_data_frame(event_sock_t *socket,
@@ -248,12 +315,17 @@ int send_data_frame(event_sock_t *socket,
                     uint8_t end_stream,
                     event_write_cb cb)
 {
-    // reset the reserved memory
-    memset(frame_bytes, 0, FRAME_MAX_SIZE);
+    if (size + 9 > FRAME_MAX_SIZE) {
+        return -1;
+    }
+
+    // encode the frame directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9 + size);
+    if (frame == NULL) {
+        return -1;
+    }
 
     // Create the frame header
-    // TODO: check if frame fits in frame_size before setting
-    // end stream flag?
     frame_header_t header;
     header.length    = size;
     header.type      = FRAME_DATA_TYPE;
@@ -262,12 +334,57 @@ int send_data_frame(event_sock_t *socket,
     header.reserved  = 0;
 
     // copy header data into the beginning of the frame
-    int frame_size = frame_header_to_bytes(&header, frame_bytes);
+    int frame_size = frame_header_to_bytes(&header, frame);
 
     // copy data into the frame
-    memcpy(frame_bytes + frame_size, data, size);
+    memcpy(frame + frame_size, data, size);
     frame_size += size;
 
     // write to the socket
-    return event_write(socket, frame_size, frame_bytes, cb);
+    return frame_commit(socket, header.type, frame_size, cb);
+}
+
+#ifndef CONTIKI
+int send_data_frame_file(event_sock_t *socket,
+                         int fd,
+                         off_t offset,
+                         uint32_t size,
+                         uint32_t stream_id,
+                         uint8_t end_stream,
+                         event_write_cb cb)
+{
+    // the header and the file payload must be queued together. The
+    // write space is 0 if the buffer has ended or if there are not
+    // two write operations available, so event_sendfile() cannot fail
+    // after the header is committed
+    if (size == 0 || event_write_contiguous(socket) < 9) {
+        return -1;
+    }
+
+    // encode the frame header directly in the socket write buffer
+    uint8_t *frame = event_write_reserve(socket, 9);
+    if (frame == NULL) {
+        return -1;
+    }
+
+    // Create the frame header
+    frame_header_t header;
+    header.length    = size;
+    header.type      = FRAME_DATA_TYPE;
+    header.flags     = (uint8_t)(end_stream ? FRAME_FLAGS_END_STREAM : 0x0);
+    header.stream_id = stream_id;
+    header.reserved  = 0;
+
+    // only the file operation notifies the callback
+    int frame_size = frame_header_to_bytes(&header, frame);
+    event_write_commit(socket, frame_size, NULL);
+
+    // the payload is sent directly from the file
+    int sent = event_sendfile(socket, fd, offset, size, cb);
+    assert(sent == (int)size);
+    (void)sent;
+    METRICS_FRAME_OUT(FRAME_DATA_TYPE);
+
+    return frame_size + size;
 }
+#endif
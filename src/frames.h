@@ -40,6 +40,13 @@ typedef struct frame_header
     uint32_t stream_id : 31;
 } frame_header_t; // 72 bits-> 9 bytes
 
+/*
+ * Function: frame_header_to_bytes
+ * Write the 9 byte representation of the frame header
+ * Return the number of bytes written
+ */
+int frame_header_to_bytes(frame_header_t *frame_header, uint8_t *byte_array);
+
 void frame_parse_header(frame_header_t *header,
                         uint8_t *data,
                         unsigned int size);
@@ -94,6 +101,23 @@ int send_headers_frame(event_sock_t *socket,
                        uint32_t stream_id,
                        uint8_t end_stream,
                        event_write_cb cb);
+/*
+ * Function: send_header_block_frame
+ * Queues a write of a headers frame with an already encoded header block.
+ * The block must not depend on the connection dynamic table state
+ * Input: ->socket: event socket
+ *        ->header_block: encoded header block
+ *        ->size: size of the encoded header block
+ *        ->stream_id: stream id to write on headers frame header
+ *        ->end_stream: boolean that indicates if END_STREAM_FLAG must be set
+ *        ->cb: function to call on successful data send
+ * Output: actual number of bytes queued or -1 if the block does not fit */
+int send_header_block_frame(event_sock_t *socket,
+                            uint8_t *header_block,
+                            uint32_t size,
+                            uint32_t stream_id,
+                            uint8_t end_stream,
+                            event_write_cb cb);
 /*
  * Function: send_window_update_frame
  * Queues a write of a window_update frame to the socket.
@@ -132,7 +156,8 @@ int send_rst_stream_frame(event_sock_t *socket,
  *        -> stream_id: identifier of the stream
  *        -> end_stream: boolean that indicates if END_STREAM_FLAG must be set
  *        -> cb: function to call when data is sent
- * Output: actual number of bytes queued
+ * Output: actual number of bytes queued or -1 if the frame does not fit
+ * in the write buffer
  */
 int send_data_frame(event_sock_t *socket,
                     uint8_t *data,
@@ -140,4 +165,30 @@ int send_data_frame(event_sock_t *socket,
                     uint32_t stream_id,
                     uint8_t end_stream,
                     event_write_cb cb);
+
+#ifndef CONTIKI
+/*
+ * Function: send_data_frame_file
+ * Queues a write of a data frame to the socket, where the payload is read
+ * from the given file (see event_sendfile()) instead of being copied
+ * into the write buffer
+ * Input: -> socket: event socket
+ *        -> fd: open file descriptor to read the payload from
+ *        -> offset: position of the payload in the file
+ *        -> size: size of the payload
+ *        -> stream_id: identifier of the stream
+ *        -> end_stream: boolean that indicates if END_STREAM_FLAG must be set
+ *        -> cb: function to call when the payload is sent
+ * Output: actual number of bytes queued or -1 if the frame could not
+ * be queued
+ */
+int send_data_frame_file(event_sock_t *socket,
+                         int fd,
+                         off_t offset,
+                         uint32_t size,
+                         uint32_t stream_id,
+                         uint8_t end_stream,
+                         event_write_cb cb);
+#endif
+
 #endif // TWO_FRAMES_V3_H
@@ -4,6 +4,7 @@
 #include "hpack/decoder.h"
 #include "hpack/huffman.h"
 #include "hpack/utils.h"
+#include "metrics.h"
 
 #define LOG_MODULE LOG_MODULE_HPACK
 #include "logging.h"
@@ -297,9 +298,11 @@ int32_t hpack_decoder_decode_string(char *str, uint32_t str_length,
                                     uint8_t huffman_bit)
 {
     if (huffman_bit) {
+        METRICS_INC(HPACK_IN_HUFFMAN);
         return hpack_decoder_decode_huffman_string(
           str, str_length, encoded_buffer, encoded_buffer_length);
     } else {
+        METRICS_INC(HPACK_IN_RAW);
         return hpack_decoder_decode_non_huffman_string(
           str, str_length, encoded_buffer, encoded_buffer_length);
     }
@@ -579,6 +582,7 @@ int hpack_decoder_decode_header(hpack_dynamic_table_t *dynamic_table,
 {
     if (encoded_header->preamble == INDEXED_HEADER_FIELD) {
         DEBUG("Decoding an indexed header field");
+        METRICS_INC(HPACK_IN_INDEXED);
         return hpack_decoder_decode_indexed_header_field(
           dynamic_table, encoded_header, tmp_name, tmp_value);
     } else if (encoded_header->preamble == DYNAMIC_TABLE_SIZE_UPDATE) {
@@ -590,6 +594,7 @@ int hpack_decoder_decode_header(hpack_dynamic_table_t *dynamic_table,
                encoded_header->preamble == LITERAL_HEADER_FIELD_NEVER_INDEXED ||
                encoded_header->preamble ==
                  LITERAL_HEADER_FIELD_WITH_INCREMENTAL_INDEXING) {
+        METRICS_INC(HPACK_IN_LITERAL);
         return hpack_decoder_decode_literal_header_field(
           dynamic_table, encoded_header, tmp_name, tmp_value);
     }
@@ -4,6 +4,7 @@
 #include "hpack/encoder.h"
 #include "hpack/huffman.h" /* for huffman_encoded_word_t, hpack_huffman_...*/
 #include "hpack/utils.h"
+#include "metrics.h"
 
 #define LOG_MODULE LOG_MODULE_HPACK
 #include "logging.h"
@@ -248,14 +249,18 @@ int hpack_encoder_encode_string(char *str,
                                 uint8_t *encoded_string,
                                 uint32_t buffer_size)
 {
+#if HPACK_HUFFMAN
     int rc =
       hpack_encoder_encode_huffman_string(str, encoded_string, buffer_size);
 
-    if (rc < 0 || (uint32_t)rc > strlen(str)) {
-        return hpack_encoder_encode_non_huffman_string(
-          str, encoded_string, buffer_size);
+    if (rc >= 0 && (uint32_t)rc <= strlen(str)) {
+        METRICS_INC(HPACK_OUT_HUFFMAN);
+        return rc;
     }
-    return rc;
+#endif
+    METRICS_INC(HPACK_OUT_RAW);
+    return hpack_encoder_encode_non_huffman_string(
+      str, encoded_string, buffer_size);
 }
 
 /*
@@ -384,6 +389,13 @@ int hpack_encoder_encode_header(hpack_encoded_header_t *encoded_header,
     }
     // attach the preamble to the first byte of the buffer
     encoded_buffer[0] |= encoded_header->preamble;
+#if TWO_METRICS
+    if (encoded_header->preamble == INDEXED_HEADER_FIELD) {
+        METRICS_INC(HPACK_OUT_INDEXED);
+    } else {
+        METRICS_INC(HPACK_OUT_LITERAL);
+    }
+#endif
     return pointer;
 }
 
@@ -473,3 +485,81 @@ int hpack_encoder_encode_dynamic_size_update(
     return -2;
 #endif
 }
+
+/*
+ * Function: hpack_encoder_encode_static
+ * Encodes a header field using only the static table. A full match is
+ * encoded as an indexed header field, otherwise as a literal header field
+ * without indexing (using the indexed name if available). Since the dynamic
+ * table is never read nor modified, the result is valid for any connection
+ * and can be cached and reused verbatim
+ * Input:
+ *      -> *name_string: name of the header field to encode
+ *      -> *value_string: value of the header field to encode
+ *      -> *encoded_buffer: Buffer to store the result of the encoding process
+ *      -> buffer_size: Size of the buffer
+ * Output:
+ *  Return the number of bytes written in encoded_buffer or < 0 if it fails
+ */
+int hpack_encoder_encode_static(char *name_string,
+                                char *value_string,
+                                uint8_t *encoded_buffer,
+                                uint32_t buffer_size)
+{
+    hpack_encoded_header_t encoded_header = { 0 };
+
+    int index = hpack_tables_static_find_index(name_string, value_string);
+    if (index > 0) {
+        encoded_header.preamble = INDEXED_HEADER_FIELD;
+        encoded_header.index    = (uint32_t)index;
+    } else {
+        index = hpack_tables_static_find_index_name(name_string);
+        encoded_header.preamble = LITERAL_HEADER_FIELD_WITHOUT_INDEXING;
+        encoded_header.index    = index > 0 ? (uint32_t)index : 0;
+    }
+
+    return hpack_encoder_encode_header(
+      &encoded_header, name_string, value_string, encoded_buffer, buffer_size);
+}
+
+/*
+ * Function: hpack_encoder_encode_content_length
+ * Encodes a content-length header field as a literal without indexing
+ * referencing the static table name, with a raw (non huffman) decimal value.
+ * Input:
+ *      -> content_length: value of the header
+ *      -> *encoded_buffer: Buffer to store the result of the encoding process
+ *      -> buffer_size: Size of the buffer
+ * Output:
+ *  Return the number of bytes written in encoded_buffer or -2 if the buffer
+ * is too small
+ */
+int hpack_encoder_encode_content_length(uint32_t content_length,
+                                        uint8_t *encoded_buffer,
+                                        uint32_t buffer_size)
+{
+    uint8_t digits[10];
+    uint8_t len = 0;
+
+    do {
+        digits[len++] = (uint8_t)('0' + content_length % 10);
+        content_length /= 10;
+    } while (content_length > 0);
+
+    // preamble and name index (2 bytes) + value length + digits
+    if ((uint32_t)len + 3 > buffer_size) {
+        DEBUG("Buffer too small to encode content-length");
+        return HPACK_INTERNAL_ERROR;
+    }
+
+    int pointer = hpack_encoder_encode_integer(
+      HPACK_TABLES_CONTENT_LENGTH_INDEX, 4, encoded_buffer);
+    encoded_buffer[0] |= LITERAL_HEADER_FIELD_WITHOUT_INDEXING;
+    encoded_buffer[pointer++] = len;
+    for (uint8_t i = 0; i < len; i++) {
+        encoded_buffer[pointer++] = digits[len - 1 - i];
+    }
+    METRICS_INC(HPACK_OUT_LITERAL);
+    METRICS_INC(HPACK_OUT_RAW);
+    return pointer;
+}
@@ -12,6 +12,11 @@
 int hpack_encoder_encode(hpack_dynamic_table_t *dynamic_table,
                          header_list_t *headers_out, uint8_t *encoded_buffer,
                          uint32_t buffer_size);
+int hpack_encoder_encode_static(char *name_string, char *value_string,
+                                uint8_t *encoded_buffer, uint32_t buffer_size);
+int hpack_encoder_encode_content_length(uint32_t content_length,
+                                        uint8_t *encoded_buffer,
+                                        uint32_t buffer_size);
 int hpack_encoder_encode_dynamic_size_update(
   hpack_dynamic_table_t *dynamic_table, uint32_t max_size,
   uint8_t *encoded_buffer);
@@ -50,6 +50,42 @@ int hpack_encode(hpack_dynamic_table_t *dynamic_table,
     return rc;
 }
 
+/*
+ * Function: hpack_encode_static
+ * Encodes a header field using only the static table, the result does not
+ * depend on the connection dynamic table and can be safely cached
+ * Input:
+ *      -> *name: name of the header field to encode
+ *      -> *value: value of the header field to encode
+ *      -> *encoded_buffer: Buffer to store the result of the encoding process
+ *      -> buffer_size: size of the buffer
+ * Output:
+ *  Return the number of bytes written in encoded_buffer or < 0 if it fails
+ */
+int hpack_encode_static(char *name, char *value, uint8_t *encoded_buffer,
+                        uint32_t buffer_size)
+{
+    return hpack_encoder_encode_static(name, value, encoded_buffer,
+                                       buffer_size);
+}
+
+/*
+ * Function: hpack_encode_content_length
+ * Encodes a content-length header field without touching the dynamic table
+ * Input:
+ *      -> content_length: value of the header field
+ *      -> *encoded_buffer: Buffer to store the result of the encoding process
+ *      -> buffer_size: size of the buffer
+ * Output:
+ *  Return the number of bytes written in encoded_buffer or < 0 if it fails
+ */
+int hpack_encode_content_length(uint32_t content_length,
+                                uint8_t *encoded_buffer, uint32_t buffer_size)
+{
+    return hpack_encoder_encode_content_length(content_length, encoded_buffer,
+                                               buffer_size);
+}
+
 /*
  * Function: encode_dynamic_size_update
  * Input:
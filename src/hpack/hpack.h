@@ -18,6 +18,10 @@ int hpack_decode(hpack_dynamic_table_t *dynamic_table, uint8_t *header_block,
 int hpack_encode(hpack_dynamic_table_t *dynamic_table,
                  header_list_t *headers_out, uint8_t *encoded_buffer,
                  uint32_t buffer_size);
+int hpack_encode_static(char *name, char *value, uint8_t *encoded_buffer,
+                        uint32_t buffer_size);
+int hpack_encode_content_length(uint32_t content_length,
+                                uint8_t *encoded_buffer, uint32_t buffer_size);
 void hpack_dynamic_change_max_size(hpack_dynamic_table_t *dynamic_table,
                                    uint32_t incoming_max_table_size);
 
@@ -593,24 +593,24 @@ int8_t hpack_tables_find_entry_name(hpack_dynamic_table_t *dynamic_table,
 }
 
 /*
- *  Function: hpack_tables_find_index
+ *  Function: hpack_tables_static_find_index
  *  Given a buffer containing a name and another buffer containing the value of
- * a header Searches both static and Dynamic tables Input:
- *      -> *dynamic_table: Dynamic table to search
+ * a header, searches only the static table. Lookups in the static table
+ * never depend on the state of a dynamic table, so the result is valid for
+ * any connection
+ *  Input:
  *      -> *name: Buffer containing the name of a header to search
  *      -> *value: Buffer containing the value of a header to search
  *  Output:
- *      Returns the index in the static or dynamic table containing both name
- * and value if successful, otherwise it returns -2.
+ *      Returns the index in the static table containing both name and value
+ * if successful, otherwise it returns -2.
  */
-int hpack_tables_find_index(hpack_dynamic_table_t *dynamic_table, char *name,
-                            char *value)
+int hpack_tables_static_find_index(char *name, char *value)
 {
-    // Search first in static table
     char *table_name  = hpack_static_table.name_table;
     char *table_value = hpack_static_table.value_table;
 
-    for (uint8_t i = 0; i < HPACK_TABLES_FIRST_INDEX_DYNAMIC; i++) {
+    for (uint8_t i = 0; i < STATIC_TABLE_SIZE; i++) {
         if ((strlen(name) == strlen(table_name) &&
              strncmp(table_name, name, strlen(name)) == 0) &&
             ((strlen(value) == strlen(table_value) &&
@@ -620,6 +620,51 @@ int hpack_tables_find_index(hpack_dynamic_table_t *dynamic_table, char *name,
         table_name += strlen(table_name) + 1;
         table_value += strlen(table_value) + 1;
     }
+    return HPACK_INTERNAL_ERROR;
+}
+
+/*
+ *  Function: hpack_tables_static_find_index_name
+ *  Given a buffer containing a name a header, searches only the static table
+ *  Input:
+ *      -> *name: Buffer containing the name of a header to search
+ *  Output:
+ *      Returns the index in the static table containing name if
+ * successful, otherwise it returns -2.
+ */
+int hpack_tables_static_find_index_name(char *name)
+{
+    char *table_name = hpack_static_table.name_table;
+
+    for (uint8_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+        if (strlen(name) == strlen(table_name) &&
+            strncmp(table_name, name, strlen(name)) == 0) {
+            return i + 1;
+        }
+        table_name += strlen(table_name) + 1;
+    }
+    return HPACK_INTERNAL_ERROR;
+}
+
+/*
+ *  Function: hpack_tables_find_index
+ *  Given a buffer containing a name and another buffer containing the value of
+ * a header Searches both static and Dynamic tables Input:
+ *      -> *dynamic_table: Dynamic table to search
+ *      -> *name: Buffer containing the name of a header to search
+ *      -> *value: Buffer containing the value of a header to search
+ *  Output:
+ *      Returns the index in the static or dynamic table containing both name
+ * and value if successful, otherwise it returns -2.
+ */
+int hpack_tables_find_index(hpack_dynamic_table_t *dynamic_table, char *name,
+                            char *value)
+{
+    // Search first in static table
+    int index = hpack_tables_static_find_index(name, value);
+    if (index > 0) {
+        return index;
+    }
 
 #if HPACK_INCLUDE_DYNAMIC_TABLE
     // Then search in dynamic table with a linear search
@@ -673,14 +718,9 @@ int hpack_tables_find_index_name(hpack_dynamic_table_t *dynamic_table,
 {
 
     // Search first in static table
-    char *table_name = hpack_static_table.name_table;
-
-    for (uint8_t i = 0; i < HPACK_TABLES_FIRST_INDEX_DYNAMIC; i++) {
-        if (strlen(name) == strlen(table_name) &&
-            strncmp(table_name, name, strlen(name)) == 0) {
-            return i + 1;
-        }
-        table_name += strlen(table_name) + 1;
+    int index = hpack_tables_static_find_index_name(name);
+    if (index > 0) {
+        return index;
     }
 
 #if HPACK_INCLUDE_DYNAMIC_TABLE
@@ -4,6 +4,9 @@
 #include <stdint.h> /* for int8_t, uint32_t */
 
 #define STATIC_TABLE_SIZE (61)
+
+// Static table index of the content-length header name
+#define HPACK_TABLES_CONTENT_LENGTH_INDEX (28)
 #define SEPARATOR         "\0"
 
 #define CREATE_STATIC_TABLE(                                                   \
@@ -67,6 +70,8 @@ int8_t hpack_tables_find_entry_name_and_value(
   char *value);
 int8_t hpack_tables_find_entry_name(hpack_dynamic_table_t *dynamic_table,
                                     uint32_t index, char *name);
+int hpack_tables_static_find_index(char *name, char *value);
+int hpack_tables_static_find_index_name(char *name);
 int hpack_tables_find_index(hpack_dynamic_table_t *dynamic_table, char *name,
                             char *value);
 int hpack_tables_find_index_name(hpack_dynamic_table_t *dynamic_table,
@@ -1,6 +1,16 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+/**
+ * Maximum size of the ETag response header value, including the
+ * surrounding quotes and the string terminator
+ */
+#ifdef CONFIG_HTTP_MAX_ETAG_SIZE
+#define HTTP_MAX_ETAG_SIZE (CONFIG_HTTP_MAX_ETAG_SIZE)
+#else
+#define HTTP_MAX_ETAG_SIZE (24)
+#endif
+
 typedef struct http_header
 {
     char *name;
@@ -30,12 +40,31 @@ typedef struct http_response
     // value of the Content-Type header
     char *content_type;
 
+    // value of the Content-Encoding header, NULL for identity
+    char *content_encoding;
+
+    // value of the Vary header, NULL if the response
+    // does not depend on request headers
+    char *vary;
+
     // Length of HTTP response in bytes
     int content_length;
 
+    // value of the ETag header, empty if the
+    // response has no validator
+    char etag[HTTP_MAX_ETAG_SIZE];
+
     // response body, it must be allocated
     // by the caller
     char *content;
+
+    // file descriptor to read the response body from
+    // instead of content, or -1. It must be closed by the caller
+    int fd;
+
+    // index of the resource that handled the request,
+    // or -1 if no resource was found
+    int route;
 } http_response_t;
 
 /***********************************************
@@ -61,6 +90,29 @@ void http_handle_request(http_request_t *req, http_response_t *res,
  */
 int http_has_method_support(char *method);
 
+/**
+ * Check an If-None-Match header value against the given entity tag
+ * using weak comparison (see
+ * https://tools.ietf.org/html/rfc7232#section-3.2)
+ *
+ * @param if_none_match value of the If-None-Match header
+ * @param etag quoted entity tag of the selected representation
+ * @return 1 if any of the tags in the list matches (or the list is '*'), 0
+ * if not
+ */
+int http_etag_match(char *if_none_match, char *etag);
+
+/**
+ * Get the quality value assigned to a content coding by an Accept-Encoding
+ * header (see https://tools.ietf.org/html/rfc7231#section-5.3.4)
+ *
+ * @param accept_encoding value of the Accept-Encoding header
+ * @param content_encoding content coding to look for
+ * @return quality value in thousandths (0 means not acceptable) or -1 if the
+ * coding is not listed (nor matched by '*')
+ */
+int http_accept_encoding_q(char *accept_encoding, char *content_encoding);
+
 /**
  * Generate an HTTP error response from the server
  *
@@ -4,11 +4,17 @@
 #include <string.h>
 #include <strings.h>
 
+#ifndef CONTIKI
+#include <unistd.h>
+#endif
+
 #include "buffer.h"
 #include "frames.h"
 #include "http.h"
 #include "ll.h"
 #include "macros.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define LOG_MODULE LOG_MODULE_HTTP2
 #include "logging.h"
@@ -24,6 +30,15 @@
 #define HTTP2_FLAGS_GOAWAY_RECV          (0x8)
 #define HTTP2_FLAGS_GOAWAY_SENT          (0x10)
 #define HTTP2_FLAGS_WAITING_TRAILERS     (0x20)
+#define HTTP2_FLAGS_WAITING_PING_ACK     (0x40)
+#define HTTP2_FLAGS_SETTINGS_ACKED       (0x80)
+#define HTTP2_FLAGS_WAITING_WRITE        (0x100)
+
+// initial connection window size from the specification
+#define HTTP2_DEFAULT_WINDOW_SIZE (65535)
+
+// opaque data for server pings
+#define HTTP2_PING_DATA ("two-ping")
 
 // settings
 #define HTTP2_SETTINGS_HEADER_TABLE_SIZE      (0x1)
@@ -37,14 +52,101 @@
 #define HTTP2_MAX_CLIENTS (EVENT_MAX_SOCKETS - 1)
 #endif
 
+#ifndef HTTP2_REFUSE_SOCKETS
+#define HTTP2_REFUSE_SOCKETS (0)
+#endif
+
+#ifndef HTTP2_ACCEPT_RATE
+#define HTTP2_ACCEPT_RATE (0)
+#endif
+
+// room for SETTINGS and GOAWAY frames
+#define HTTP2_REFUSE_BUF_SIZE (64)
+
+// room kept in the write buffer for control frames (e.g. PING ACK
+// and WINDOW_UPDATE) while DATA is being sent
+#define HTTP2_CONTROL_HEADROOM (2 * (HTTP2_FRAME_HEADER_SIZE + 8))
+
+#if HTTP2_SOCK_WRITE_SIZE <= HTTP2_CONTROL_HEADROOM + HTTP2_FRAME_HEADER_SIZE
+#error "HTTP2_SOCK_WRITE_SIZE is too small to send DATA frames"
+#endif
+
+#if HTTP2_HEADER_CACHE_SIZE < 1
+#error "HTTP2_HEADER_CACHE_SIZE must be at least 1"
+#endif
+
+#if HTTP2_STREAM_BUF_POOL_SIZE < 1
+#error "HTTP2_STREAM_BUF_POOL_SIZE must be at least 1"
+#endif
+
+#if HTTP2_MAX_WINDOW_SIZE < HTTP2_INITIAL_WINDOW_SIZE ||                       \
+  HTTP2_MAX_WINDOW_SIZE > ((1u << 31) - 1)
+#error                                                                         \
+  "HTTP2_MAX_WINDOW_SIZE must be between HTTP2_INITIAL_WINDOW_SIZE and 2^31-1"
+#endif
+
+#if HTTP2_PING_INTERVAL > 0 && HTTP2_PING_TIMEOUT <= 0
+#error "HTTP2_PING_TIMEOUT must be larger than 0"
+#endif
+
+// maximum size of an encoded :status, content-type, content-encoding
+// and vary prefix
+#define HTTP2_HEADER_PREFIX_SIZE (64)
+
+// maximum size of an encoded content-length header
+#define HTTP2_CONTENT_LENGTH_SIZE (13)
+
+// maximum size of an encoded etag header
+#define HTTP2_ETAG_SIZE (HTTP_MAX_ETAG_SIZE + 3)
+
+// Pre-encoded response header block prefix (:status, content-type,
+// content-encoding and vary). Prefixes only use static table
+// representations, so they can be shared by all connections without
+// affecting the state of their dynamic tables
+typedef struct {
+    int status;
+    char *content_type;
+    char *content_encoding;
+    char *vary;
+    uint8_t size;
+    uint8_t block[HTTP2_HEADER_PREFIX_SIZE];
+} http2_header_prefix_t;
+
+static http2_header_prefix_t header_cache[HTTP2_HEADER_CACHE_SIZE];
+static unsigned int header_cache_next;
+
 // static variables for reserved http2 client memory
 // and free and connected clients lists
 LL_STATIC(http2_context_t, clients, HTTP2_MAX_CLIENTS);
 static http2_context_t *connected_clients;
 
+// stream buffers shared by all clients
+LL_STATIC(http2_stream_buf_t, stream_bufs, HTTP2_STREAM_BUF_POOL_SIZE);
+
 // Current client id
 static uint8_t client_id;
 
+// connections closed by deadline or refused
+static http2_reap_counts_t reap_counts;
+
+// buffers for connections refused while overloaded
+typedef struct
+{
+    event_sock_t *socket;
+    uint8_t read_buf[HTTP2_REFUSE_BUF_SIZE];
+    uint8_t write_buf[HTTP2_REFUSE_BUF_SIZE];
+} http2_refused_t;
+
+#if HTTP2_REFUSE_SOCKETS > 0
+static http2_refused_t refused[HTTP2_REFUSE_SOCKETS];
+#endif
+
+#if HTTP2_ACCEPT_RATE > 0
+// accept tokens in thousandths of a connection
+static uint32_t accept_tokens;
+static uint32_t accept_last;
+#endif
+
 // default settings from the protocol specification
 http2_settings_t default_settings = { .header_table_size      = 4096,
                                       .enable_push            = 1,
@@ -53,6 +155,13 @@ http2_settings_t default_settings = { .header_table_size      = 4096,
                                       .max_frame_size         = 16384,
                                       .max_header_list_size   = 0xFFFFFFFF };
 
+// local settings sent on the connection preface
+static uint32_t local_settings[] = {
+    HTTP2_HEADER_TABLE_SIZE,      HTTP2_ENABLE_PUSH,
+    HTTP2_MAX_CONCURRENT_STREAMS, HTTP2_INITIAL_WINDOW_SIZE,
+    HTTP2_MAX_FRAME_SIZE,         HTTP2_MAX_HEADER_LIST_SIZE
+};
+
 // used as generic callback for event_write methods. It checks
 // the status of the socket and closes the connection if an
 // error ocurred
@@ -67,8 +176,160 @@ int receiving(event_sock_t *client, int size, uint8_t *buf);
 
 // send as much data as flow control allows from the stream buffer
 void http2_continue_send(http2_context_t *ctx, http2_stream_t *stream);
+void http2_on_writable(event_sock_t *sock);
+int http2_wait_write(http2_context_t *ctx);
 void http2_on_client_close(event_sock_t *sock);
 
+// timer callbacks for connection deadlines
+int on_preface_timeout(event_sock_t *sock);
+int on_connection_timer(event_sock_t *sock);
+
+// pending response data for the stream
+int http2_stream_remaining(http2_stream_t *stream)
+{
+#ifndef CONTIKI
+    if (stream->fd >= 0) {
+        return stream->filelen;
+    }
+#endif
+    return stream->buflen;
+}
+
+// attach a buffer from the pool to the stream
+int http2_stream_buf_get(http2_stream_t *stream)
+{
+    if (stream->buf == NULL) {
+        stream->buf = LL_POP(stream_bufs);
+    }
+    stream->buflen = 0;
+    stream->bufptr = (stream->buf != NULL) ? stream->buf->data : NULL;
+    return (stream->buf != NULL) ? 0 : -1;
+}
+
+// return the stream buffer to the pool, pending data is discarded
+void http2_stream_buf_release(http2_stream_t *stream)
+{
+    if (stream->buf != NULL) {
+        LL_PUSH(stream->buf, stream_bufs);
+    }
+    stream->buf    = NULL;
+    stream->buflen = 0;
+    stream->bufptr = NULL;
+}
+
+#ifndef CONTIKI
+// release the stream response file if it is not being sent
+void http2_stream_close_file(http2_stream_t *stream)
+{
+    if (stream->fd >= 0 && stream->fd != stream->sendfd) {
+        close(stream->fd);
+    }
+    stream->fd      = -1;
+    stream->filelen = 0;
+}
+#endif
+
+// Take a token from the accept rate bucket. Return -1 if the
+// connection rate is over HTTP2_ACCEPT_RATE
+int http2_accept_token(void)
+{
+#if HTTP2_ACCEPT_RATE > 0
+    // refill the bucket for the elapsed time
+    uint32_t now     = event_time_ms();
+    uint32_t elapsed = now - accept_last;
+    if (elapsed > 1000U * HTTP2_ACCEPT_BURST) {
+        elapsed = 1000U * HTTP2_ACCEPT_BURST;
+    }
+    accept_last = now;
+    accept_tokens += elapsed * HTTP2_ACCEPT_RATE;
+    if (accept_tokens > 1000U * HTTP2_ACCEPT_BURST) {
+        accept_tokens = 1000U * HTTP2_ACCEPT_BURST;
+    }
+
+    if (accept_tokens < 1000) {
+        return -1;
+    }
+    accept_tokens -= 1000;
+#endif
+    return 0;
+}
+
+#if HTTP2_REFUSE_SOCKETS > 0
+void http2_on_refused_close(event_sock_t *sock)
+{
+    for (int i = 0; i < HTTP2_REFUSE_SOCKETS; i++) {
+        if (refused[i].socket == sock) {
+            refused[i].socket = NULL;
+        }
+    }
+    INFO("http/2 refused client disconnected");
+}
+
+void close_refused_on_write_error(event_sock_t *sock, int status)
+{
+    if (status < 0) {
+        event_close(sock, http2_on_refused_close);
+    }
+}
+
+void close_refused_on_goaway_sent(event_sock_t *sock, int status)
+{
+    (void)status;
+    event_close(sock, http2_on_refused_close);
+}
+
+// discard everything sent by a refused client, so closing
+// does not reset the connection before the GOAWAY is read
+int refused_receiving(event_sock_t *sock, int size, uint8_t *buf)
+{
+    (void)buf;
+    if (size <= 0) {
+        event_close(sock, http2_on_refused_close);
+        return 0;
+    }
+    return size;
+}
+#endif
+
+// Tell the client to retry later with a GOAWAY that has no processed
+// streams. The connection is just closed if no refusal buffer is free
+void http2_refuse_client(event_sock_t *client)
+{
+    reap_counts.refused++;
+    METRICS_INC(REJECTS);
+
+#if HTTP2_REFUSE_SOCKETS > 0
+    http2_refused_t *r = NULL;
+    for (int i = 0; i < HTTP2_REFUSE_SOCKETS; i++) {
+        if (refused[i].socket == NULL) {
+            r = &refused[i];
+            break;
+        }
+    }
+
+    if (r != NULL) {
+        INFO("http/2 server overloaded, refusing client");
+        r->socket    = client;
+        client->data = NULL;
+        event_read_start(
+          client, r->read_buf, HTTP2_REFUSE_BUF_SIZE, refused_receiving);
+        event_write_enable(client, r->write_buf, HTTP2_REFUSE_BUF_SIZE);
+
+        // the server preface must be sent before GOAWAY
+        send_settings_frame(
+          client, 0, local_settings, close_refused_on_write_error);
+        send_goaway_frame(
+          client, HTTP2_REFUSED_STREAM, 0, close_refused_on_goaway_sent);
+        return;
+    }
+#endif
+
+    // increase CONFIG_HTTP2_MAX_CLIENTS to avoid this error
+    ERROR("Maximum number of clients (%d) reached.", HTTP2_MAX_CLIENTS);
+    client->data = NULL;
+    event_close(client, http2_on_client_close);
+}
+
 http2_context_t *http2_new_client(event_sock_t *client)
 {
     assert(client != NULL);
@@ -78,19 +339,24 @@ http2_context_t *http2_new_client(event_sock_t *client)
     if (!inited) {
         // Initialize client memory
         LL_INIT(clients, HTTP2_MAX_CLIENTS);
+        LL_INIT(stream_bufs, HTTP2_STREAM_BUF_POOL_SIZE);
         connected_clients = NULL;
         inited            = 1;
     }
 
-    // get first element from the client list into the connected clients list
-    http2_context_t *ctx = LL_MOVE(clients, connected_clients);
+    // get first element from the client list into the connected clients
+    // list, unless the server is full or the accept rate is exceeded
+    http2_context_t *ctx = NULL;
+    if (clients != NULL && http2_accept_token() == 0) {
+        ctx = LL_MOVE(clients, connected_clients);
+    }
     if (ctx == NULL) {
-        // increase CONFIG_HTTP2_MAX_CLIENTS to avoid this error
-        ERROR("Maximum number of clients (%d) reached.", HTTP2_MAX_CLIENTS);
-        event_close(client, http2_on_client_close);
+        http2_refuse_client(client);
         return NULL;
     }
     INFO("http/2 client %d connected", client_id);
+    METRICS_INC(ACCEPTS);
+    METRICS_INC(CONNECTIONS);
 
     client->data               = ctx;
     ctx->id                    = client_id++;
@@ -98,6 +364,10 @@ http2_context_t *http2_new_client(event_sock_t *client)
     ctx->settings              = default_settings;
     ctx->stream.id             = 0;
     ctx->stream.state          = HTTP2_STREAM_IDLE;
+#ifndef CONTIKI
+    ctx->stream.fd     = -1;
+    ctx->stream.sendfd = -1;
+#endif
     ctx->state                 = HTTP2_WAITING_PREFACE;
     ctx->flags                 = HTTP2_FLAGS_NONE;
     ctx->last_opened_stream_id = 0;
@@ -105,6 +375,20 @@ http2_context_t *http2_new_client(event_sock_t *client)
     // this value can only be updated by a WINDOW_UPDATE frame
     ctx->window_size = default_settings.initial_window_size;
 
+    // the receive window grows with the measured bandwidth-delay product
+    ctx->recv_window      = HTTP2_DEFAULT_WINDOW_SIZE;
+    ctx->recv_window_size = HTTP2_INITIAL_WINDOW_SIZE;
+    ctx->bdp_bytes        = 0;
+    ctx->data_skip        = 0;
+    ctx->rtt              = 0;
+
+    // reset deadlines
+    ctx->idle_ticks    = 0;
+    ctx->frame_ticks   = 0;
+    ctx->stream_ticks  = 0;
+    ctx->closing_ticks = 0;
+    ctx->rx_partial    = 0;
+
     // initialize hpack
     hpack_init(&ctx->hpack_dynamic_table, HTTP2_HEADER_TABLE_SIZE);
 
@@ -112,14 +396,33 @@ http2_context_t *http2_new_client(event_sock_t *client)
       client, ctx->read_buf, HTTP2_SOCK_READ_SIZE, waiting_for_preface);
     event_write_enable(client, ctx->write_buf, HTTP2_SOCK_WRITE_SIZE);
 
+    // the client must send the preface before the deadline
+    ctx->timer =
+      event_timer_set(client, HTTP2_PREFACE_TIMEOUT, on_preface_timeout);
+
     return ctx;
 }
 
+const http2_reap_counts_t *http2_get_reap_counts(void)
+{
+    return &reap_counts;
+}
+
 void http2_on_client_close(event_sock_t *sock)
 {
     if (sock->data != NULL) {
         http2_context_t *ctx = (http2_context_t *)sock->data;
         INFO("http/2 client %u disconnected", ctx->id);
+        METRICS_DEC(CONNECTIONS);
+        http2_stream_buf_release(&ctx->stream);
+
+#ifndef CONTIKI
+        http2_stream_close_file(&ctx->stream);
+        if (ctx->stream.sendfd >= 0) {
+            close(ctx->stream.sendfd);
+            ctx->stream.sendfd = -1;
+        }
+#endif
 
         // free the client
         LL_DELETE(ctx, connected_clients);
@@ -136,6 +439,8 @@ void http2_close_immediate(http2_context_t *ctx)
     // stop receiving data and close connection
     ctx->state        = HTTP2_CLOSED;
     ctx->stream.state = HTTP2_STREAM_CLOSED;
+    ctx->flags &= ~HTTP2_FLAGS_WAITING_WRITE;
+    http2_stream_buf_release(&ctx->stream);
     event_read_stop(ctx->socket);
     event_close(ctx->socket, http2_on_client_close);
 }
@@ -148,19 +453,17 @@ int http2_close_gracefully(http2_context_t *ctx)
 
     // update state
     ctx->state = HTTP2_CLOSING;
-    ctx->flags &= HTTP2_FLAGS_GOAWAY_SENT;
 
-    // send go away with HTTP2_NO_ERROR
-    INFO("->|%u| GOAWAY (last_stream_id: %u, error_code: 0x%x)",
-         ctx->id,
-         (unsigned int)ctx->last_opened_stream_id,
-         HTTP2_NO_ERROR);
-    send_goaway_frame(ctx->socket,
-                      HTTP2_NO_ERROR,
-                      ctx->last_opened_stream_id,
-                      close_on_write_error);
-
-    // TODO: set a timer for goaway (?)
+    // send go away with HTTP2_NO_ERROR, or close if it does not fit
+    TRACE_FRAME(SEND, ctx->id, FRAME_GOAWAY_TYPE, 0, 8, 0);
+    if (send_goaway_frame(ctx->socket,
+                          HTTP2_NO_ERROR,
+                          ctx->last_opened_stream_id,
+                          close_on_write_error) < 0) {
+        http2_close_immediate(ctx);
+        return 0;
+    }
+    ctx->flags |= HTTP2_FLAGS_GOAWAY_SENT;
 
     return 0;
 }
@@ -169,32 +472,41 @@ void http2_error(http2_context_t *ctx, http2_error_t error)
 {
     // update state
     ctx->state = HTTP2_CLOSING;
-    ctx->flags &= HTTP2_FLAGS_GOAWAY_SENT;
 
     // stop accepting data
     event_read_stop(ctx->socket);
-
-    // send goaway and close the connection
-    INFO("->|%u| GOAWAY (last_stream_id: %u, error_code: 0x%x)",
-         ctx->id,
-         (unsigned int)ctx->last_opened_stream_id,
-         error);
-    send_goaway_frame(
-      ctx->socket, error, ctx->last_opened_stream_id, close_on_goaway_sent);
+    ctx->flags &= ~HTTP2_FLAGS_WAITING_WRITE;
+
+    // send goaway and close the connection, right away if
+    // the frame does not fit in the write buffer
+    TRACE_FRAME(SEND, ctx->id, FRAME_GOAWAY_TYPE, 0, 8, 0);
+    DEBUG("     - error_code: 0x%x", error);
+    if (send_goaway_frame(ctx->socket,
+                          error,
+                          ctx->last_opened_stream_id,
+                          close_on_goaway_sent) < 0) {
+        http2_close_immediate(ctx);
+        return;
+    }
+    ctx->flags |= HTTP2_FLAGS_GOAWAY_SENT;
 }
 
 void http2_stream_error(http2_context_t *ctx,
                         uint32_t stream_id,
                         http2_error_t error)
 {
-    // Send reset stream and close frame
-    INFO("->|%u| RST_STREAM (stream_id: %u, error_code: 0x%x)",
-         ctx->id,
-         (unsigned int)stream_id,
-         error);
-    send_rst_stream_frame(ctx->socket, error, stream_id, close_on_write_error);
+    // Send reset stream and close frame. If it does not fit, the
+    // stream cannot be reset and the connection is closed instead
+    TRACE_FRAME(SEND, ctx->id, FRAME_RST_STREAM_TYPE, 0, 4, stream_id);
+    DEBUG("     - error_code: 0x%x", error);
+    if (send_rst_stream_frame(
+          ctx->socket, error, stream_id, close_on_write_error) < 0) {
+        http2_error(ctx, error);
+        return;
+    }
     if (stream_id == ctx->stream.id) {
         ctx->stream.state = HTTP2_STREAM_CLOSED;
+        http2_stream_buf_release(&ctx->stream);
     }
 }
 
@@ -218,10 +530,25 @@ int on_settings_timeout(event_sock_t *sock)
 {
     http2_context_t *ctx = (http2_context_t *)sock->data;
 
+    reap_counts.settings++;
+    ctx->timer = NULL;
     http2_error(ctx, HTTP2_SETTINGS_TIMEOUT);
     return 1;
 }
 
+int on_preface_timeout(event_sock_t *sock)
+{
+    http2_context_t *ctx = (http2_context_t *)sock->data;
+
+    // no SETTINGS have been sent yet, so the connection
+    // is closed without GOAWAY
+    INFO("http/2 client %u did not send preface", ctx->id);
+    reap_counts.preface++;
+    ctx->timer = NULL;
+    http2_close_immediate(ctx);
+    return 1;
+}
+
 void on_settings_sent(event_sock_t *sock, int status)
 {
     http2_context_t *ctx = (http2_context_t *)sock->data;
@@ -341,11 +668,7 @@ int handle_settings_frame(http2_context_t *ctx,
                           uint8_t *payload)
 {
     // check stream id
-    INFO("<-|%u| SETTINGS (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
     if (header.stream_id != 0x0) {
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
         return -1;
@@ -359,10 +682,15 @@ int handle_settings_frame(http2_context_t *ctx,
             return -1;
         }
 
-        // process settings
+        // process settings, the frame is processed again once the
+        // ACK fits in the write buffer
         if (update_settings(ctx, payload, header.length) > 0) {
-            INFO("->|%u| SETTINGS (ack)", ctx->id);
-            send_settings_frame(ctx->socket, 1, NULL, close_on_write_error);
+            if (send_settings_frame(
+                  ctx->socket, 1, NULL, close_on_write_error) < 0) {
+                return http2_wait_write(ctx);
+            }
+            TRACE_FRAME(
+              SEND, ctx->id, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK, 0, 0);
         }
 
     } else {
@@ -379,9 +707,21 @@ int handle_settings_frame(http2_context_t *ctx,
         // disable flag
         ctx->flags &= ~HTTP2_FLAGS_WAITING_SETTINGS_ACK;
 
+        // the local initial window size applies from now on
+        if (!(ctx->flags & HTTP2_FLAGS_SETTINGS_ACKED) &&
+            ctx->stream.state == HTTP2_STREAM_OPEN) {
+            ctx->stream.recv_window +=
+              HTTP2_INITIAL_WINDOW_SIZE - HTTP2_DEFAULT_WINDOW_SIZE;
+        }
+        ctx->flags |= HTTP2_FLAGS_SETTINGS_ACKED;
+
         // disable settings ack timer
         event_timer_stop(ctx->timer);
         ctx->timer = NULL;
+
+        // enforce deadlines for the rest of the connection
+        ctx->timer =
+          event_timer_set(ctx->socket, HTTP2_TIMER_TICK, on_connection_timer);
     }
 
     return 0;
@@ -394,11 +734,7 @@ int handle_goaway_frame(http2_context_t *ctx,
                         uint8_t *payload)
 {
     // check stream id
-    INFO("<-|%u| GOAWAY (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
     if (header.stream_id != 0x0) {
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
         return -1;
@@ -429,36 +765,240 @@ int handle_goaway_frame(http2_context_t *ctx,
         if (ctx->stream.id > last_stream_id) {
             // close current stream
             ctx->stream.state = HTTP2_STREAM_CLOSED;
+            http2_stream_buf_release(&ctx->stream);
         }
         // update connection state
         ctx->state = HTTP2_CLOSING;
         event_read(ctx->socket, receiving);
 
         // send goaway and and close connection
-        INFO("->|%u| GOAWAY (last_stream_id: %u, error_code: 0x%x)",
-             ctx->id,
-             (unsigned int)ctx->last_opened_stream_id,
-             HTTP2_NO_ERROR);
-        send_goaway_frame(ctx->socket,
-                          HTTP2_NO_ERROR,
-                          ctx->last_opened_stream_id,
-                          close_on_goaway_sent);
+        TRACE_FRAME(SEND, ctx->id, FRAME_GOAWAY_TYPE, 0, 8, 0);
+        if (send_goaway_frame(ctx->socket,
+                              HTTP2_NO_ERROR,
+                              ctx->last_opened_stream_id,
+                              close_on_goaway_sent) < 0) {
+            http2_close_immediate(ctx);
+            return 0;
+        }
+        ctx->flags |= HTTP2_FLAGS_GOAWAY_SENT;
     }
 
     return 0;
 }
 
+// Send a WINDOW_UPDATE frame to return the connection receive window
+// consumed by the remote endpoint. Unless flush is set, updates are
+// coalesced until at least half of the window has been used. If the
+// frame does not fit, it is sent again once the write buffer drains
+void http2_conn_window_update(http2_context_t *ctx, int flush)
+{
+    // the connection window is never smaller than the protocol default
+    int32_t size = ctx->recv_window_size;
+    if (size < HTTP2_DEFAULT_WINDOW_SIZE) {
+        size = HTTP2_DEFAULT_WINDOW_SIZE;
+    }
+
+    int32_t increment = size - ctx->recv_window;
+    if (increment > 0 && (flush || increment >= size / 2)) {
+        if (send_window_update_frame(
+              ctx->socket, increment, 0, close_on_write_error) < 0) {
+            event_write_wait(ctx->socket, http2_on_writable);
+            return;
+        }
+        TRACE_FRAME(SEND, ctx->id, FRAME_WINDOW_UPDATE_TYPE, 0, 4, 0);
+        DEBUG("     - window_size_increment: %u", (unsigned int)increment);
+        ctx->recv_window += increment;
+    }
+}
+
+// Same as http2_conn_window_update() for the stream receive window
+void http2_stream_window_update(http2_context_t *ctx, int flush)
+{
+    // the stream window is only updated while the remote
+    // endpoint can send data
+    http2_stream_t *stream = &ctx->stream;
+    if (stream->state != HTTP2_STREAM_OPEN) {
+        return;
+    }
+
+    int32_t size      = ctx->recv_window_size;
+    int32_t increment = size - stream->recv_window;
+    if (increment > 0 && (flush || increment >= size / 2)) {
+        if (send_window_update_frame(
+              ctx->socket, increment, stream->id, close_on_write_error) < 0) {
+            event_write_wait(ctx->socket, http2_on_writable);
+            return;
+        }
+        TRACE_FRAME(
+          SEND, ctx->id, FRAME_WINDOW_UPDATE_TYPE, 0, 4, stream->id);
+        DEBUG("     - window_size_increment: %u", (unsigned int)increment);
+        stream->recv_window += increment;
+    }
+}
+
+// Return the consumed connection and stream receive windows
+void http2_recv_window_update(http2_context_t *ctx, int flush)
+{
+    http2_conn_window_update(ctx, flush);
+    http2_stream_window_update(ctx, flush);
+}
+
+// Send a PING to measure the round trip time. Only one
+// PING can be waiting for ACK at a time. If it does not fit in
+// the write buffer, it is sent on the next timer tick or DATA frame
+void http2_send_ping(http2_context_t *ctx)
+{
+    if (ctx->flags & HTTP2_FLAGS_WAITING_PING_ACK) {
+        return;
+    }
+
+    if (send_ping_frame(ctx->socket,
+                        (uint8_t *)HTTP2_PING_DATA,
+                        0,
+                        close_on_write_error) < 0) {
+        return;
+    }
+    TRACE_FRAME(SEND, ctx->id, FRAME_PING_TYPE, 0, 8, 0);
+    ctx->flags |= HTTP2_FLAGS_WAITING_PING_ACK;
+    ctx->ping_sent = event_time_ms();
+    ctx->bdp_bytes = 0;
+}
+
+// Count received data for the bandwidth-delay product estimation.
+// A PING is sent with the first data received, all data received
+// until its ACK is the amount in flight for a round trip
+void http2_bdp_sample(http2_context_t *ctx, uint32_t len)
+{
+    if (ctx->recv_window_size < HTTP2_MAX_WINDOW_SIZE) {
+        http2_send_ping(ctx);
+    }
+    ctx->bdp_bytes += len;
+}
+
+// Grow the receive window to twice the bandwidth-delay product if
+// the last round trip used most of it
+void http2_bdp_update(http2_context_t *ctx)
+{
+    DEBUG("     - bdp: %u", (unsigned int)ctx->bdp_bytes);
+
+    if (ctx->bdp_bytes < (uint32_t)ctx->recv_window_size / 3 * 2) {
+        return;
+    }
+
+    int32_t size = HTTP2_MAX_WINDOW_SIZE;
+    if (ctx->bdp_bytes < HTTP2_MAX_WINDOW_SIZE / 2) {
+        size = 2 * ctx->bdp_bytes;
+    }
+
+    if (size > ctx->recv_window_size) {
+        DEBUG("     - recv_window_size: %u", (unsigned int)size);
+        ctx->recv_window_size = size;
+
+        // let the remote endpoint use the new window right away
+        http2_recv_window_update(ctx, 1);
+    }
+}
+
+// Update the round trip time estimate on PING ack
+void http2_rtt_update(http2_context_t *ctx)
+{
+    uint32_t sample = event_time_ms() - ctx->ping_sent;
+
+    // smooth as TCP does (RFC 6298)
+    if (ctx->rtt == 0) {
+        ctx->rtt = sample;
+    } else {
+        ctx->rtt = (7 * ctx->rtt + sample) / 8;
+    }
+    DEBUG("     - rtt: %u ms", (unsigned int)ctx->rtt);
+}
+
+// Count a timer tick and return the elapsed time in milliseconds
+uint32_t http2_tick(uint16_t *ticks)
+{
+    if (*ticks < UINT16_MAX) {
+        (*ticks)++;
+    }
+    return (uint32_t)*ticks * HTTP2_TIMER_TICK;
+}
+
+// Enforce the connection deadlines once the SETTINGS have been
+// acknowledged. Send a PING if the connection has been quiet for
+// HTTP2_PING_INTERVAL and close it if nothing arrives after that,
+// if a frame or header block takes too long, if there are no streams
+// or if it is still closing a tick after the GOAWAY
+int on_connection_timer(event_sock_t *sock)
+{
+    http2_context_t *ctx = (http2_context_t *)sock->data;
+
+    // the GOAWAY could not be sent or the client did not reply
+    if (ctx->state == HTTP2_CLOSING) {
+        if (http2_tick(&ctx->closing_ticks) > HTTP2_TIMER_TICK) {
+            INFO("http/2 client %u did not close", ctx->id);
+            reap_counts.closing++;
+            ctx->timer = NULL;
+            http2_close_immediate(ctx);
+            return 1;
+        }
+        return 0;
+    }
+    if (ctx->state != HTTP2_READY) {
+        return 0;
+    }
+
+    // idle_ticks is reset on every read
+    uint32_t quiet = http2_tick(&ctx->idle_ticks);
+    if ((ctx->flags & HTTP2_FLAGS_WAITING_PING_ACK) &&
+        quiet >= HTTP2_PING_INTERVAL + HTTP2_PING_TIMEOUT) {
+        INFO("http/2 client %u did not reply to PING", ctx->id);
+        reap_counts.ping++;
+        ctx->timer = NULL;
+        http2_close_immediate(ctx);
+        return 1;
+    }
+
+    // frame_ticks is reset on every complete frame
+    if (ctx->rx_partial || (ctx->flags & HTTP2_FLAGS_WAITING_END_HEADERS)) {
+        if (http2_tick(&ctx->frame_ticks) >= HTTP2_HEADERS_TIMEOUT) {
+            INFO("http/2 client %u is too slow", ctx->id);
+            reap_counts.headers++;
+            ctx->timer = NULL;
+            http2_error(ctx, HTTP2_ENHANCE_YOUR_CALM);
+            return 1;
+        }
+        ctx->stream_ticks = 0;
+    }
+#if HTTP2_IDLE_TIMEOUT > 0
+    else if (ctx->stream.state == HTTP2_STREAM_IDLE ||
+             ctx->stream.state == HTTP2_STREAM_CLOSED) {
+        if (http2_tick(&ctx->stream_ticks) >= HTTP2_IDLE_TIMEOUT) {
+            INFO("http/2 client %u is idle", ctx->id);
+            reap_counts.idle++;
+            ctx->timer = NULL;
+            http2_error(ctx, HTTP2_NO_ERROR);
+            return 1;
+        }
+    }
+#endif
+    else {
+        ctx->stream_ticks = 0;
+    }
+
+#if HTTP2_PING_INTERVAL > 0
+    if (quiet >= HTTP2_PING_INTERVAL) {
+        http2_send_ping(ctx);
+    }
+#endif
+    return 0;
+}
+
 // Handle a ping frame reception. Reply with same payload and an ack if the
 // frame is well formed
 int handle_ping_frame(http2_context_t *ctx,
                       frame_header_t header,
                       uint8_t *payload)
 {
-    INFO("<-|%u| PING (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
     // check stream id
     if (header.stream_id != 0x0) {
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
@@ -472,13 +1012,22 @@ int handle_ping_frame(http2_context_t *ctx,
     }
 
     if (header.flags & FRAME_FLAGS_ACK) {
-        // ignore ping with ack (we never send pings)
+        // ignore ACKs for pings we did not send
+        if ((ctx->flags & HTTP2_FLAGS_WAITING_PING_ACK) &&
+            memcmp(payload, HTTP2_PING_DATA, 8) == 0) {
+            ctx->flags &= ~HTTP2_FLAGS_WAITING_PING_ACK;
+            http2_rtt_update(ctx);
+            http2_bdp_update(ctx);
+        }
         return 0;
     }
 
-    // send ack with same payload
-    INFO("->|%u| PING (ack)", ctx->id);
-    send_ping_frame(ctx->socket, payload, 1, close_on_write_error);
+    // send ack with same payload, the PING is processed again
+    // once the ACK fits in the write buffer
+    if (send_ping_frame(ctx->socket, payload, 1, close_on_write_error) < 0) {
+        return http2_wait_write(ctx);
+    }
+    TRACE_FRAME(SEND, ctx->id, FRAME_PING_TYPE, FRAME_FLAGS_ACK, 8, 0);
 
     return 0;
 }
@@ -540,41 +1089,157 @@ void on_stream_send_complete(event_sock_t *sock, int status)
         return;
     }
 
-    if (ctx->stream.buflen <= 0) {
+    if (http2_stream_remaining(&ctx->stream) <= 0) {
+#if METRICS_ROUTES > 0
+        // the last byte of the response has been flushed
+        if (ctx->stream.state != HTTP2_STREAM_CLOSED) {
+            METRICS_PHASES_END(ctx->stream.route, ctx->stream.stamps);
+        }
+#endif
         // close the stream if we send all available data
         ctx->stream.state = HTTP2_STREAM_CLOSED;
+        http2_stream_buf_release(&ctx->stream);
     } else {
         // else send remaining data
         http2_continue_send(ctx, &ctx->stream);
     }
 }
 
+#ifndef CONTIKI
+void on_stream_file_sent(event_sock_t *sock, int status)
+{
+    http2_context_t *ctx   = (http2_context_t *)sock->data;
+    http2_stream_t *stream = &ctx->stream;
+
+    // the file is no longer needed after the last chunk, if the
+    // stream was reset or if it belongs to a previous stream
+    int sendfd     = stream->sendfd;
+    stream->sendfd = -1;
+    if (sendfd != stream->fd) {
+        close(sendfd);
+    } else if (stream->filelen == 0 ||
+               stream->state == HTTP2_STREAM_CLOSED) {
+        http2_stream_close_file(stream);
+    }
+    on_stream_send_complete(sock, status);
+}
+
+// send the next chunk of the response file. Only one chunk is
+// queued at a time, so the file can be released on completion
+void http2_continue_sendfile(http2_context_t *ctx, http2_stream_t *stream)
+{
+    if (stream->sendfd >= 0 || stream->state == HTTP2_STREAM_CLOSED) {
+        return;
+    }
+
+    int window_size = MIN(ctx->window_size, stream->window_size);
+    uint32_t len    = MIN(stream->filelen, ctx->settings.max_frame_size);
+
+    // do nothing if window size is lower than 0
+    if (window_size <= 0) {
+        METRICS_INC(FLOW_STALLS);
+        return;
+    }
+    len = MIN(len, (uint32_t)window_size);
+
+    // wait for room for the frame header, which is encoded in place
+    if (event_write_space(ctx->socket) <
+          HTTP2_FRAME_HEADER_SIZE + HTTP2_CONTROL_HEADROOM ||
+        event_write_contiguous(ctx->socket) < HTTP2_FRAME_HEADER_SIZE) {
+        METRICS_INC(WRITE_STALLS);
+        event_write_wait(ctx->socket, http2_on_writable);
+        return;
+    }
+
+    TRACE_FRAME(SEND,
+                ctx->id,
+                FRAME_DATA_TYPE,
+                stream->filelen == len ? FRAME_FLAGS_END_STREAM : 0,
+                len,
+                stream->id);
+    if (send_data_frame_file(ctx->socket,
+                             stream->fd,
+                             stream->fileoff,
+                             len,
+                             stream->id,
+                             stream->filelen == len,
+                             on_stream_file_sent) < 0) {
+        http2_error(ctx, HTTP2_INTERNAL_ERROR);
+        return;
+    }
+#if METRICS_ROUTES > 0
+    if (stream->fileoff == 0) {
+        METRICS_STAMP(stream->stamps, SEND);
+    }
+#endif
+
+    stream->sendfd = stream->fd;
+    stream->fileoff += len;
+    stream->filelen -= len;
+    stream->window_size -= len;
+    ctx->window_size -= len;
+}
+#endif
+
 void http2_continue_send(http2_context_t *ctx, http2_stream_t *stream)
 {
+#ifndef CONTIKI
+    if (stream->fd >= 0) {
+        http2_continue_sendfile(ctx, stream);
+        return;
+    }
+#endif
+
     // send at most window_size
     int window_size = MIN(ctx->window_size, stream->window_size);
     int len         = MIN(stream->buflen, window_size);
 
     // do nothing if window size is lower than 0
     if (len <= 0) {
+        if (stream->buflen > 0) {
+            METRICS_INC(FLOW_STALLS);
+        }
         return;
     }
 
-    // limit size to write buffer
-    len = MIN(len, HTTP2_SOCK_WRITE_SIZE);
+    // pace the frame to the space left in the write buffer, and to
+    // the contiguous space since it is encoded in place. A frame
+    // reaching the end of the buffer leaves the headroom after the wrap
+    int space      = event_write_space(ctx->socket) - HTTP2_CONTROL_HEADROOM;
+    int contiguous = event_write_contiguous(ctx->socket);
+    if (contiguous < space) {
+        space = contiguous;
+    }
+    space -= HTTP2_FRAME_HEADER_SIZE;
+    if (space <= 0) {
+        METRICS_INC(WRITE_STALLS);
+        event_write_wait(ctx->socket, http2_on_writable);
+        return;
+    }
+    len = MIN(len, space);
+    len = MIN((uint32_t)len, ctx->settings.max_frame_size);
 
     // send data frame
-    INFO("->|%u| DATA (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         len,
-         (unsigned int)stream->id,
-         (stream->buflen - len <= 0));
-    send_data_frame(ctx->socket,
-                    stream->bufptr,
-                    len,
-                    stream->id,
-                    (stream->buflen - len <= 0),
-                    on_stream_send_complete);
+    TRACE_FRAME(SEND,
+                ctx->id,
+                FRAME_DATA_TYPE,
+                stream->buflen - len <= 0 ? FRAME_FLAGS_END_STREAM : 0,
+                len,
+                stream->id);
+    if (send_data_frame(ctx->socket,
+                        stream->bufptr,
+                        len,
+                        stream->id,
+                        (stream->buflen - len <= 0),
+                        on_stream_send_complete) < 0) {
+        event_write_wait(ctx->socket, http2_on_writable);
+        return;
+    }
+#if METRICS_ROUTES > 0
+    if (stream->bufptr == stream->buf->data) {
+        METRICS_STAMP(stream->stamps, SEND);
+    }
+#endif
 
     // use actual size sent here
     stream->bufptr += len;
@@ -583,15 +1248,46 @@ void http2_continue_send(http2_context_t *ctx, http2_stream_t *stream)
     ctx->window_size -= len;
 }
 
+// Stop processing received frames until the reply to the current
+// one fits in the write buffer. The frame is not consumed, so it is
+// processed again by http2_on_writable()
+int http2_wait_write(http2_context_t *ctx)
+{
+    METRICS_INC(WRITE_STALLS);
+    ctx->flags |= HTTP2_FLAGS_WAITING_WRITE;
+    event_write_wait(ctx->socket, http2_on_writable);
+    return 1;
+}
+
+// resume the control frames and the response once the write
+// buffer drains
+void http2_on_writable(event_sock_t *sock)
+{
+    http2_context_t *ctx = (http2_context_t *)sock->data;
+
+    // process again the frames waiting to reply
+    if (ctx->flags & HTTP2_FLAGS_WAITING_WRITE) {
+        ctx->flags &= ~HTTP2_FLAGS_WAITING_WRITE;
+        event_read(sock,
+                   ctx->state == HTTP2_WAITING_SETTINGS ? waiting_for_settings
+                                                        : receiving);
+    }
+
+    // return the receive windows that could not be updated
+    if (ctx->state == HTTP2_READY) {
+        http2_recv_window_update(ctx, 0);
+    }
+
+    if (ctx->stream.state != HTTP2_STREAM_CLOSED) {
+        http2_continue_send(ctx, &ctx->stream);
+    }
+}
+
 int handle_window_update_frame(http2_context_t *ctx,
                                frame_header_t header,
                                uint8_t *payload)
 {
-    INFO("<-|%u| WINDOW_UPDATE (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
 
     // check header length
     if (header.length != 4) {
@@ -627,6 +1323,11 @@ int handle_window_update_frame(http2_context_t *ctx,
             return -1;
         }
         ctx->window_size += window_size_increment;
+
+        // send data blocked by the connection window
+        if (ctx->stream.state != HTTP2_STREAM_CLOSED) {
+            http2_continue_send(ctx, &ctx->stream);
+        }
     } else { // update stream window size
         if (ctx->stream.window_size + window_size_increment >
             ((uint32_t)(1 << 31) - 1)) {
@@ -642,15 +1343,81 @@ int handle_window_update_frame(http2_context_t *ctx,
     return 0;
 }
 
+// Encode an optional header into the prefix
+int http2_header_prefix_add(http2_header_prefix_t *prefix, int size,
+                            char *name, char *value)
+{
+    if (size < 0 || value == NULL) {
+        return size;
+    }
+
+    int rc = hpack_encode_static(
+      name, value, prefix->block + size, HTTP2_HEADER_PREFIX_SIZE - size);
+    if (rc < 0) {
+        return rc;
+    }
+    return size + rc;
+}
+
+// Get the encoded header block prefix for the response status and
+// headers, encoding it on a cache miss. Header values are
+// compared by pointer since they are obtained from allowed lists
+http2_header_prefix_t *http2_header_prefix_get(http_response_t *res)
+{
+    for (int i = 0; i < HTTP2_HEADER_CACHE_SIZE; i++) {
+        if (header_cache[i].size > 0 && header_cache[i].status == res->status &&
+            header_cache[i].content_type == res->content_type &&
+            header_cache[i].content_encoding == res->content_encoding &&
+            header_cache[i].vary == res->vary) {
+            return &header_cache[i];
+        }
+    }
+
+    // replace the oldest entry
+    http2_header_prefix_t *prefix = &header_cache[header_cache_next];
+    header_cache_next = (header_cache_next + 1) % HTTP2_HEADER_CACHE_SIZE;
+
+    // invalidate the entry until encoding succeeds
+    prefix->size = 0;
+
+    char str_status[4];
+    snprintf(str_status, 4, "%d", res->status);
+
+    int size = http2_header_prefix_add(prefix, 0, ":status", str_status);
+
+    // content type can be null for http errors
+    size = http2_header_prefix_add(
+      prefix, size, "content-type", res->content_type);
+    size = http2_header_prefix_add(
+      prefix, size, "content-encoding", res->content_encoding);
+    size = http2_header_prefix_add(prefix, size, "vary", res->vary);
+    if (size < 0) {
+        return NULL;
+    }
+
+    prefix->status           = res->status;
+    prefix->content_type     = res->content_type;
+    prefix->content_encoding = res->content_encoding;
+    prefix->vary             = res->vary;
+    prefix->size             = (uint8_t)size;
+
+    return prefix;
+}
+
 int handle_end_stream(http2_context_t *ctx, http2_stream_t *stream)
 {
+    assert(stream->buf != NULL);
+    METRICS_STAMP(stream->stamps, DECODE);
+
     // decode header block
     header_list_t header_list;
 
     header_list_reset(&header_list);
 
-    switch (hpack_decode(
-      &ctx->hpack_dynamic_table, stream->buf, stream->buflen, &header_list)) {
+    switch (hpack_decode(&ctx->hpack_dynamic_table,
+                         stream->buf->data,
+                         stream->buflen,
+                         &header_list)) {
         case HPACK_COMPRESSION_ERROR:
             http2_error(ctx, HTTP2_COMPRESSION_ERROR);
             return -1;
@@ -668,6 +1435,7 @@ int handle_end_stream(http2_context_t *ctx, http2_stream_t *stream)
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
         return -1;
     }
+    METRICS_STAMP(stream->stamps, HANDLER);
 
     // handle request at end headers
     // data frames are ignored
@@ -680,47 +1448,120 @@ int handle_end_stream(http2_context_t *ctx, http2_stream_t *stream)
                            .headers_length = headers_length,
                            .headers = header_list_all(&header_list, headers) };
 
-    http_response_t res = { .content = (char *)stream->buf };
+    http_response_t res = { .content = (char *)stream->buf->data, .fd = -1 };
     http_handle_request(&req, &res, HTTP2_STREAM_BUF_SIZE);
+#if METRICS_ROUTES > 0
+    stream->route = res.route;
+    METRICS_STAMP(stream->stamps, QUEUE);
+#endif
 
-    // prepare HTTP2 headers
-    header_list_reset(&header_list);
-
-    // status code
-    char strCode[4];
-    snprintf(strCode, 4, "%d", res.status);
-    header_list_set(&header_list, ":status", strCode);
+    // Response data goes to the stream buffer
+    stream->buflen = res.content_length;
+#ifndef CONTIKI
+    // or is read from the response file, in which case the buffer
+    // is no longer needed. The file is attached to the stream before
+    // any error, so it is closed with the connection
+    if (res.fd >= 0) {
+        http2_stream_buf_release(stream);
+        stream->fd      = res.fd;
+        stream->fileoff = 0;
+        stream->filelen = res.content_length;
+        if (stream->filelen == 0) {
+            http2_stream_close_file(stream);
+        }
+    }
+#endif
 
-    // content type can be null for http errors
-    if (res.content_type != NULL) {
-        header_list_set(&header_list, "content-type", res.content_type);
+    // prepare HTTP2 headers from the cached prefix, only content-length
+    // and etag need to be encoded for every response
+    http2_header_prefix_t *prefix = http2_header_prefix_get(&res);
+    if (prefix == NULL) {
+        http2_error(ctx, HTTP2_INTERNAL_ERROR);
+        return -1;
     }
 
-    char strLen[10]; // 10 digits to be safe
-    snprintf(strLen, 10, "%d", res.content_length);
-    header_list_set(&header_list, "content-length", strLen);
+    uint8_t block[HTTP2_HEADER_PREFIX_SIZE + HTTP2_CONTENT_LENGTH_SIZE +
+                  HTTP2_ETAG_SIZE];
+    memcpy(block, prefix->block, prefix->size);
+    int block_size = prefix->size;
 
-    // Response data goes to the stream buffer
-    stream->buflen = res.content_length;
+    // a 304 response must not send a content-length different from
+    // the selected representation, so it is omitted
+    int rc = 0;
+    if (res.status != 304 &&
+        (rc = hpack_encode_content_length(res.content_length,
+                                          block + block_size,
+                                          HTTP2_CONTENT_LENGTH_SIZE)) < 0) {
+        http2_error(ctx, HTTP2_INTERNAL_ERROR);
+        return -1;
+    }
+    block_size += rc;
+
+    if (res.etag[0] != '\0') {
+        if ((rc = hpack_encode_static(
+               "etag", res.etag, block + block_size, HTTP2_ETAG_SIZE)) < 0) {
+            http2_error(ctx, HTTP2_INTERNAL_ERROR);
+            return -1;
+        }
+        block_size += rc;
+    }
 
     // send headers
     int hlen = 0;
-    if ((hlen = send_headers_frame(ctx->socket,
-                                   &header_list,
-                                   &ctx->hpack_dynamic_table,
-                                   stream->id,
-                                   stream->buflen == 0,
-                                   on_stream_send_complete)) < 0) {
+    if ((hlen = send_header_block_frame(ctx->socket,
+                                        block,
+                                        block_size,
+                                        stream->id,
+                                        http2_stream_remaining(stream) == 0,
+                                        on_stream_send_complete)) < 0) {
         http2_error(ctx, HTTP2_INTERNAL_ERROR);
         return -1;
     }
-    INFO("->|%u| HEADERS (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         hlen,
-         FRAME_FLAGS_END_HEADERS |
-           (stream->buflen > 0 ? 0 : FRAME_FLAGS_END_STREAM),
-         (unsigned int)stream->id);
+    TRACE_FRAME(SEND,
+                ctx->id,
+                FRAME_HEADERS_TYPE,
+                FRAME_FLAGS_END_HEADERS |
+                  (http2_stream_remaining(stream) > 0 ? 0
+                                                      : FRAME_FLAGS_END_STREAM),
+                hlen,
+                stream->id);
+
+#if METRICS_ROUTES > 0
+    // the response has no DATA frames
+    if (http2_stream_remaining(stream) == 0) {
+        METRICS_STAMP(stream->stamps, SEND);
+    }
+#endif
+
+    return 0;
+}
+
+// Reset a stream before processing its headers, e.g. when no stream
+// buffer is available. The header block must still be decoded to keep
+// the dynamic table in sync, which can only be done if it fits in a
+// single frame
+int http2_refuse_stream(http2_context_t *ctx,
+                        frame_header_t header,
+                        uint8_t *data,
+                        int size,
+                        http2_error_t error)
+{
+    if (!(header.flags & FRAME_FLAGS_END_HEADERS)) {
+        http2_error(ctx, error);
+        return -1;
+    }
+
+    header_list_t header_list;
+    header_list_reset(&header_list);
+    if (hpack_decode(&ctx->hpack_dynamic_table, data, size, &header_list) <
+        0) {
+        http2_error(ctx, HTTP2_COMPRESSION_ERROR);
+        return -1;
+    }
 
+    ctx->flags &= ~HTTP2_FLAGS_WAITING_END_HEADERS;
+    ctx->flags &= ~HTTP2_FLAGS_WAITING_END_STREAM;
+    http2_stream_error(ctx, header.stream_id, error);
     return 0;
 }
 
@@ -729,6 +1570,11 @@ int handle_header_block(http2_context_t *ctx,
                         uint8_t *data,
                         int size)
 {
+    if (ctx->stream.buf == NULL) {
+        return http2_refuse_stream(
+          ctx, header, data, size, HTTP2_REFUSED_STREAM);
+    }
+
     // copy header data to stream buffer
     int copylen = MIN(size, HTTP2_STREAM_BUF_SIZE - ctx->stream.buflen);
 
@@ -740,7 +1586,7 @@ int handle_header_block(http2_context_t *ctx,
 
     // copy memory to the stream buffer
     if (!(ctx->flags & HTTP2_FLAGS_WAITING_TRAILERS)) {
-        memcpy(ctx->stream.buf + ctx->stream.buflen, data, copylen);
+        memcpy(ctx->stream.buf->data + ctx->stream.buflen, data, copylen);
         ctx->stream.buflen += copylen;
     }
 
@@ -770,19 +1616,11 @@ int handle_headers_frame(http2_context_t *ctx,
 {
     // ignore new streams after starting close
     if (ctx->state == HTTP2_CLOSING) {
-        INFO("X-|%u| HEADERS (length: %u, flags: 0x%x, stream_id: %u)",
-             ctx->id,
-             header.length,
-             header.flags,
-             header.stream_id);
+        TRACE_HEADER(DROP, ctx->id, header);
         return 0;
     }
 
-    INFO("<-|%u| HEADERS (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
     // check stream id and stream state
     if (header.stream_id == 0x0) {
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
@@ -828,15 +1666,28 @@ int handle_headers_frame(http2_context_t *ctx,
         ctx->stream.id             = header.stream_id;
         ctx->stream.state          = HTTP2_STREAM_OPEN;
         ctx->stream.window_size    = ctx->settings.initial_window_size;
+        ctx->stream.recv_window    = HTTP2_INITIAL_WINDOW_SIZE;
         ctx->last_opened_stream_id = header.stream_id;
+        METRICS_STAMP(ctx->stream.stamps, REQUEST);
+
+        // the remote endpoint may use the default window
+        // until our settings are acknowledged
+        if (!(ctx->flags & HTTP2_FLAGS_SETTINGS_ACKED)) {
+            ctx->stream.recv_window = HTTP2_DEFAULT_WINDOW_SIZE;
+        }
 
         // reset stream flags
         ctx->flags |= HTTP2_FLAGS_WAITING_END_HEADERS;
         ctx->flags |= HTTP2_FLAGS_WAITING_END_STREAM;
 
-        // initialize stream buffer
-        ctx->stream.buflen = 0;
-        ctx->stream.bufptr = ctx->stream.buf;
+        // borrow a stream buffer from the pool, the stream
+        // is refused if none is available
+        http2_stream_buf_get(&ctx->stream);
+#ifndef CONTIKI
+        // a chunk of the previous response may still be queued,
+        // in that case the file is closed when it is sent
+        http2_stream_close_file(&ctx->stream);
+#endif
     }
 
     // calculate header payload size
@@ -857,10 +1708,24 @@ int handle_headers_frame(http2_context_t *ctx,
         payload++;
     }
 
-    // ignore all priority data
+    // priorities are not used with a single stream, but
+    // the dependency must be valid
     if (header.flags & FRAME_FLAGS_PRIORITY) {
-        size -= 5; // remove the priority size from total size
+        if (size < 5) {
+            http2_error(ctx, HTTP2_PROTOCOL_ERROR);
+            return -1;
+        }
+
+        // remove the priority size from total size
+        uint32_t dependency = buffer_get_u31(payload);
+        size -= 5;
         payload += 5;
+
+        // a stream cannot depend on itself
+        if (dependency == header.stream_id) {
+            return http2_refuse_stream(
+              ctx, header, payload, size, HTTP2_PROTOCOL_ERROR);
+        }
     }
 
     // update headers from the block size
@@ -873,11 +1738,7 @@ int handle_data_frame(http2_context_t *ctx,
                       frame_header_t header,
                       uint8_t *payload)
 {
-    INFO("X-|%u| DATA (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(DROP, ctx->id, header);
 
     // check stream id
     if (header.stream_id == 0x0 ||
@@ -886,6 +1747,18 @@ int handle_data_frame(http2_context_t *ctx,
         return -1;
     }
 
+    // all data counts against the connection window
+    if (header.length > (uint32_t)ctx->recv_window) {
+        http2_error(ctx, HTTP2_FLOW_CONTROL_ERROR);
+        return -1;
+    }
+    ctx->recv_window -= header.length;
+    http2_bdp_sample(ctx, header.length);
+
+    // the data is discarded, so the connection window can be
+    // returned even if the frame is rejected below
+    http2_conn_window_update(ctx, 0);
+
     if (header.stream_id < ctx->last_opened_stream_id) {
         http2_stream_error(ctx, header.stream_id, HTTP2_STREAM_CLOSED_ERROR);
         return -1;
@@ -896,6 +1769,12 @@ int handle_data_frame(http2_context_t *ctx,
         return -1;
     }
 
+    if (header.length > (uint32_t)ctx->stream.recv_window) {
+        http2_stream_error(ctx, header.stream_id, HTTP2_FLOW_CONTROL_ERROR);
+        return -1;
+    }
+    ctx->stream.recv_window -= header.length;
+
     if (header.flags & FRAME_FLAGS_PADDED) {
         // Padding that exceeds remaining size for header block
         // must be treated as PROTOCOL_ERROR
@@ -909,6 +1788,8 @@ int handle_data_frame(http2_context_t *ctx,
         // set the stream to the correct state
         ctx->flags &= ~HTTP2_FLAGS_WAITING_END_STREAM;
         ctx->stream.state = HTTP2_STREAM_HALF_CLOSED_REMOTE;
+    } else {
+        http2_stream_window_update(ctx, 0);
     }
 
     // if we received both end headers and end stream
@@ -924,11 +1805,7 @@ int handle_continuation_frame(http2_context_t *ctx,
                               frame_header_t header,
                               uint8_t *payload)
 {
-    INFO("<-|%u| CONTINUATION (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
 
     // check stream id and stream state
     if (header.stream_id == 0x0 ||
@@ -943,16 +1820,36 @@ int handle_continuation_frame(http2_context_t *ctx,
     return handle_header_block(ctx, header, payload, header.length);
 }
 
+// PRIORITY frames can be received on a stream in any state,
+// they are validated and otherwise ignored
+int handle_priority_frame(http2_context_t *ctx,
+                          frame_header_t header,
+                          uint8_t *payload)
+{
+    TRACE_HEADER(RECV, ctx->id, header);
+    if (header.stream_id == 0x0) {
+        http2_error(ctx, HTTP2_PROTOCOL_ERROR);
+        return -1;
+    }
+
+    if (header.length != 5) {
+        http2_stream_error(ctx, header.stream_id, HTTP2_FRAME_SIZE_ERROR);
+        return 0;
+    }
+
+    // a stream cannot depend on itself
+    if (buffer_get_u31(payload) == header.stream_id) {
+        http2_stream_error(ctx, header.stream_id, HTTP2_PROTOCOL_ERROR);
+    }
+    return 0;
+}
+
 int handle_rst_stream_frame(http2_context_t *ctx,
                             frame_header_t header,
                             uint8_t *payload)
 {
     (void)payload;
-    INFO("<-|%u| RST_STREAM (length: %u, flags: 0x%x, stream_id: %u)",
-         ctx->id,
-         header.length,
-         header.flags,
-         header.stream_id);
+    TRACE_HEADER(RECV, ctx->id, header);
     // check stream id and stream state
     if (header.stream_id == 0x0) {
         http2_error(ctx, HTTP2_PROTOCOL_ERROR);
@@ -974,6 +1871,7 @@ int handle_rst_stream_frame(http2_context_t *ctx,
 
     // close the stream
     ctx->stream.state = HTTP2_STREAM_CLOSED;
+    http2_stream_buf_release(&ctx->stream);
 
     return 0;
 }
@@ -997,38 +1895,33 @@ int waiting_for_preface(event_sock_t *client, int size, uint8_t *buf)
 
     // Wait until preface is received
     if (size < 24) {
-        // TODO: set a timer to prevent clients blocking
-        // the server at this stage
         return 0;
     }
 
     if (strncmp((char *)buf, HTTP2_PREFACE, 24) != 0) {
-        INFO("<-|%u| INVALID HTTP2_PREFACE", ctx->id);
+        TRACE_FRAME(DROP, ctx->id, TRACE_PREFACE, 0, 24, 0);
         http2_close_immediate(ctx);
         return 24;
     }
 
-    INFO("<-|%u| HTTP2_PREFACE", ctx->id);
+    TRACE_FRAME(RECV, ctx->id, TRACE_PREFACE, 0, 24, 0);
+
+    // the settings ack timer is set once SETTINGS are sent
+    event_timer_stop(ctx->timer);
+    ctx->timer = NULL;
 
     // update connection state
     ctx->state = HTTP2_WAITING_SETTINGS;
 
-    // prepare settings
-    uint32_t settings[] = {
-        HTTP2_HEADER_TABLE_SIZE,      HTTP2_ENABLE_PUSH,
-        HTTP2_MAX_CONCURRENT_STREAMS, HTTP2_INITIAL_WINDOW_SIZE,
-        HTTP2_MAX_FRAME_SIZE,         HTTP2_MAX_HEADER_LIST_SIZE
-    };
-
     // call send_setting_frame
-    INFO("->|%u| SETTINGS (length: 36)", ctx->id);
+    TRACE_FRAME(SEND, ctx->id, FRAME_SETTINGS_TYPE, 0, 36, 0);
     DEBUG("     - header_table_size: %u", HTTP2_HEADER_TABLE_SIZE);
     DEBUG("     - enable_push: %u", HTTP2_ENABLE_PUSH);
     DEBUG("     - max_concurrent_streams: %u", HTTP2_MAX_CONCURRENT_STREAMS);
     DEBUG("     - initial_window_size: %u", HTTP2_INITIAL_WINDOW_SIZE);
     DEBUG("     - max_frame_size: %u", HTTP2_MAX_FRAME_SIZE);
     DEBUG("     - max_header_list_size: %u", HTTP2_MAX_HEADER_LIST_SIZE);
-    send_settings_frame(client, 0, settings, on_settings_sent);
+    send_settings_frame(client, 0, local_settings, on_settings_sent);
 
     // go to next state
     event_read(client, waiting_for_settings);
@@ -1069,12 +1962,18 @@ int waiting_for_settings(event_sock_t *sock, int size, uint8_t *buf)
     if (size < frame_size) {
         return 0;
     }
+    METRICS_FRAME_IN(frame_header.type);
 
-    if (handle_settings_frame(
-          ctx, frame_header, buf + HTTP2_FRAME_HEADER_SIZE) < 0) {
+    int rc = handle_settings_frame(
+      ctx, frame_header, buf + HTTP2_FRAME_HEADER_SIZE);
+    if (rc < 0) {
         // if an error ocurred, discard the remaining data
         return size;
     }
+    if (rc > 0) {
+        // wait until the ACK can be sent
+        return 0;
+    }
 
     // go to next state
     ctx->state = HTTP2_READY;
@@ -1095,14 +1994,28 @@ int receiving(event_sock_t *sock, int size, uint8_t *buf)
         return 0;
     }
 
+    // the remote endpoint is alive
+    ctx->idle_ticks = 0;
+
     int bytes_read      = 0;
     int bytes_remaining = size;
     frame_header_t frame_header;
 
     // process as much data as possible
     while (bytes_remaining > 0) {
+        // discard the remaining payload of a DATA frame
+        // larger than the read buffer
+        if (ctx->data_skip > 0) {
+            int len = MIN(ctx->data_skip, (uint32_t)bytes_remaining);
+            ctx->data_skip -= len;
+            bytes_read += len;
+            bytes_remaining -= len;
+            continue;
+        }
+
         // Wait until frame header is received
         if (bytes_remaining < HTTP2_FRAME_HEADER_SIZE) {
+            ctx->rx_partial = 1;
             return bytes_read;
         }
 
@@ -1122,8 +2035,10 @@ int receiving(event_sock_t *sock, int size, uint8_t *buf)
         }
 
         // we cannot allocate frames larger than the buffer
-        // send a FLOW_CONTROL_ERROR
-        if (frame_header.length > HTTP2_SOCK_READ_SIZE) {
+        // send a FLOW_CONTROL_ERROR. DATA frames are discarded
+        // so they can be processed as they arrive
+        if (frame_header.length > HTTP2_SOCK_READ_SIZE &&
+            frame_header.type != FRAME_DATA_TYPE) {
             ERROR("cannot process frame (type: 0x%x, length %u) for http/2 "
                   "client %u",
                   frame_header.type,
@@ -1134,9 +2049,19 @@ int receiving(event_sock_t *sock, int size, uint8_t *buf)
         }
 
         // do nothing if the frame has not been fully received
-        if (bytes_remaining < HTTP2_FRAME_HEADER_SIZE + frame_header.length) {
+        unsigned int frame_needed = frame_header.length;
+        if (frame_header.type == FRAME_DATA_TYPE) {
+            // only the padding length is needed from the DATA payload
+            unsigned int padded = !!(frame_header.flags & FRAME_FLAGS_PADDED);
+            frame_needed        = MIN(frame_header.length, padded);
+        }
+        if (bytes_remaining < HTTP2_FRAME_HEADER_SIZE + (int)frame_needed) {
+            ctx->rx_partial = 1;
             return bytes_read;
         }
+        ctx->rx_partial  = 0;
+        ctx->frame_ticks = 0;
+        METRICS_FRAME_IN(frame_header.type);
 
         // update totals
         bytes_read += HTTP2_FRAME_HEADER_SIZE;
@@ -1177,30 +2102,33 @@ int receiving(event_sock_t *sock, int size, uint8_t *buf)
                 rc =
                   handle_rst_stream_frame(ctx, frame_header, buf + bytes_read);
                 break;
-            case FRAME_PRIORITY_TYPE: // ignore priority frames
-                INFO("X-|%u| PRIORITY (length: %u, flags: 0x%x, stream_id: %u)",
-                     ctx->id,
-                     frame_header.length,
-                     frame_header.flags,
-                     frame_header.stream_id);
+            case FRAME_PRIORITY_TYPE:
+                rc = handle_priority_frame(ctx, frame_header, buf + bytes_read);
                 break;
             case FRAME_DATA_TYPE:
                 rc = handle_data_frame(ctx, frame_header, buf + bytes_read);
                 break;
             case FRAME_PUSH_PROMISE_TYPE:
-                INFO("X-|%u| PUSH_PROMISE (length: %u, flags: 0x%x, stream_id: "
-                     "%u)",
-                     ctx->id,
-                     frame_header.length,
-                     frame_header.flags,
-                     frame_header.stream_id);
+                TRACE_HEADER(DROP, ctx->id, frame_header);
                 http2_error(ctx, HTTP2_PROTOCOL_ERROR);
                 break;
         }
 
+        // the frame is processed again once its reply can be sent
+        if (rc > 0) {
+            return bytes_read - HTTP2_FRAME_HEADER_SIZE;
+        }
+
+        // the rest of a DATA payload is skipped as it arrives
+        unsigned int frame_read = frame_header.length;
+        if (frame_read > (unsigned int)bytes_remaining) {
+            ctx->data_skip = frame_read - bytes_remaining;
+            frame_read     = bytes_remaining;
+        }
+
         // update totals
-        bytes_read += frame_header.length;
-        bytes_remaining -= frame_header.length;
+        bytes_read += frame_read;
+        bytes_remaining -= frame_read;
 
         // if an error ocurred in handling, break and return
         if (rc < 0) {
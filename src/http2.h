@@ -9,6 +9,7 @@
 #include "event.h"
 #include "header_list.h"
 #include "hpack/hpack.h"
+#include "metrics.h"
 
 /**
  * SETTINGS_HEADER_TABLE_SIZE
@@ -176,6 +177,13 @@ typedef enum
     HTTP2_HTTP_1_1_REQUIRED = (uint8_t)0xd
 } http2_error_t;
 
+// stream buffer from the shared pool
+typedef struct http2_stream_buf
+{
+    struct http2_stream_buf *next;
+    uint8_t data[HTTP2_STREAM_BUF_SIZE];
+} http2_stream_buf_t;
+
 typedef struct http2_stream
 {
     uint32_t id;
@@ -195,11 +203,33 @@ typedef struct http2_stream
     // window size
     int32_t window_size;
 
+    // remaining receive window for the remote endpoint
+    int32_t recv_window;
+
     // header block receiving buffer
-    // and data output buffer
-    uint8_t buf[HTTP2_STREAM_BUF_SIZE];
+    // and data output buffer, only attached
+    // while the stream is active
+    http2_stream_buf_t *buf;
     uint16_t buflen;
     uint8_t *bufptr;
+
+#ifndef CONTIKI
+    // data output from a file, used
+    // instead of the stream buffer if fd >= 0
+    int fd;
+    off_t fileoff;
+    uint32_t filelen;
+
+    // file of the data frame being sent or -1
+    int sendfd;
+#endif
+
+#if METRICS_ROUTES > 0
+    // resource that handled the request and
+    // start time of the request phases
+    int route;
+    uint32_t stamps[METRICS_PHASE_TOTAL];
+#endif
 } http2_stream_t;
 
 typedef struct http2_settings
@@ -239,11 +269,39 @@ typedef struct http2_context
 
     // connection window size
     // for the remote endpoint
-    // since we will ignore DATA frames
-    // we don not require to maintain
-    // a local window size
     int32_t window_size;
 
+    // remaining connection receive window and the
+    // autotuned size for connection and stream windows.
+    // DATA frames are ignored so consumed window is
+    // returned as soon as the data is read
+    int32_t recv_window;
+    int32_t recv_window_size;
+
+    // bytes received since the last PING was sent,
+    // used as bandwidth-delay product sample
+    uint32_t bdp_bytes;
+
+    // smoothed round trip time in milliseconds measured with
+    // PING frames, 0 if unknown
+    uint32_t rtt;
+    uint32_t ping_sent;
+
+    // connection timer ticks without receiving data, waiting
+    // for the end of a frame or header block, without streams
+    // and since the connection started closing
+    uint16_t idle_ticks;
+    uint16_t frame_ticks;
+    uint16_t stream_ticks;
+    uint16_t closing_ticks;
+
+    // a frame has been partially received
+    uint8_t rx_partial;
+
+    // remaining payload of a DATA frame larger than
+    // the read buffer
+    uint32_t data_skip;
+
     // current stream
     http2_stream_t stream;
 
@@ -251,7 +309,7 @@ typedef struct http2_context
     uint32_t last_opened_stream_id;
 
     // http2 state flags
-    uint8_t flags;
+    uint16_t flags;
 
     // sock read and write buffers
     uint8_t read_buf[HTTP2_SOCK_READ_SIZE];
@@ -264,7 +322,20 @@ typedef struct http2_context
     event_t *timer;
 } http2_context_t;
 
+// number of connections closed on each deadline
+typedef struct
+{
+    uint32_t preface;  // no connection preface
+    uint32_t settings; // no SETTINGS ACK
+    uint32_t headers;  // incomplete frame or header block
+    uint32_t idle;     // no streams
+    uint32_t ping;     // no PING ACK
+    uint32_t refused;  // server full or accept rate exceeded
+    uint32_t closing;  // GOAWAY not sent or answered in time
+} http2_reap_counts_t;
+
 http2_context_t *http2_new_client(event_sock_t *client);
+const http2_reap_counts_t *http2_get_reap_counts(void);
 int http2_close_gracefully(http2_context_t *ctx);
 void http2_close_immediate(http2_context_t *ctx);
 void http2_error(http2_context_t *ctx, http2_error_t error);
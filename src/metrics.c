@@ -0,0 +1,491 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONTIKI
+#include "contiki.h"
+#else
+#include <time.h>
+#endif
+
+#include "metrics.h"
+
+metrics_t metrics;
+
+// Prometheus names for the counters, in metrics_counter_t order
+static const char *counter_names[METRICS_COUNTERS] = {
+    "two_accepts_total",
+    "two_rejects_total",
+    "two_connections",
+    "two_bytes_in_total",
+    "two_bytes_out_total",
+    "two_hpack_in_indexed_total",
+    "two_hpack_in_literal_total",
+    "two_hpack_in_huffman_total",
+    "two_hpack_in_raw_total",
+    "two_hpack_out_indexed_total",
+    "two_hpack_out_literal_total",
+    "two_hpack_out_huffman_total",
+    "two_hpack_out_raw_total",
+    "two_flow_stalls_total",
+    "two_write_stalls_total",
+    "two_read_buffer_max_bytes",
+    "two_write_buffer_max_bytes",
+    "two_write_queue_max",
+};
+
+// Names of the frame types, indexed by type
+static const char *frame_names[METRICS_FRAME_TYPES] = {
+    "DATA",         "HEADERS", "PRIORITY", "RST_STREAM",    "SETTINGS",
+    "PUSH_PROMISE", "PING",    "GOAWAY",   "WINDOW_UPDATE", "CONTINUATION"
+};
+
+static const uint32_t latency_bounds[METRICS_LATENCY_BUCKETS - 1] =
+  METRICS_LATENCY_BOUNDS;
+
+#if METRICS_ROUTES > 0
+// Names of the request phases
+static const char *phase_names[METRICS_PHASES] = {
+    "request", "decode", "handler", "queue", "send", "total"
+};
+
+// Route paths, kept on reset
+static const char *route_paths[METRICS_ROUTES];
+#endif
+
+#define HIST_SUB_BUCKETS (1 << METRICS_HIST_SUB_BITS)
+
+void metrics_max(metrics_counter_t counter, uint32_t value)
+{
+    if (value > metrics.counters[counter]) {
+        metrics.counters[counter] = value;
+    }
+}
+
+void metrics_frame(uint32_t *frames, uint8_t type)
+{
+    if (type < METRICS_FRAME_TYPES) {
+        frames[type]++;
+    }
+}
+
+void metrics_latency(uint32_t micros)
+{
+    int i = 0;
+    while (i < METRICS_LATENCY_BUCKETS - 1 && micros > latency_bounds[i]) {
+        i++;
+    }
+    metrics.latency_buckets[i]++;
+    metrics.latency_sum += micros;
+}
+
+uint32_t metrics_clock_us(void)
+{
+#ifdef CONTIKI
+    return (uint32_t)(((uint64_t)clock_time() * 1000000) / CLOCK_SECOND);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000000 + now.tv_nsec / 1000);
+#endif
+}
+
+void metrics_reset(void)
+{
+    memset(&metrics, 0, sizeof(metrics_t));
+}
+
+/////////////////////////////////////////////////////
+// Log-linear histograms
+/////////////////////////////////////////////////////
+
+// Get the bucket for the value. Values below HIST_SUB_BUCKETS have
+// a bucket each, larger values use the position of the most
+// significant bit and the next METRICS_HIST_SUB_BITS bits
+static unsigned int hist_bucket(uint32_t value)
+{
+    if (value < HIST_SUB_BUCKETS) {
+        return value;
+    }
+    if (value >= ((uint32_t)1 << METRICS_HIST_MAX_BITS)) {
+        return METRICS_HIST_BUCKETS - 1;
+    }
+
+    unsigned int msb = 0;
+    while (value >> (msb + 1)) {
+        msb++;
+    }
+
+    unsigned int shift = msb - METRICS_HIST_SUB_BITS;
+    return ((shift + 1) << METRICS_HIST_SUB_BITS) +
+           ((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Get the largest value that goes in the bucket
+static uint32_t hist_bucket_max(unsigned int bucket)
+{
+    if (bucket < HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    if (bucket >= METRICS_HIST_BUCKETS - 1) {
+        return (uint32_t)1 << METRICS_HIST_MAX_BITS;
+    }
+
+    unsigned int shift = (bucket >> METRICS_HIST_SUB_BITS) - 1;
+    uint32_t sub       = bucket & (HIST_SUB_BUCKETS - 1);
+    return ((HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void metrics_hist_add(metrics_hist_t *hist, uint32_t value)
+{
+    hist->buckets[hist_bucket(value)]++;
+    hist->count++;
+}
+
+uint32_t metrics_hist_quantile(metrics_hist_t *hist, unsigned int permille)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    // rank of the quantile, starting at 1
+    uint64_t rank = ((uint64_t)hist->count * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        count += hist->buckets[i];
+        if (count >= rank) {
+            return hist_bucket_max(i);
+        }
+    }
+    return hist_bucket_max(METRICS_HIST_BUCKETS - 1);
+}
+
+/////////////////////////////////////////////////////
+// Request phases
+/////////////////////////////////////////////////////
+
+void metrics_route(int route, const char *path)
+{
+#if METRICS_ROUTES > 0
+    if (route >= 0 && route < METRICS_ROUTES) {
+        route_paths[route] = path;
+    }
+#else
+    (void)route;
+    (void)path;
+#endif
+}
+
+void metrics_phases(int route, uint32_t *stamps)
+{
+#if METRICS_ROUTES > 0
+    if (route < 0 || route >= METRICS_ROUTES) {
+        return;
+    }
+
+    uint32_t now = metrics_clock_us();
+    for (int i = 0; i < METRICS_PHASE_TOTAL; i++) {
+        uint32_t end = (i + 1 < METRICS_PHASE_TOTAL) ? stamps[i + 1] : now;
+        metrics_hist_add(&metrics.phases[route][i], end - stamps[i]);
+    }
+    metrics_hist_add(&metrics.phases[route][METRICS_PHASE_TOTAL],
+                     now - stamps[0]);
+#else
+    (void)route;
+    (void)stamps;
+#endif
+}
+
+uint32_t metrics_phase_quantile(int route,
+                                metrics_phase_t phase,
+                                unsigned int permille)
+{
+#if METRICS_ROUTES > 0
+    if (route < 0 || route >= METRICS_ROUTES || phase >= METRICS_PHASES) {
+        return 0;
+    }
+    return metrics_hist_quantile(&metrics.phases[route][phase], permille);
+#else
+    (void)route;
+    (void)phase;
+    (void)permille;
+    return 0;
+#endif
+}
+
+/////////////////////////////////////////////////////
+// Prometheus text format
+/////////////////////////////////////////////////////
+
+// Append a line to the response. It returns -1 if the
+// line does not fit in the remaining space
+static int append_line(char *response,
+                       unsigned int *len,
+                       unsigned int maxlen,
+                       const char *fmt,
+                       ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(response + *len, maxlen - *len, fmt, args);
+    va_end(args);
+
+    // keep the response cut at the last complete line
+    if (n < 0 || (unsigned int)n >= maxlen - *len) {
+        response[*len] = '\0';
+        return -1;
+    }
+    *len += n;
+    return 0;
+}
+
+int metrics_prometheus_handler(char *method, char *uri, char *response,
+                               unsigned int maxlen)
+{
+    (void)method;
+    (void)uri;
+
+    unsigned int len = 0;
+    for (int i = 0; i < METRICS_COUNTERS; i++) {
+        if (metrics.counters[i] > 0 &&
+            append_line(response,
+                        &len,
+                        maxlen,
+                        "%s %lu\n",
+                        counter_names[i],
+                        (unsigned long)metrics.counters[i]) < 0) {
+            return len;
+        }
+    }
+
+    for (int i = 0; i < METRICS_FRAME_TYPES; i++) {
+        if (metrics.frames_in[i] > 0 &&
+            append_line(response,
+                        &len,
+                        maxlen,
+                        "two_frames_in_total{type=\"%s\"} %lu\n",
+                        frame_names[i],
+                        (unsigned long)metrics.frames_in[i]) < 0) {
+            return len;
+        }
+    }
+
+    for (int i = 0; i < METRICS_FRAME_TYPES; i++) {
+        if (metrics.frames_out[i] > 0 &&
+            append_line(response,
+                        &len,
+                        maxlen,
+                        "two_frames_out_total{type=\"%s\"} %lu\n",
+                        frame_names[i],
+                        (unsigned long)metrics.frames_out[i]) < 0) {
+            return len;
+        }
+    }
+
+    // histogram buckets are cumulative
+    if (append_line(response,
+                    &len,
+                    maxlen,
+                    "# TYPE two_handler_latency_us histogram\n") < 0) {
+        return len;
+    }
+    unsigned long count = 0;
+    for (int i = 0; i < METRICS_LATENCY_BUCKETS; i++) {
+        count += metrics.latency_buckets[i];
+        int rc;
+        if (i < METRICS_LATENCY_BUCKETS - 1) {
+            rc = append_line(response,
+                             &len,
+                             maxlen,
+                             "two_handler_latency_us_bucket{le=\"%lu\"} "
+                             "%lu\n",
+                             (unsigned long)latency_bounds[i],
+                             count);
+        } else {
+            rc = append_line(response,
+                             &len,
+                             maxlen,
+                             "two_handler_latency_us_bucket{le=\"+Inf\"} "
+                             "%lu\n",
+                             count);
+        }
+        if (rc < 0) {
+            return len;
+        }
+    }
+    if (append_line(response,
+                    &len,
+                    maxlen,
+                    "two_handler_latency_us_sum %llu\n",
+                    (unsigned long long)metrics.latency_sum) < 0) {
+        return len;
+    }
+    append_line(
+      response, &len, maxlen, "two_handler_latency_us_count %lu\n", count);
+
+    return len;
+}
+
+/////////////////////////////////////////////////////
+// CBOR format
+/////////////////////////////////////////////////////
+
+#define CBOR_UINT  (0)
+#define CBOR_ARRAY (4)
+#define CBOR_MAP   (5)
+
+// Write the CBOR head for the major type and value. It returns
+// -1 if there is not enough space in the buffer
+static int cbor_head(uint8_t *buf,
+                     unsigned int *len,
+                     unsigned int maxlen,
+                     uint8_t major,
+                     uint64_t value)
+{
+    int size     = 0;
+    uint8_t info = 0;
+    if (value < 24) {
+        info = (uint8_t)value;
+    } else if (value <= 0xff) {
+        info = 24;
+        size = 1;
+    } else if (value <= 0xffff) {
+        info = 25;
+        size = 2;
+    } else if (value <= 0xffffffff) {
+        info = 26;
+        size = 4;
+    } else {
+        info = 27;
+        size = 8;
+    }
+
+    if (*len + 1 + size > maxlen) {
+        return -1;
+    }
+
+    buf[(*len)++] = (major << 5) | info;
+    for (int i = size - 1; i >= 0; i--) {
+        buf[(*len)++] = (uint8_t)(value >> (8 * i));
+    }
+    return 0;
+}
+
+// Write the key followed by an array of values
+static int cbor_array(uint8_t *buf,
+                      unsigned int *len,
+                      unsigned int maxlen,
+                      unsigned int key,
+                      uint32_t *values,
+                      unsigned int count)
+{
+    if (cbor_head(buf, len, maxlen, CBOR_UINT, key) < 0 ||
+        cbor_head(buf, len, maxlen, CBOR_ARRAY, count) < 0) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        if (cbor_head(buf, len, maxlen, CBOR_UINT, values[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int metrics_cbor_handler(char *method, char *uri, char *response,
+                         unsigned int maxlen)
+{
+    (void)method;
+    (void)uri;
+
+    uint8_t *buf     = (uint8_t *)response;
+    unsigned int len = 0;
+
+    if (cbor_head(buf, &len, maxlen, CBOR_MAP, METRICS_COUNTERS + 4) < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < METRICS_COUNTERS; i++) {
+        if (cbor_head(buf, &len, maxlen, CBOR_UINT, i) < 0 ||
+            cbor_head(buf, &len, maxlen, CBOR_UINT, metrics.counters[i]) <
+              0) {
+            return -1;
+        }
+    }
+
+    if (cbor_array(buf,
+                   &len,
+                   maxlen,
+                   METRICS_KEY_FRAMES_IN,
+                   metrics.frames_in,
+                   METRICS_FRAME_TYPES) < 0 ||
+        cbor_array(buf,
+                   &len,
+                   maxlen,
+                   METRICS_KEY_FRAMES_OUT,
+                   metrics.frames_out,
+                   METRICS_FRAME_TYPES) < 0 ||
+        cbor_array(buf,
+                   &len,
+                   maxlen,
+                   METRICS_KEY_LATENCY_BUCKETS,
+                   metrics.latency_buckets,
+                   METRICS_LATENCY_BUCKETS) < 0) {
+        return -1;
+    }
+
+    if (cbor_head(buf, &len, maxlen, CBOR_UINT, METRICS_KEY_LATENCY_SUM) < 0 ||
+        cbor_head(buf, &len, maxlen, CBOR_UINT, metrics.latency_sum) < 0) {
+        return -1;
+    }
+
+    return len;
+}
+
+/////////////////////////////////////////////////////
+// Request phases table
+/////////////////////////////////////////////////////
+
+int metrics_phases_handler(char *method, char *uri, char *response,
+                           unsigned int maxlen)
+{
+    (void)method;
+    (void)uri;
+
+    unsigned int len = 0;
+    if (append_line(response,
+                    &len,
+                    maxlen,
+                    "route phase count p50 p99 p999\n") < 0) {
+        return len;
+    }
+
+#if METRICS_ROUTES > 0
+    for (int route = 0; route < METRICS_ROUTES; route++) {
+        for (int phase = 0; phase < METRICS_PHASES; phase++) {
+            metrics_hist_t *hist = &metrics.phases[route][phase];
+            if (hist->count == 0) {
+                continue;
+            }
+            if (append_line(
+                  response,
+                  &len,
+                  maxlen,
+                  "%s %s %lu %lu %lu %lu\n",
+                  route_paths[route] != NULL ? route_paths[route] : "-",
+                  phase_names[phase],
+                  (unsigned long)hist->count,
+                  (unsigned long)metrics_hist_quantile(hist, 500),
+                  (unsigned long)metrics_hist_quantile(hist, 990),
+                  (unsigned long)metrics_hist_quantile(hist, 999)) < 0) {
+                return len;
+            }
+        }
+    }
+#endif
+
+    return len;
+}
@@ -0,0 +1,223 @@
+/**
+ * Server metrics registry
+ *
+ * Counters, gauges and a latency histogram for the event loop, the HTTP/2
+ * and the HPACK modules. The event loop runs in a single thread, so values
+ * are updated in place without locks.
+ *
+ * Metrics are only updated if the library is built with CONFIG_TWO_METRICS
+ * set to 1, otherwise the update macros compile to nothing. The values can
+ * be served by registering one of the resource handlers below, e.g.
+ *
+ *   two_register_resource("GET", "/metrics", "text/plain",
+ *                         metrics_prometheus_handler);
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "two-conf.h"
+
+// Counters and gauges. The position in the list is
+// the key used by the CBOR representation
+typedef enum
+{
+    METRICS_ACCEPTS,           // accepted connections
+    METRICS_REJECTS,           // connections refused by the server
+    METRICS_CONNECTIONS,       // active connections (gauge)
+    METRICS_BYTES_IN,          // bytes received
+    METRICS_BYTES_OUT,         // bytes sent
+    METRICS_HPACK_IN_INDEXED,  // received header fields found in the tables
+    METRICS_HPACK_IN_LITERAL,  // received header fields with a literal value
+    METRICS_HPACK_IN_HUFFMAN,  // received huffman encoded strings
+    METRICS_HPACK_IN_RAW,      // received raw strings
+    METRICS_HPACK_OUT_INDEXED, // sent header fields found in the tables
+    METRICS_HPACK_OUT_LITERAL, // sent header fields with a literal value
+    METRICS_HPACK_OUT_HUFFMAN, // sent huffman encoded strings
+    METRICS_HPACK_OUT_RAW,     // sent raw strings
+    METRICS_FLOW_STALLS,       // DATA delayed by the flow control window
+    METRICS_WRITE_STALLS,      // DATA delayed by a full write buffer
+    METRICS_READ_BUF_MAX,      // read buffer high-water mark (gauge)
+    METRICS_WRITE_BUF_MAX,     // write buffer high-water mark (gauge)
+    METRICS_WRITE_OPS_MAX,     // write queue high-water mark (gauge)
+    METRICS_COUNTERS
+} metrics_counter_t;
+
+// CBOR keys for the values after the counters
+#define METRICS_KEY_FRAMES_IN       (METRICS_COUNTERS)
+#define METRICS_KEY_FRAMES_OUT      (METRICS_COUNTERS + 1)
+#define METRICS_KEY_LATENCY_BUCKETS (METRICS_COUNTERS + 2)
+#define METRICS_KEY_LATENCY_SUM     (METRICS_COUNTERS + 3)
+
+// Frame types are counted up to CONTINUATION (0x9)
+#define METRICS_FRAME_TYPES (10)
+
+// Upper bounds in microseconds for the handler latency histogram,
+// the last bucket counts all observations
+#define METRICS_LATENCY_BOUNDS                                                 \
+    {                                                                          \
+        100, 1000, 10000, 100000                                               \
+    }
+#define METRICS_LATENCY_BUCKETS (5)
+
+// Phases of a request, measured for each route. Each phase starts
+// at a timestamp of the stream and ends at the start of the next one,
+// the last phase ends when the last byte of the response is flushed
+typedef enum
+{
+    METRICS_PHASE_REQUEST, // stream open to complete request
+    METRICS_PHASE_DECODE,  // HPACK decoding of the header block
+    METRICS_PHASE_HANDLER, // request processing and resource handler
+    METRICS_PHASE_QUEUE,   // response headers to the first DATA queued
+    METRICS_PHASE_SEND,    // first DATA queued to the last byte flushed
+    METRICS_PHASE_TOTAL,   // stream open to the last byte flushed
+    METRICS_PHASES
+} metrics_phase_t;
+
+// Log-linear histogram of values in microseconds. Values are grouped by
+// powers of 2, each split in 2^METRICS_HIST_SUB_BITS linear buckets, which
+// bounds the relative error to 25%. Values of 2^METRICS_HIST_MAX_BITS
+// (about 16 seconds) or larger go to the last bucket
+#define METRICS_HIST_SUB_BITS (2)
+#define METRICS_HIST_MAX_BITS (24)
+#define METRICS_HIST_BUCKETS                                                   \
+    ((((METRICS_HIST_MAX_BITS) - (METRICS_HIST_SUB_BITS) + 1)                  \
+      << (METRICS_HIST_SUB_BITS)) +                                            \
+     1)
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t buckets[METRICS_HIST_BUCKETS];
+} metrics_hist_t;
+
+// Routes with phase histograms, only allocated if metrics are enabled
+#if TWO_METRICS
+#define METRICS_ROUTES (TWO_METRICS_ROUTES)
+#else
+#define METRICS_ROUTES (0)
+#endif
+
+typedef struct
+{
+    uint32_t counters[METRICS_COUNTERS];
+    uint32_t frames_in[METRICS_FRAME_TYPES];
+    uint32_t frames_out[METRICS_FRAME_TYPES];
+
+    // resource handler latency
+    uint32_t latency_buckets[METRICS_LATENCY_BUCKETS];
+    uint64_t latency_sum;
+
+#if METRICS_ROUTES > 0
+    // request phases by route
+    metrics_hist_t phases[METRICS_ROUTES][METRICS_PHASES];
+#endif
+} metrics_t;
+
+extern metrics_t metrics;
+
+#if TWO_METRICS
+#define METRICS_INC(name) (metrics.counters[METRICS_##name]++)
+#define METRICS_DEC(name) (metrics.counters[METRICS_##name]--)
+#define METRICS_ADD(name, n) (metrics.counters[METRICS_##name] += (n))
+#define METRICS_MAX(name, n) metrics_max(METRICS_##name, (n))
+#define METRICS_FRAME_IN(type) metrics_frame(metrics.frames_in, (type))
+#define METRICS_FRAME_OUT(type) metrics_frame(metrics.frames_out, (type))
+#define METRICS_CLOCK(var) uint32_t var = metrics_clock_us()
+#define METRICS_LATENCY(start) metrics_latency(metrics_clock_us() - (start))
+#else
+#define METRICS_INC(name)
+#define METRICS_DEC(name)
+#define METRICS_ADD(name, n)
+#define METRICS_MAX(name, n)
+#define METRICS_FRAME_IN(type)
+#define METRICS_FRAME_OUT(type)
+#define METRICS_CLOCK(var)
+#define METRICS_LATENCY(start)
+#endif
+
+#if METRICS_ROUTES > 0
+#define METRICS_ROUTE(route, path) metrics_route((route), (path))
+#define METRICS_STAMP(stamps, phase)                                           \
+    ((stamps)[METRICS_PHASE_##phase] = metrics_clock_us())
+#define METRICS_PHASES_END(route, stamps) metrics_phases((route), (stamps))
+#else
+#define METRICS_ROUTE(route, path)
+#define METRICS_STAMP(stamps, phase)
+#define METRICS_PHASES_END(route, stamps)
+#endif
+
+// Update the gauge if the value is larger than the current one
+void metrics_max(metrics_counter_t counter, uint32_t value);
+
+// Count a frame of the given type in the list
+void metrics_frame(uint32_t *frames, uint8_t type);
+
+// Add an observation to the handler latency histogram
+void metrics_latency(uint32_t micros);
+
+// Get a monotonic time in microseconds. The value wraps around, so
+// it is only useful to measure intervals
+uint32_t metrics_clock_us(void);
+
+// Set all metrics to 0
+void metrics_reset(void);
+
+// Add a value to the histogram
+void metrics_hist_add(metrics_hist_t *hist, uint32_t value);
+
+// Get the value for the quantile given in parts per thousand, i.e. 990
+// for p99. It returns the upper bound of the bucket with the quantile,
+// or 0 if the histogram is empty
+uint32_t metrics_hist_quantile(metrics_hist_t *hist, unsigned int permille);
+
+// Set the path of the route, used as label by the handlers
+void metrics_route(int route, const char *path);
+
+// Add the phases of a finished request to the route histograms.
+// Stamps has the start time of every phase before METRICS_PHASE_TOTAL
+void metrics_phases(int route, uint32_t *stamps);
+
+// Get the quantile of the phase duration for the route in microseconds,
+// or 0 if the route has no requests
+uint32_t metrics_phase_quantile(int route,
+                                metrics_phase_t phase,
+                                unsigned int permille);
+
+/**
+ * Resource handler for the metrics in the Prometheus text format. Counters
+ * with a 0 value are omitted to fit the stream buffer, and the response is
+ * cut at the last line that fits in maxlen
+ *
+ * @return  the length of the response
+ */
+int metrics_prometheus_handler(char *method, char *uri, char *response,
+                               unsigned int maxlen);
+
+/**
+ * Resource handler for the metrics as a CBOR map. Counters use the
+ * metrics_counter_t value as key, the frame counts and the latency
+ * buckets are arrays under the METRICS_KEY_* keys
+ *
+ * @return  the length of the response or -1 if it does not fit in maxlen
+ */
+int metrics_cbor_handler(char *method, char *uri, char *response,
+                         unsigned int maxlen);
+
+/**
+ * Resource handler for the request phases as a text table with one line
+ * for each route and phase with requests, giving the count and the
+ * p50, p99 and p999 durations in microseconds, e.g.
+ *
+ *   route phase count p50 p99 p999
+ *   /index handler 12 13 47 47
+ *
+ * The response is cut at the last line that fits in maxlen
+ *
+ * @return  the length of the response
+ */
+int metrics_phases_handler(char *method, char *uri, char *response,
+                           unsigned int maxlen);
+
+#endif /* METRICS_H */
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "event.h"
+#include "trace.h"
+
+#include "logging.h"
+
+#if TWO_TRACE_SIZE > 0
+
+#if (TWO_TRACE_SIZE & (TWO_TRACE_SIZE - 1)) != 0
+#error "CONFIG_TWO_TRACE_SIZE must be a power of 2"
+#endif
+
+#define TRACE_MASK (TWO_TRACE_SIZE - 1)
+
+// Maximum length of a formatted entry
+#define TRACE_LINE_SIZE (96)
+
+static trace_entry_t entries[TWO_TRACE_SIZE];
+
+// total entries written, the index is
+// the lowest bits of the counter
+static uint32_t trace_count;
+
+static const char *frame_names[] = {
+    "DATA",         "HEADERS", "PRIORITY", "RST_STREAM",    "SETTINGS",
+    "PUSH_PROMISE", "PING",    "GOAWAY",   "WINDOW_UPDATE", "CONTINUATION"
+};
+#define FRAME_NAMES (sizeof(frame_names) / sizeof(frame_names[0]))
+
+static const char *dir_names[] = { "<-", "->", "X-" };
+
+void trace_frame(uint8_t dir,
+                 uint8_t conn,
+                 uint8_t type,
+                 uint8_t flags,
+                 uint32_t length,
+                 uint32_t stream_id)
+{
+    trace_entry_t *entry = &entries[trace_count++ & TRACE_MASK];
+    entry->time          = event_time_ms();
+    entry->stream_id     = stream_id;
+    entry->length        = length;
+    entry->conn          = conn;
+    entry->dir           = dir;
+    entry->type          = type;
+    entry->flags         = flags;
+}
+
+int trace_format(const trace_entry_t *entry, char *buf, unsigned int maxlen)
+{
+    const char *dir = entry->dir < 3 ? dir_names[entry->dir] : "??";
+    if (entry->type == TRACE_PREFACE) {
+        return snprintf(buf,
+                        maxlen,
+                        "%lu %s|%u| HTTP2_PREFACE",
+                        (unsigned long)entry->time,
+                        dir,
+                        entry->conn);
+    }
+
+    if (entry->type < FRAME_NAMES) {
+        return snprintf(buf,
+                        maxlen,
+                        "%lu %s|%u| %s (length: %lu, flags: 0x%x, "
+                        "stream_id: %lu)",
+                        (unsigned long)entry->time,
+                        dir,
+                        entry->conn,
+                        frame_names[entry->type],
+                        (unsigned long)entry->length,
+                        entry->flags,
+                        (unsigned long)entry->stream_id);
+    }
+
+    return snprintf(buf,
+                    maxlen,
+                    "%lu %s|%u| 0x%x (length: %lu, flags: 0x%x, "
+                    "stream_id: %lu)",
+                    (unsigned long)entry->time,
+                    dir,
+                    entry->conn,
+                    entry->type,
+                    (unsigned long)entry->length,
+                    entry->flags,
+                    (unsigned long)entry->stream_id);
+}
+
+void trace_dump(trace_dump_cb cb)
+{
+    char line[TRACE_LINE_SIZE];
+
+    // the oldest entry is overwritten once the buffer is full
+    uint32_t start = 0;
+    if (trace_count > TWO_TRACE_SIZE) {
+        start = trace_count - TWO_TRACE_SIZE;
+    }
+
+    for (uint32_t i = start; i != trace_count; i++) {
+        trace_format(&entries[i & TRACE_MASK], line, TRACE_LINE_SIZE);
+        if (cb != NULL) {
+            cb(line);
+        } else {
+            LOG_PRINT("[TRACE] %s\n", line);
+        }
+    }
+}
+
+void trace_reset(void)
+{
+    trace_count = 0;
+    memset(entries, 0, sizeof(entries));
+}
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * Frame trace
+ *
+ * Fixed size ring buffer with the last frames received, sent or dropped by
+ * the HTTP/2 module. Each entry is stored in binary form (16 bytes) and is
+ * only formatted when the trace is dumped, so tracing a frame costs a few
+ * stores instead of a formatted write to the log.
+ *
+ * The number of entries is set with CONFIG_TWO_TRACE_SIZE (a power of 2).
+ * Setting it to 0 removes the trace.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "two-conf.h"
+
+// Frame direction
+#define TRACE_RECV (0) // received and processed
+#define TRACE_SEND (1) // queued for sending
+#define TRACE_DROP (2) // received and ignored
+
+// Pseudo frame type for the connection preface
+#define TRACE_PREFACE (0xff)
+
+typedef struct
+{
+    uint32_t time; // milliseconds from event_time_ms()
+    uint32_t stream_id;
+    uint32_t length;
+    uint8_t conn; // http2 context id
+    uint8_t dir;
+    uint8_t type;
+    uint8_t flags;
+} trace_entry_t;
+
+#if TWO_TRACE_SIZE > 0
+#define TRACE_FRAME(dir, conn, type, flags, length, stream_id)                 \
+    trace_frame(TRACE_##dir, (conn), (type), (flags), (length), (stream_id))
+#define TRACE_HEADER(dir, conn, header)                                        \
+    trace_frame(TRACE_##dir,                                                   \
+                (conn),                                                        \
+                (header).type,                                                 \
+                (header).flags,                                                \
+                (header).length,                                               \
+                (header).stream_id)
+#else
+#define TRACE_FRAME(dir, conn, type, flags, length, stream_id)
+#define TRACE_HEADER(dir, conn, header)
+#endif
+
+// Callback for trace_dump(), receives one formatted entry
+// without the line terminator
+typedef void (*trace_dump_cb)(const char *line);
+
+// Add a frame to the trace, overwriting the oldest entry
+// if the buffer is full
+void trace_frame(uint8_t dir,
+                 uint8_t conn,
+                 uint8_t type,
+                 uint8_t flags,
+                 uint32_t length,
+                 uint32_t stream_id);
+
+// Format the entry as a log line. It returns the number of characters
+// that the line needs, as snprintf()
+int trace_format(const trace_entry_t *entry, char *buf, unsigned int maxlen);
+
+// Format the trace entries from the oldest to the newest and pass
+// them to the callback. If cb is NULL lines are written to the log output
+void trace_dump(trace_dump_cb cb);
+
+// Remove all entries
+void trace_reset(void);
+
+#endif /* TRACE_H */
@@ -21,6 +21,17 @@
 #define HTTP2_HEADER_TABLE_SIZE (4096)
 #endif
 
+/**
+ * Encode hpack strings with Huffman coding when the result is
+ * shorter than the raw string. Setting this value to 0 always sends
+ * raw strings, trading header block size for encoding time
+ */
+#ifdef CONFIG_HPACK_HUFFMAN
+#define HPACK_HUFFMAN (CONFIG_HPACK_HUFFMAN)
+#else
+#define HPACK_HUFFMAN (1)
+#endif
+
 /**
  * Set the initial number of concurrent streams allowed by
  * HTTP2. The current value cannot be larger than 1
@@ -50,6 +61,42 @@
 #define HTTP2_MAX_FRAME_SIZE (16384)
 #endif
 
+/**
+ * Set the maximum size of the receive flow control window. The
+ * window starts at HTTP2_INITIAL_WINDOW_SIZE and grows up to this
+ * value following the bandwidth-delay product of the connection,
+ * measured with PING round trips. Received DATA is discarded as it
+ * is read, so this does not alter the static memory used by
+ * the implementation, but it bounds the data the remote endpoint can
+ * have in flight towards the device.
+ */
+#ifdef CONFIG_HTTP2_MAX_WINDOW_SIZE
+#define HTTP2_MAX_WINDOW_SIZE (CONFIG_HTTP2_MAX_WINDOW_SIZE)
+#else
+#define HTTP2_MAX_WINDOW_SIZE (65535)
+#endif
+
+/**
+ * Set the time in milliseconds after which an idle connection is
+ * checked with a PING. This keeps NAT bindings alive and detects
+ * dead peers. Setting this value to 0 disables keepalive pings
+ */
+#ifdef CONFIG_HTTP2_PING_INTERVAL
+#define HTTP2_PING_INTERVAL (CONFIG_HTTP2_PING_INTERVAL)
+#else
+#define HTTP2_PING_INTERVAL (30000)
+#endif
+
+/**
+ * Set the maximum time in milliseconds to wait for the
+ * remote endpoint to reply to a PING before closing the connection
+ */
+#ifdef CONFIG_HTTP2_PING_TIMEOUT
+#define HTTP2_PING_TIMEOUT (CONFIG_HTTP2_PING_TIMEOUT)
+#else
+#define HTTP2_PING_TIMEOUT (5000)
+#endif
+
 /**
  * Set the maximum size in bytes for the received
  * header list. This memory is reserved in the stack
@@ -72,6 +119,48 @@
 #define HTTP2_SETTINGS_WAIT (300)
 #endif
 
+/**
+ * Set the maximum time in milliseconds for a new connection
+ * to send the HTTP/2 connection preface
+ */
+#ifdef CONFIG_HTTP2_PREFACE_TIMEOUT
+#define HTTP2_PREFACE_TIMEOUT (CONFIG_HTTP2_PREFACE_TIMEOUT)
+#else
+#define HTTP2_PREFACE_TIMEOUT (1000)
+#endif
+
+/**
+ * Set the maximum time in milliseconds to finish receiving
+ * a frame or a header block once it has started
+ */
+#ifdef CONFIG_HTTP2_HEADERS_TIMEOUT
+#define HTTP2_HEADERS_TIMEOUT (CONFIG_HTTP2_HEADERS_TIMEOUT)
+#else
+#define HTTP2_HEADERS_TIMEOUT (5000)
+#endif
+
+/**
+ * Set the maximum time in milliseconds a connection can stay
+ * open without streams. Keepalive PINGs do not open streams, so
+ * a non zero value also closes connections kept alive by them.
+ * Disabled (0) by default, idle connections stay open
+ */
+#ifdef CONFIG_HTTP2_IDLE_TIMEOUT
+#define HTTP2_IDLE_TIMEOUT (CONFIG_HTTP2_IDLE_TIMEOUT)
+#else
+#define HTTP2_IDLE_TIMEOUT (0)
+#endif
+
+/**
+ * Set the period in milliseconds of the connection timer. Idle,
+ * header and PING deadlines are checked with this resolution
+ */
+#ifdef CONFIG_HTTP2_TIMER_TICK
+#define HTTP2_TIMER_TICK (CONFIG_HTTP2_TIMER_TICK)
+#else
+#define HTTP2_TIMER_TICK (1000)
+#endif
+
 /**
  * Set the size for the read socket buffer. This effectively
  * limits the maximum frame size that can be received by the
@@ -122,9 +211,77 @@
  * memory used by the implementation
  */
 #ifdef CONFIG_HTTP2_MAX_CLIENTS
-#define EVENT_MAX_SOCKETS ((CONFIG_HTTP2_MAX_CLIENTS) + 1)
+#define HTTP2_MAX_CLIENTS (CONFIG_HTTP2_MAX_CLIENTS)
 #else
-#define EVENT_MAX_SOCKETS (3)
+#define HTTP2_MAX_CLIENTS (2)
+#endif
+
+/**
+ * Set the number of sockets reserved to refuse connections when
+ * all clients are in use or the accept rate is exceeded. Refused
+ * clients receive SETTINGS and a GOAWAY without processed streams,
+ * telling them to retry later, and the connection is closed.
+ * Setting this value to 0 closes extra connections silently
+ */
+#ifdef CONFIG_HTTP2_REFUSE_SOCKETS
+#define HTTP2_REFUSE_SOCKETS (CONFIG_HTTP2_REFUSE_SOCKETS)
+#else
+#define HTTP2_REFUSE_SOCKETS (1)
+#endif
+
+// one socket for the server
+#define EVENT_MAX_SOCKETS ((HTTP2_MAX_CLIENTS) + (HTTP2_REFUSE_SOCKETS) + 1)
+
+/**
+ * Set the backlog of pending connections for the server socket
+ */
+#ifdef CONFIG_TWO_LISTEN_BACKLOG
+#define EVENT_LISTEN_BACKLOG (CONFIG_TWO_LISTEN_BACKLOG)
+#endif
+
+/**
+ * Set the maximum number of connections accepted from the
+ * backlog on each event loop iteration
+ */
+#ifdef CONFIG_TWO_ACCEPT_BUDGET
+#define EVENT_ACCEPT_BUDGET (CONFIG_TWO_ACCEPT_BUDGET)
+#endif
+
+/**
+ * Set the number of buffered bytes that force a socket write
+ * before the end of the event loop iteration
+ */
+#ifdef CONFIG_TWO_WRITE_HIGH_WATER
+#define EVENT_WRITE_HIGH_WATER (CONFIG_TWO_WRITE_HIGH_WATER)
+#endif
+
+/**
+ * Set the number of buffered bytes below which a socket
+ * accepts new DATA frames again
+ */
+#ifdef CONFIG_TWO_WRITE_LOW_WATER
+#define EVENT_WRITE_LOW_WATER (CONFIG_TWO_WRITE_LOW_WATER)
+#endif
+
+/**
+ * Set the maximum rate of new connections per second. Connections
+ * over the rate are refused as when the server is full. Setting
+ * this value to 0 disables the limit
+ */
+#ifdef CONFIG_HTTP2_ACCEPT_RATE
+#define HTTP2_ACCEPT_RATE (CONFIG_HTTP2_ACCEPT_RATE)
+#else
+#define HTTP2_ACCEPT_RATE (0)
+#endif
+
+/**
+ * Set the number of connections that can be accepted at once
+ * over HTTP2_ACCEPT_RATE
+ */
+#ifdef CONFIG_HTTP2_ACCEPT_BURST
+#define HTTP2_ACCEPT_BURST (CONFIG_HTTP2_ACCEPT_BURST)
+#else
+#define HTTP2_ACCEPT_BURST (HTTP2_MAX_CLIENTS)
 #endif
 
 /**
@@ -140,6 +297,74 @@
 #define TWO_MAX_RESOURCES (4)
 #endif
 
+/**
+ * Set the number of pre-encoded response header blocks
+ * (:status and content-type) cached by the http2 module.
+ * One entry per resource content type is enough for
+ * the common 200 response.
+ *
+ * Changes in this value alter the total static memory used
+ * by the implementation.
+ */
+#ifdef CONFIG_HTTP2_HEADER_CACHE_SIZE
+#define HTTP2_HEADER_CACHE_SIZE (CONFIG_HTTP2_HEADER_CACHE_SIZE)
+#else
+#define HTTP2_HEADER_CACHE_SIZE (TWO_MAX_RESOURCES)
+#endif
+
+/**
+ * Set the number of stream buffers (of CONFIG_HTTP2_STREAM_BUF_SIZE
+ * bytes) shared by http2 clients. A buffer is only attached to a
+ * client while a stream is active, so this limits the number of
+ * concurrent active streams instead of the number of connections.
+ * New streams are refused when no buffer is available. The socket
+ * buffers and header table of each client are not pooled.
+ *
+ * Changes in this value alter the total static memory used
+ * by the implementation.
+ */
+#ifdef CONFIG_HTTP2_STREAM_BUF_POOL_SIZE
+#define HTTP2_STREAM_BUF_POOL_SIZE (CONFIG_HTTP2_STREAM_BUF_POOL_SIZE)
+#else
+#define HTTP2_STREAM_BUF_POOL_SIZE (HTTP2_MAX_CLIENTS)
+#endif
+
+/**
+ * Enable the metrics registry (see metrics.h). Counters are
+ * updated in the event loop, HTTP/2 and HPACK modules and can be
+ * served with a resource handler. Disabled by default
+ */
+#ifdef CONFIG_TWO_METRICS
+#define TWO_METRICS (CONFIG_TWO_METRICS)
+#else
+#define TWO_METRICS (0)
+#endif
+
+/**
+ * Set the number of routes (registered resources, in order of
+ * registration) with request phase histograms when metrics are
+ * enabled. Each route uses about 2.2 KB of static memory.
+ * Setting this value to 0 disables the phase histograms
+ */
+#ifdef CONFIG_TWO_METRICS_ROUTES
+#define TWO_METRICS_ROUTES (CONFIG_TWO_METRICS_ROUTES)
+#else
+#define TWO_METRICS_ROUTES (TWO_MAX_RESOURCES)
+#endif
+
+/**
+ * Set the number of entries in the frame trace (see trace.h). The
+ * last frames received and sent by the server are kept in memory
+ * and can be dumped on demand. Each entry uses 16 bytes of
+ * static memory, the value must be a power of 2. Setting this
+ * value to 0 disables the trace
+ */
+#ifdef CONFIG_TWO_TRACE_SIZE
+#define TWO_TRACE_SIZE (CONFIG_TWO_TRACE_SIZE)
+#else
+#define TWO_TRACE_SIZE (32)
+#endif
+
 /**
  * Event module log level (off by default)
  */
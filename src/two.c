@@ -8,10 +8,17 @@
 #include <assert.h>
 #include <strings.h>
 
+#ifndef CONTIKI
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "content_type.h"
 #include "event.h"
 #include "http.h"
 #include "http2.h"
+#include "metrics.h"
 
 #define LOG_MODULE LOG_MODULE_HTTP
 #include "logging.h"
@@ -25,11 +32,35 @@ typedef struct
     char *method;
     char *content_type;
     two_resource_handler_t handler;
+    two_resource_validator_t validator;
+    uint8_t variants;
 } two_resource_t;
 
+typedef struct
+{
+    two_resource_t *resource;
+    char *content_encoding;
+    const char *content;
+    unsigned int size;
+} two_variant_t;
+
 static two_resource_t server_resources[TWO_MAX_RESOURCES];
 static int server_resources_size = 0;
 
+static two_variant_t server_variants[TWO_MAX_VARIANTS];
+static int server_variants_size = 0;
+
+#ifndef CONTIKI
+typedef struct
+{
+    char path[TWO_MAX_PATH_SIZE];
+    char *directory;
+} two_directory_t;
+
+static two_directory_t server_directories[TWO_MAX_DIRECTORIES];
+static int server_directories_size = 0;
+#endif
+
 // Server event loop
 static event_loop_t loop;
 
@@ -109,11 +140,17 @@ static void on_client_close(event_sock_t *client)
 static event_sock_t *on_new_connection(event_sock_t *server)
 {
     event_sock_t *client = event_sock_create(server->loop);
-    if (event_accept(server, client) == 0) {
-        http2_new_client(client);
-    } else {
+    if (client == NULL) {
+        return NULL;
+    }
+
+    if (event_accept(server, client) < 0) {
+        // no more pending connections
         event_close(client, on_client_close);
+        return NULL;
     }
+
+    http2_new_client(client);
     return client;
 }
 
@@ -135,6 +172,225 @@ two_resource_t *find_resource(char *method, char *path)
     return NULL;
 }
 
+/*
+ * Get the value of the request header with the given name
+ * or NULL if not found
+ */
+char *http_get_header(http_request_t *req, char *name)
+{
+    for (unsigned int i = 0; i < req->headers_length; i++) {
+        if (strcmp(req->headers[i].name, name) == 0) {
+            return req->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Get the smallest variant of the resource accepted by the client
+ * or NULL if the identity representation must be used
+ */
+two_variant_t *find_variant(two_resource_t *resource, char *accept_encoding,
+                            unsigned int maxlen)
+{
+    two_variant_t *variant = NULL;
+
+    for (int i = 0; i < server_variants_size; i++) {
+        two_variant_t *v = &server_variants[i];
+        if (v->resource != resource || v->size > maxlen) {
+            continue;
+        }
+
+        if (http_accept_encoding_q(accept_encoding, v->content_encoding) <= 0) {
+            continue;
+        }
+
+        if (variant == NULL || v->size < variant->size) {
+            variant = v;
+        }
+    }
+    return variant;
+}
+
+/*
+ * Write the quoted entity tag given by the resource validator. Variants
+ * get the content coding appended to the tag so every representation
+ * has a different entity tag
+ *
+ * @return length of the entity tag or -1 if the validator did not provide
+ * one
+ */
+int resource_etag(two_resource_t *resource, char *method, char *path,
+                  two_variant_t *variant, char *etag)
+{
+    char tag[HTTP_MAX_ETAG_SIZE - 2];
+
+    memset(tag, 0, HTTP_MAX_ETAG_SIZE - 2);
+    int len = resource->validator(method, path, tag, HTTP_MAX_ETAG_SIZE - 3);
+    if (len <= 0 || len > HTTP_MAX_ETAG_SIZE - 3) {
+        return -1;
+    }
+
+    if (variant != NULL) {
+        len = snprintf(etag, HTTP_MAX_ETAG_SIZE, "\"%.*s-%s\"", len, tag,
+                       variant->content_encoding);
+    } else {
+        len = snprintf(etag, HTTP_MAX_ETAG_SIZE, "\"%.*s\"", len, tag);
+    }
+
+    // the tag does not fit
+    if (len >= HTTP_MAX_ETAG_SIZE) {
+        etag[0] = '\0';
+        return -1;
+    }
+    return len;
+}
+
+/*
+ * Write a quoted entity tag computed as the
+ * 32-bit FNV-1a hash of the response content
+ */
+int content_etag(char *content, int content_length, char *etag)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < content_length; i++) {
+        hash ^= (uint8_t)content[i];
+        hash *= 16777619u;
+    }
+
+    return snprintf(etag, HTTP_MAX_ETAG_SIZE, "\"%08lx\"",
+                    (unsigned long)hash);
+}
+
+/*
+ * Set a 304 response for a matching validator
+ */
+void http_not_modified(http_response_t *res)
+{
+    res->status           = 304;
+    res->content_type     = NULL;
+    res->content_encoding = NULL;
+    res->content_length   = 0;
+}
+
+#ifndef CONTIKI
+/*
+ * Get the registered directory for the given path and set
+ * relpath to the remaining path inside the directory
+ */
+two_directory_t *find_directory(char *path, char **relpath)
+{
+    for (int i = 0; i < server_directories_size; i++) {
+        two_directory_t *dir = &server_directories[i];
+        int len              = strlen(dir->path);
+
+        // keep the separator in the relative path
+        if (dir->path[len - 1] == '/') {
+            len--;
+        }
+
+        if (strncmp(dir->path, path, len) == 0 &&
+            (path[len] == '/' || path[len] == '\0')) {
+            *relpath = path + len;
+            return dir;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Open the file for the relative path inside the directory
+ * and prepare the response
+ *
+ * @return 0 if ok or the HTTP error code
+ */
+int http_open_file(two_directory_t *dir, char *relpath, http_response_t *res)
+{
+    // prevent access outside the directory
+    if (strstr(relpath, "..") != NULL) {
+        return 404;
+    }
+
+    char filepath[strlen(dir->directory) + strlen(relpath) +
+                  sizeof("/index.html")];
+    int len = sprintf(filepath, "%s%s", dir->directory, relpath);
+
+    // directories are served through their index
+    if (*relpath == '\0') {
+        strcpy(filepath + len, "/index.html");
+    } else if (filepath[len - 1] == '/') {
+        strcpy(filepath + len, "index.html");
+    }
+
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 404;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 404;
+    }
+
+    // content length is an int
+    if (st.st_size > (1u << 31) - 1) {
+        close(fd);
+        return 500;
+    }
+
+    res->fd             = fd;
+    res->status         = 200;
+    res->content_length = st.st_size;
+    res->content_type   = content_type_from_path(filepath);
+
+    // files use the modification time and size as validator
+    snprintf(res->etag, HTTP_MAX_ETAG_SIZE, "\"%lx-%lx\"",
+             (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+
+    return 0;
+}
+#endif
+
+/*
+ * Remove all the registered variants of the resource
+ */
+void remove_variants(two_resource_t *resource)
+{
+    int i = 0;
+    while (i < server_variants_size) {
+        if (server_variants[i].resource == resource) {
+            // move the last variant to the empty position
+            server_variants[i] = server_variants[--server_variants_size];
+            continue;
+        }
+        i++;
+    }
+    resource->variants = 0;
+}
+
+#ifndef CONTIKI
+/*
+ * Respond with the file for the relative path inside the directory
+ */
+void http_handle_file(http_request_t *req, http_response_t *res,
+                      two_directory_t *dir, char *relpath)
+{
+    int code = http_open_file(dir, relpath, res);
+    if (code != 0) {
+        http_error(res, code);
+        return;
+    }
+
+    char *if_none_match = http_get_header(req, "if-none-match");
+    if (if_none_match != NULL && http_etag_match(if_none_match, res->etag)) {
+        close(res->fd);
+        res->fd = -1;
+        http_not_modified(res);
+    }
+}
+#endif
+
 /***********************************************
  * HTTP (http.h) implementation methods
  ***********************************************/
@@ -176,6 +432,128 @@ int http_has_method_support(char *method)
     return 0;
 }
 
+/*
+ * Parse a quality value (see
+ * https://tools.ietf.org/html/rfc7231#section-5.3.1) and move the pointer
+ * after it
+ *
+ * @return the value in thousandths
+ */
+int parse_qvalue(char **str)
+{
+    char *ptr = *str;
+    int q     = 0;
+
+    if (*ptr == '1') {
+        q = 1000;
+    } else if (*ptr != '0') {
+        return 0;
+    }
+    ptr++;
+
+    if (*ptr == '.') {
+        ptr++;
+        for (int mult = 100; *ptr >= '0' && *ptr <= '9'; ptr++) {
+            q += (*ptr - '0') * mult;
+            mult /= 10;
+        }
+    }
+    *str = ptr;
+
+    return q > 1000 ? 1000 : q;
+}
+
+int http_accept_encoding_q(char *accept_encoding, char *content_encoding)
+{
+    int any_q                 = -1;
+    unsigned int encoding_len = strlen(content_encoding);
+
+    char *ptr = accept_encoding;
+    while (*ptr != '\0') {
+        // skip list separators
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == ',') {
+            ptr++;
+        }
+
+        // read the content coding
+        char *coding = ptr;
+        while (*ptr != '\0' && *ptr != ',' && *ptr != ';' && *ptr != ' ' &&
+               *ptr != '\t') {
+            ptr++;
+        }
+        unsigned int coding_len = ptr - coding;
+
+        // read parameters until the next list element
+        int q = 1000;
+        while (*ptr != '\0' && *ptr != ',') {
+            if (*ptr == ';') {
+                ptr++;
+                while (*ptr == ' ' || *ptr == '\t') {
+                    ptr++;
+                }
+                if ((*ptr == 'q' || *ptr == 'Q') && *(ptr + 1) == '=') {
+                    ptr += 2;
+                    q = parse_qvalue(&ptr);
+                }
+                continue;
+            }
+            ptr++;
+        }
+
+        if (coding_len == encoding_len &&
+            strncasecmp(coding, content_encoding, coding_len) == 0) {
+            return q;
+        }
+
+        if (coding_len == 1 && *coding == '*') {
+            any_q = q;
+        }
+    }
+    return any_q;
+}
+
+int http_etag_match(char *if_none_match, char *etag)
+{
+    // weak comparison ignores the weak indicator
+    if (strncmp(etag, "W/", 2) == 0) {
+        etag += 2;
+    }
+    unsigned int etag_len = strlen(etag);
+
+    char *tag = if_none_match;
+    while (*tag != '\0') {
+        // skip list separators
+        while (*tag == ' ' || *tag == '\t' || *tag == ',') {
+            tag++;
+        }
+
+        if (*tag == '*') {
+            return 1;
+        }
+
+        if (strncmp(tag, "W/", 2) == 0) {
+            tag += 2;
+        }
+
+        // entity tags must be quoted
+        if (*tag != '"') {
+            return 0;
+        }
+
+        char *end = index(tag + 1, '"');
+        if (end == NULL) {
+            return 0;
+        }
+
+        if ((unsigned)(end - tag + 1) == etag_len &&
+            strncmp(tag, etag, etag_len) == 0) {
+            return 1;
+        }
+        tag = end + 1;
+    }
+    return 0;
+}
+
 /**
  * Send an http error with the given code and message
  */
@@ -201,6 +579,13 @@ void http_handle_request(http_request_t *req, http_response_t *res,
     // the content
     assert(res->content != NULL);
 
+    // no validator and identity encoding by default
+    res->etag[0]          = '\0';
+    res->content_encoding = NULL;
+    res->vary             = NULL;
+    res->fd               = -1;
+    res->route            = -1;
+
     if (!http_has_method_support(req->method)) {
         http_error(res, 501);
         goto end;
@@ -213,27 +598,78 @@ void http_handle_request(http_request_t *req, http_response_t *res,
     // find callback for resource
     two_resource_t *uri_resource;
     if ((uri_resource = find_resource(req->method, path)) == NULL) {
+#ifndef CONTIKI
+        // look for a file in the registered directories
+        char *relpath;
+        two_directory_t *dir = find_directory(path, &relpath);
+        if (dir != NULL && strcmp(req->method, "GET") == 0) {
+            http_handle_file(req, res, dir, relpath);
+            goto end;
+        }
+#endif
         http_error(res, 404);
         goto end;
     }
 
+    res->route = uri_resource - server_resources;
+
+    // select a precompressed variant accepted by the client
+    two_variant_t *variant = NULL;
+    if (uri_resource->variants > 0) {
+        res->vary             = "accept-encoding";
+        char *accept_encoding = http_get_header(req, "accept-encoding");
+        if (accept_encoding != NULL) {
+            variant = find_variant(uri_resource, accept_encoding, maxlen);
+        }
+    }
+
+    // the resource validator allows to skip the handler if the client
+    // already has the current representation
+    char *if_none_match = http_get_header(req, "if-none-match");
+    if (uri_resource->validator != NULL &&
+        resource_etag(uri_resource, req->method, path, variant, res->etag) >
+          0 &&
+        if_none_match != NULL && http_etag_match(if_none_match, res->etag)) {
+        http_not_modified(res);
+        goto end;
+    }
+
     // clean response memory
     memset(res->content, 0, maxlen);
 
-    // call the resource handler
-    int content_length = 0;
-    if ((content_length = uri_resource->handler(req->method, path, res->content,
-                                                maxlen)) < 0) {
-        http_error(res, 500);
-        goto end;
+    if (variant != NULL) {
+        // variants are served as is
+        memcpy(res->content, variant->content, variant->size);
+        res->content_length   = variant->size;
+        res->content_encoding = variant->content_encoding;
+    } else {
+        // call the resource handler
+        METRICS_CLOCK(start);
+        int content_length =
+          uri_resource->handler(req->method, path, res->content, maxlen);
+        METRICS_LATENCY(start);
+        if (content_length < 0) {
+            http_error(res, 500);
+            goto end;
+        }
+        res->content_length = MIN((unsigned)content_length, maxlen);
     }
 
-    res->status         = 200;
-    res->content_length = MIN((unsigned)content_length, maxlen);
-    res->content_type   = uri_resource->content_type;
+    res->status       = 200;
+    res->content_type = uri_resource->content_type;
+
+    // fall back to an entity tag of the content
+    if (res->etag[0] == '\0') {
+        content_etag(res->content, res->content_length, res->etag);
+    }
+
+    // the body is discarded if the client already has it
+    if (if_none_match != NULL && http_etag_match(if_none_match, res->etag)) {
+        http_not_modified(res);
+    }
 
 end:
-    INFO("%s %s HTTP/2.0 - %d", req->method, req->path, res->status);
+    DEBUG("%s %s HTTP/2.0 - %d", req->method, req->path, res->status);
     DEBUG("Request");
     for (int i = 0; i < (signed)req->headers_length; i++) {
         DEBUG("%s: %s", req->headers[i].name, req->headers[i].value);
@@ -241,6 +677,8 @@ end:
     DEBUG("Response status %d", res->status);
     DEBUG("Content-Type: %s", res->content_type);
     DEBUG("Content-Length: %d", res->content_length);
+    DEBUG("Content-Encoding: %s", res->content_encoding);
+    DEBUG("ETag: %s", res->etag);
     DEBUG("%s", res->content);
 }
 
@@ -248,9 +686,9 @@ end:
  * Public methods
  ***********************************************/
 
-int two_server_start(unsigned int port)
+// Listen on the given port and run the event loop
+static int two_server_run(unsigned int port)
 {
-    event_loop_init(&loop);
     server = event_sock_create(&loop);
 
     int r = event_listen(server, port, on_new_connection);
@@ -259,11 +697,50 @@ int two_server_start(unsigned int port)
         return 1;
     }
     INFO("Starting HTTP/2 server in port %u", port);
+
+#ifndef CONTIKI
+    two_sockopts_t eff;
+    if (event_sock_getopts(server, &eff) == 0) {
+        INFO("nodelay: %d, fastopen: %d, defer_accept: %d, sndbuf: %d, "
+             "rcvbuf: %d, notsent_lowat: %d",
+             eff.nodelay,
+             eff.fastopen,
+             eff.defer_accept,
+             eff.sndbuf,
+             eff.rcvbuf,
+             eff.notsent_lowat);
+    }
+#endif
     event_loop(&loop);
 
     return 0;
 }
 
+int two_server_start(unsigned int port)
+{
+    event_loop_init(&loop);
+    return two_server_run(port);
+}
+
+#ifndef CONTIKI
+int two_server_start_sockopts(unsigned int port, const two_sockopts_t *opts)
+{
+    event_loop_init(&loop);
+    if (opts != NULL) {
+        event_loop_sockopts(&loop, opts);
+    }
+    return two_server_run(port);
+}
+
+int two_server_sockopts(two_sockopts_t *opts)
+{
+    if (server == NULL || server->state != EVENT_SOCK_LISTENING) {
+        return -1;
+    }
+    return event_sock_getopts(server, opts);
+}
+#endif
+
 void two_server_stop(void (*close_cb)())
 {
     global_close_cb = close_cb;
@@ -312,6 +789,8 @@ int two_register_resource(char *method, char *path, char *content_type,
             // If it does, replaces the resource
             res->content_type = ct;
             res->handler      = handler;
+            res->validator    = NULL;
+            remove_variants(res);
             return 0;
         }
     }
@@ -332,6 +811,122 @@ int two_register_resource(char *method, char *path, char *content_type,
     res->method       = http_get_method(method);
     res->content_type = ct;
     res->handler      = handler;
+    res->validator    = NULL;
+    res->variants     = 0;
+    METRICS_ROUTE(server_resources_size - 1, res->path);
+
+    return 0;
+}
+
+int two_register_validator(char *method, char *path,
+                           two_resource_validator_t validator)
+{
+    assert(method != NULL && path != NULL && validator != NULL);
+
+    two_resource_t *res = find_resource(method, path);
+    if (res == NULL) {
+        errno = EINVAL;
+        ERROR("Resource %s %s is not registered", method, path);
+        return -1;
+    }
+
+    res->validator = validator;
+    return 0;
+}
+
+int two_register_variant(char *method, char *path, char *content_encoding,
+                         const char *content, unsigned int size)
+{
+    assert(method != NULL && path != NULL && content_encoding != NULL &&
+           content != NULL);
+
+    two_resource_t *res = find_resource(method, path);
+    if (res == NULL) {
+        errno = EINVAL;
+        ERROR("Resource %s %s is not registered", method, path);
+        return -1;
+    }
+
+    char *ce = content_encoding_allowed(content_encoding);
+    if (ce == NULL) {
+        errno = EINVAL;
+        ERROR("Unsupported content-encoding: %s", content_encoding);
+        return -1;
+    }
+
+    if (size > HTTP2_STREAM_BUF_SIZE) {
+        errno = EINVAL;
+        ERROR("Variant size (%u) is larger than CONFIG_HTTP2_STREAM_BUF_SIZE",
+              size);
+        return -1;
+    }
+
+    // Checks if the variant already exists
+    two_variant_t *variant;
+    for (int i = 0; i < server_variants_size; i++) {
+        variant = &server_variants[i];
+        if (variant->resource == res && variant->content_encoding == ce) {
+            // If it does, replaces the content
+            variant->content = content;
+            variant->size    = size;
+            return 0;
+        }
+    }
+
+    // Checks if the list is full
+    if (server_variants_size >= TWO_MAX_VARIANTS) {
+        ERROR("Server variant limit (%d) reached. Try changing value for "
+              "CONFIG_TWO_MAX_VARIANTS",
+              TWO_MAX_VARIANTS);
+        return -1;
+    }
+
+    variant = &server_variants[server_variants_size++];
+
+    variant->resource         = res;
+    variant->content_encoding = ce;
+    variant->content          = content;
+    variant->size             = size;
+    res->variants++;
+
+    return 0;
+}
+
+#ifndef CONTIKI
+int two_register_directory(char *path, char *directory)
+{
+    assert(path != NULL && directory != NULL);
+    assert(strlen(path) < TWO_MAX_PATH_SIZE);
+
+    if (!is_valid_path(path)) {
+        errno = EINVAL;
+        ERROR("Path %s does not have a valid format", path);
+        return -1;
+    }
+
+    // Checks if the path already exists
+    two_directory_t *dir;
+    for (int i = 0; i < server_directories_size; i++) {
+        dir = &server_directories[i];
+        if (strncmp(dir->path, path, TWO_MAX_PATH_SIZE) == 0) {
+            // If it does, replaces the directory
+            dir->directory = directory;
+            return 0;
+        }
+    }
+
+    // Checks if the list is full
+    if (server_directories_size >= TWO_MAX_DIRECTORIES) {
+        ERROR("Server directory limit (%d) reached. Try changing value for "
+              "CONFIG_TWO_MAX_DIRECTORIES",
+              TWO_MAX_DIRECTORIES);
+        return -1;
+    }
+
+    dir = &server_directories[server_directories_size++];
+    strncpy(dir->path, path, TWO_MAX_PATH_SIZE);
+    dir->directory = directory;
 
     return 0;
 }
+#endif
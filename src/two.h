@@ -5,10 +5,24 @@
 #include "macros.h"
 #include "two-conf.h"
 
+#include "event.h"
+
 #ifndef TWO_MAX_RESOURCES
 #define TWO_MAX_RESOURCES (4)
 #endif
 
+#ifdef CONFIG_TWO_MAX_VARIANTS
+#define TWO_MAX_VARIANTS (CONFIG_TWO_MAX_VARIANTS)
+#else
+#define TWO_MAX_VARIANTS (2)
+#endif
+
+#ifdef CONFIG_TWO_MAX_DIRECTORIES
+#define TWO_MAX_DIRECTORIES (CONFIG_TWO_MAX_DIRECTORIES)
+#else
+#define TWO_MAX_DIRECTORIES (1)
+#endif
+
 #ifdef CONFIG_TWO_MAX_PATH_SIZE
 #define TWO_MAX_PATH_SIZE (CONFIG_TWO_MAX_PATH_SIZE)
 #else
@@ -20,6 +34,13 @@
 typedef int (*two_resource_handler_t)(char *method, char *uri, char *response,
                                       unsigned int maxlen);
 
+// Defines a resource validator method. It must write an opaque
+// entity tag for the current state of the resource (without quotes)
+// and return its length, or return -1 to fall back to an entity tag
+// computed from the response body
+typedef int (*two_resource_validator_t)(char *method, char *uri, char *etag,
+                                        unsigned int maxlen);
+
 /*
  * Given a port number, this function start a server
  *
@@ -30,6 +51,34 @@ typedef int (*two_resource_handler_t)(char *method, char *uri, char *response,
  */
 int two_server_start(unsigned int port);
 
+#ifndef CONTIKI
+// Socket options profile for the server. Fields set to 0 keep
+// the system default, see event_sockopts_t
+typedef event_sockopts_t two_sockopts_t;
+
+/*
+ * Start a server with the given socket options profile. If opts is
+ * NULL, only TCP_NODELAY is set
+ *
+ * @param    port       Port number
+ * @param    opts       Socket options for the server and its clients
+ *
+ * @return   0          Server was successfully performance
+ * @return   -1         An error occurred while the server was running
+ */
+int two_server_start_sockopts(unsigned int port, const two_sockopts_t *opts);
+
+/*
+ * Read the effective socket options of the running server. Values
+ * are reported by the system, so buffer sizes may differ from the
+ * requested ones
+ *
+ * @return  0           if ok
+ * @return  -1          if the server is not running
+ */
+int two_server_sockopts(two_sockopts_t *opts);
+#endif
+
 /**
  * Set callback to handle an http resource
  *
@@ -57,6 +106,69 @@ int two_server_start(unsigned int port);
 int two_register_resource(char *method, char *path, char *content_type,
                           two_resource_handler_t handler);
 
+/**
+ * Set a validator for an already registered resource
+ *
+ * Resources without a validator get an ETag computed from the response
+ * body, which saves the response DATA but still runs the handler. With a
+ * validator, requests with a matching If-None-Match header get a 304
+ * response without calling the resource handler.
+ *
+ * @param   method          HTTP method for the resource
+ * @param   path            Path of the registered resource
+ * @param   validator       Callback returning the entity tag of the resource
+ *
+ * @return  0           if ok
+ * @return  -1          if the resource is not registered
+ */
+int two_register_validator(char *method, char *path,
+                           two_resource_validator_t validator);
+
+/**
+ * Register a precompressed variant of an already registered resource
+ *
+ * Clients sending an Accept-Encoding header that accepts the content coding
+ * get the smallest accepted variant instead of calling the resource handler.
+ * Responses for resources with variants include a 'Vary: accept-encoding'
+ * header. The content is served as is, so it must remain valid while the
+ * server is running and its size cannot be larger than
+ * CONFIG_HTTP2_STREAM_BUF_SIZE.
+ *
+ * @param   method              HTTP method for the resource
+ * @param   path                Path of the registered resource
+ * @param   content_encoding    Content coding of the variant (e.g. "gzip")
+ * @param   content             Encoded representation of the resource
+ * @param   size                Size of the encoded representation
+ *
+ * @return  0           if ok
+ * @return  -1          if error
+ */
+int two_register_variant(char *method, char *path, char *content_encoding,
+                         const char *content, unsigned int size);
+
+#ifndef CONTIKI
+/**
+ * Serve the files of a local directory under the given path
+ *
+ * A GET request for <path>/<file> is answered with the contents of
+ * <directory>/<file>, and a request for a directory with its index.html.
+ * File contents are sent directly from the file to the socket, so the file
+ * size is not limited by the stream buffer. The content type is obtained
+ * from the file extension.
+ *
+ * Request paths with '..' are rejected.
+ *
+ * @param   path            Path prefix for the directory, it must start
+ * with '/'
+ * @param   directory       Local directory, the string must remain valid
+ * while the server is running
+ *
+ * @return  0           if ok
+ * @return  -1          if error
+ */
+int two_register_directory(char *path, char *directory);
+#endif
+
 /**
  * Stop the server as soon as possible
  *
@@ -0,0 +1,102 @@
+// Throughput benchmark for the circular buffer. Compares the power of two
+// mode (mask arithmetic and free running indices) against the generic mode
+// (wrapped indices) for buffer sizes from 512 bytes to 64 KiB
+//
+// Run with `make bench_cbuf`
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cbuf.h"
+
+// total bytes moved through the buffer on each run
+#ifndef BENCH_CBUF_TOTAL
+#define BENCH_CBUF_TOTAL (256 * 1024 * 1024)
+#endif
+
+#define BENCH_CBUF_MIN_SIZE (512)
+#define BENCH_CBUF_MAX_SIZE (64 * 1024)
+
+// chunk sizes similar to the server traffic: frame headers, control
+// frames and payloads
+static const int chunks[] = { 9, 17, 45, 100, 256, 9, 1000, 13 };
+#define CHUNKS (sizeof(chunks) / sizeof(chunks[0]))
+
+static uint8_t memory[BENCH_CBUF_MAX_SIZE];
+static uint8_t src[BENCH_CBUF_MAX_SIZE];
+static uint8_t dst[BENCH_CBUF_MAX_SIZE];
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// push chunks until the buffer is full, then peek and pop them as
+// the event loop does with the socket buffers. Returns MB/s
+static double bench(int size, int pow2)
+{
+    cbuf_t cbuf;
+    cbuf_init(&cbuf, memory, size);
+
+    // force the generic mode
+    if (!pow2) {
+        cbuf.mask = 0;
+    }
+
+    long moved     = 0;
+    unsigned int c = 0;
+    double start   = now();
+    while (moved < BENCH_CBUF_TOTAL) {
+        // fill
+        for (;;) {
+            int len = chunks[c++ % CHUNKS];
+            if (len > size / 2) {
+                len = size / 2;
+            }
+            if (cbuf_push(&cbuf, src, len) < len) {
+                break;
+            }
+        }
+
+        // drain half the buffer, as with partial writes
+        int len = cbuf_len(&cbuf) / 2;
+        cbuf_peek(&cbuf, dst, len);
+        moved += cbuf_pop(&cbuf, NULL, len);
+    }
+    double elapsed = now() - start;
+
+    // prevent the copies from being optimized away
+    if (dst[0] != src[0]) {
+        return 0;
+    }
+
+    return moved / elapsed / 1e6;
+}
+
+int main(void)
+{
+    for (int i = 0; i < BENCH_CBUF_MAX_SIZE; i++) {
+        src[i] = (uint8_t)i;
+    }
+
+    printf("%8s %14s %14s %8s\n",
+           "size",
+           "generic MB/s",
+           "pow2 MB/s",
+           "ratio");
+    for (int size = BENCH_CBUF_MIN_SIZE; size <= BENCH_CBUF_MAX_SIZE;
+         size *= 2) {
+        double generic = bench(size, 0);
+        double pow2    = bench(size, 1);
+        printf("%8d %14.1f %14.1f %8.2f\n",
+               size,
+               generic,
+               pow2,
+               generic > 0 ? pow2 / generic : 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+// Header compression benchmark. Encodes and decodes request corpora (a
+// browser page load, curl requests and IoT clients) with dynamic table
+// sizes of 0, 512 and 4096 bytes, reporting the time and encoded size per
+// header and the compression ratio over the raw name and value strings.
+//
+// Huffman coding is a compile time option (CONFIG_HPACK_HUFFMAN), so the
+// benchmark is built twice and `make bench_hpack` runs both binaries
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "header_list.h"
+#include "hpack/hpack.h"
+
+// times each corpus is replayed, every replay starts with empty tables
+// as a new connection does
+#ifndef BENCH_HPACK_SESSIONS
+#define BENCH_HPACK_SESSIONS (20000)
+#endif
+
+#define BENCH_HPACK_BLOCK_SIZE (512)
+#define BENCH_HPACK_MAX_REQUESTS (8)
+
+typedef struct
+{
+    const char *name;
+    const char *value;
+} bench_header_t;
+
+typedef struct
+{
+    const char *name;
+    const bench_header_t *requests[BENCH_HPACK_MAX_REQUESTS + 1];
+} bench_corpus_t;
+
+// Browser loading a page and its resources. User agents are cut to fit
+// HPACK_HEADER_VALUE_LEN
+static const bench_header_t browser_page[] = {
+    { ":method", "GET" },
+    { ":scheme", "https" },
+    { ":authority", "www.example.com" },
+    { ":path", "/" },
+    { "user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Firefox/118.0" },
+    { "accept", "text/html,application/xhtml+xml,*/*;q=0.8" },
+    { "accept-language", "en-US,en;q=0.5" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "cookie", "session=8f2a61c0b5e94d7e" },
+    { NULL, NULL }
+};
+
+static const bench_header_t browser_css[] = {
+    { ":method", "GET" },
+    { ":scheme", "https" },
+    { ":authority", "www.example.com" },
+    { ":path", "/css/style.css" },
+    { "user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Firefox/118.0" },
+    { "accept", "text/css,*/*;q=0.1" },
+    { "accept-language", "en-US,en;q=0.5" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "referer", "https://www.example.com/" },
+    { "cookie", "session=8f2a61c0b5e94d7e" },
+    { NULL, NULL }
+};
+
+static const bench_header_t browser_js[] = {
+    { ":method", "GET" },
+    { ":scheme", "https" },
+    { ":authority", "www.example.com" },
+    { ":path", "/js/app.js" },
+    { "user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Firefox/118.0" },
+    { "accept", "*/*" },
+    { "accept-language", "en-US,en;q=0.5" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "referer", "https://www.example.com/" },
+    { "cookie", "session=8f2a61c0b5e94d7e" },
+    { NULL, NULL }
+};
+
+static const bench_header_t browser_image[] = {
+    { ":method", "GET" },
+    { ":scheme", "https" },
+    { ":authority", "www.example.com" },
+    { ":path", "/img/logo.png" },
+    { "user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Firefox/118.0" },
+    { "accept", "image/avif,image/webp,*/*" },
+    { "accept-language", "en-US,en;q=0.5" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "referer", "https://www.example.com/" },
+    { "cookie", "session=8f2a61c0b5e94d7e" },
+    { NULL, NULL }
+};
+
+static const bench_header_t browser_favicon[] = {
+    { ":method", "GET" },
+    { ":scheme", "https" },
+    { ":authority", "www.example.com" },
+    { ":path", "/favicon.ico" },
+    { "user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Firefox/118.0" },
+    { "accept", "image/avif,image/webp,*/*" },
+    { "accept-language", "en-US,en;q=0.5" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "referer", "https://www.example.com/" },
+    { "cookie", "session=8f2a61c0b5e94d7e" },
+    { NULL, NULL }
+};
+
+// curl requests, minimal headers with a changing path
+static const bench_header_t curl_get_1[] = {
+    { ":method", "GET" },       { ":scheme", "http" },
+    { ":authority", "localhost:8888" },
+    { ":path", "/" },           { "user-agent", "curl/7.68.0" },
+    { "accept", "*/*" },        { NULL, NULL }
+};
+
+static const bench_header_t curl_get_2[] = {
+    { ":method", "GET" },       { ":scheme", "http" },
+    { ":authority", "localhost:8888" },
+    { ":path", "/index.html" }, { "user-agent", "curl/7.68.0" },
+    { "accept", "*/*" },        { NULL, NULL }
+};
+
+static const bench_header_t curl_post[] = {
+    { ":method", "POST" },
+    { ":scheme", "http" },
+    { ":authority", "localhost:8888" },
+    { ":path", "/api/items" },
+    { "user-agent", "curl/7.68.0" },
+    { "accept", "*/*" },
+    { "content-type", "application/json" },
+    { "content-length", "27" },
+    { NULL, NULL }
+};
+
+static const bench_header_t curl_get_3[] = {
+    { ":method", "GET" },       { ":scheme", "http" },
+    { ":authority", "localhost:8888" },
+    { ":path", "/api/items/1" }, { "user-agent", "curl/7.68.0" },
+    { "accept", "*/*" },        { NULL, NULL }
+};
+
+// IoT clients reporting readings and polling their configuration
+static const bench_header_t iot_report_1[] = {
+    { ":method", "POST" },
+    { ":scheme", "http" },
+    { ":authority", "gw.local" },
+    { ":path", "/sensors/12/temp" },
+    { "user-agent", "node/0.3" },
+    { "authorization", "Bearer a1b2c3d4e5f6" },
+    { "content-type", "application/cbor" },
+    { "content-length", "9" },
+    { NULL, NULL }
+};
+
+static const bench_header_t iot_report_2[] = {
+    { ":method", "POST" },
+    { ":scheme", "http" },
+    { ":authority", "gw.local" },
+    { ":path", "/sensors/12/hum" },
+    { "user-agent", "node/0.3" },
+    { "authorization", "Bearer a1b2c3d4e5f6" },
+    { "content-type", "application/cbor" },
+    { "content-length", "5" },
+    { NULL, NULL }
+};
+
+static const bench_header_t iot_config[] = {
+    { ":method", "GET" },
+    { ":scheme", "http" },
+    { ":authority", "gw.local" },
+    { ":path", "/nodes/12/config" },
+    { "user-agent", "node/0.3" },
+    { "authorization", "Bearer a1b2c3d4e5f6" },
+    { "accept", "application/cbor" },
+    { "if-none-match", "\"3f9c\"" },
+    { NULL, NULL }
+};
+
+static const bench_corpus_t corpora[] = {
+    { "browser",
+      { browser_page, browser_css, browser_js, browser_image, browser_favicon,
+        NULL } },
+    { "curl", { curl_get_1, curl_get_2, curl_post, curl_get_3, NULL } },
+    { "iot",
+      { iot_report_1, iot_report_2, iot_config, iot_report_1, iot_report_2,
+        NULL } },
+};
+#define CORPORA (sizeof(corpora) / sizeof(corpora[0]))
+
+static const uint32_t table_sizes[] = { 0, 512, 4096 };
+#define TABLE_SIZES (sizeof(table_sizes) / sizeof(table_sizes[0]))
+
+static header_list_t requests[BENCH_HPACK_MAX_REQUESTS];
+static header_list_t decoded;
+static uint8_t blocks[BENCH_HPACK_MAX_REQUESTS][BENCH_HPACK_BLOCK_SIZE];
+static int block_sizes[BENCH_HPACK_MAX_REQUESTS];
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fill the header lists for the corpus. Returns the number of requests
+// and stores the total headers and raw bytes of one replay
+static int load(const bench_corpus_t *corpus, int *headers, int *raw)
+{
+    int r;
+    *headers = 0;
+    *raw     = 0;
+    for (r = 0; corpus->requests[r] != NULL; r++) {
+        header_list_reset(&requests[r]);
+        for (const bench_header_t *h = corpus->requests[r]; h->name != NULL;
+             h++) {
+            if (header_list_add(&requests[r], h->name, h->value) < 0) {
+                return -1;
+            }
+            *headers += 1;
+            *raw += strlen(h->name) + strlen(h->value);
+        }
+    }
+    return r;
+}
+
+// replay the corpus through the encoder. Returns the elapsed time,
+// the encoded blocks are kept for the decoder
+static double encode(int nreq, uint32_t table_size, int *encoded)
+{
+    hpack_dynamic_table_t table;
+
+    *encoded     = 0;
+    double start = now();
+    for (int s = 0; s < BENCH_HPACK_SESSIONS; s++) {
+        hpack_init(&table, table_size);
+        for (int r = 0; r < nreq; r++) {
+            block_sizes[r] = hpack_encode(
+              &table, &requests[r], blocks[r], BENCH_HPACK_BLOCK_SIZE);
+            if (block_sizes[r] < 0) {
+                return -1;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    for (int r = 0; r < nreq; r++) {
+        *encoded += block_sizes[r];
+    }
+    return elapsed;
+}
+
+// replay the encoded blocks through the decoder. Returns the elapsed time
+static double decode(int nreq, uint32_t table_size)
+{
+    hpack_dynamic_table_t table;
+
+    double start = now();
+    for (int s = 0; s < BENCH_HPACK_SESSIONS; s++) {
+        hpack_init(&table, table_size);
+        for (int r = 0; r < nreq; r++) {
+            header_list_reset(&decoded);
+            if (hpack_decode(&table, blocks[r], block_sizes[r], &decoded) < 0 ||
+                header_list_count(&decoded) != header_list_count(&requests[r])) {
+                return -1;
+            }
+        }
+    }
+    return now() - start;
+}
+
+int main(void)
+{
+    printf("%-8s %6s %8s %12s %12s %10s %7s\n",
+           "corpus",
+           "table",
+           "huffman",
+           "enc ns/hdr",
+           "dec ns/hdr",
+           "bytes/hdr",
+           "ratio");
+
+    for (unsigned int c = 0; c < CORPORA; c++) {
+        int headers, raw;
+        int nreq = load(&corpora[c], &headers, &raw);
+        if (nreq < 0) {
+            fprintf(stderr, "%s: header list too small\n", corpora[c].name);
+            return 1;
+        }
+
+        for (unsigned int t = 0; t < TABLE_SIZES; t++) {
+            int encoded;
+            double enc = encode(nreq, table_sizes[t], &encoded);
+            double dec = enc < 0 ? -1 : decode(nreq, table_sizes[t]);
+            if (enc < 0 || dec < 0) {
+                fprintf(stderr,
+                        "%s: %s failed with table size %u\n",
+                        corpora[c].name,
+                        enc < 0 ? "encoding" : "decoding",
+                        (unsigned int)table_sizes[t]);
+                return 1;
+            }
+
+            double total = (double)headers * BENCH_HPACK_SESSIONS;
+            printf("%-8s %6u %8s %12.1f %12.1f %10.2f %7.3f\n",
+                   corpora[c].name,
+                   (unsigned int)table_sizes[t],
+                   HPACK_HUFFMAN ? "on" : "off",
+                   enc * 1e9 / total,
+                   dec * 1e9 / total,
+                   (double)encoded / headers,
+                   (double)encoded / raw);
+        }
+    }
+
+    return 0;
+}
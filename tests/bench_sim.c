@@ -0,0 +1,546 @@
+// Deterministic simulation of HTTP/2 clients against the server
+//
+// The server runs unchanged on the simulated network of sim.c, where the
+// clock moves BENCH_SIM_TICK_US on every event loop iteration. Each scenario
+// starts groups of clients with a behaviour (request path, requests per
+// connection, think time, read rate and flow control window) and runs for a
+// fixed virtual time. For each group it reports throughput, latency, errors,
+// refused connections and the fairness between its clients (Jain's index over
+// the bytes received), followed by the memory high-water marks of the
+// server. Results only depend on the scenarios and the seed, so changes to
+// the scheduling or flow control can be compared between runs
+//
+// Run with `make bench_sim`, or `build/test/bench_sim <seed>`
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "buffer.h"
+#include "frames.h"
+#include "header_list.h"
+#include "hpack/hpack.h"
+#include "metrics.h"
+#include "sim.h"
+#include "two.h"
+
+// virtual time of a loop iteration
+#ifndef BENCH_SIM_TICK_US
+#define BENCH_SIM_TICK_US (50)
+#endif
+
+// wait after a refused connection
+#define BENCH_SIM_BACKOFF_MS (5)
+
+#define BENCH_SIM_PORT        (8888)
+#define BENCH_SIM_MAX_CLIENTS (32)
+#define BENCH_SIM_MAX_GROUPS  (3)
+#define BENCH_SIM_BUF_SIZE    (16384 + 9)
+#define BENCH_SIM_FILE_SIZE   (64 * 1024)
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+typedef struct
+{
+    const char *name;
+    const char *path;
+    int requests;          // requests per connection
+    unsigned int think_ms; // pause before the next connection
+    int read_rate;         // bytes read per tick, 0 reads all
+    uint32_t window;       // initial stream window
+    int window_rate;       // window returned per tick, 0 returns all
+} behaviour_t;
+
+static const behaviour_t fast  = { "fast", "/", 10, 10, 0, 65535, 0 };
+static const behaviour_t large = {
+    "large", "/files/big.bin", 4, 10, 0, 65535, 0
+};
+static const behaviour_t slow = {
+    "slow", "/files/big.bin", 4, 10, 64, 65535, 0
+};
+static const behaviour_t starve = {
+    "starve", "/files/big.bin", 4, 10, 0, 4096, 16
+};
+static const behaviour_t burst = { "burst", "/", 4, 200, 0, 65535, 0 };
+
+// random sessions pick one of these
+static const behaviour_t *mixed[] = { &fast, &large, &slow, &starve };
+#define MIXED (sizeof(mixed) / sizeof(mixed[0]))
+
+typedef struct
+{
+    const behaviour_t *behaviour; // NULL picks a random one per connection
+    int clients;
+} group_t;
+
+typedef struct
+{
+    const char *name;
+    unsigned int duration_ms;
+    group_t groups[BENCH_SIM_MAX_GROUPS];
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "steady", 2000, { { &fast, 8 } } },
+    { "burst", 2000, { { &burst, 24 } } },
+    { "slow", 2000, { { &large, 4 }, { &slow, 4 } } },
+    { "starve", 2000, { { &large, 4 }, { &starve, 4 } } },
+    { "random", 2000, { { NULL, 16 } } },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct
+{
+    int group;
+    const behaviour_t *b;
+
+    sim_conn_t *conn;
+    uint64_t wake_us;
+    int requests_left;
+    int completed; // requests completed on the connection
+
+    uint32_t stream_id;
+    int inflight;
+    uint64_t start_us;
+
+    // received DATA not yet returned to the window
+    int owed;
+
+    hpack_dynamic_table_t encoder;
+    uint8_t buf[BENCH_SIM_BUF_SIZE];
+    int buflen;
+
+    uint64_t bytes; // DATA received
+} client_t;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t errors;
+    uint32_t refused;
+    uint64_t bytes;
+    metrics_hist_t latency;
+} group_stats_t;
+
+static client_t clients[BENCH_SIM_MAX_CLIENTS];
+static int nclients;
+static group_stats_t groups[BENCH_SIM_MAX_GROUPS];
+
+static const scenario_t *scenario;
+static uint64_t end_us;
+static int stopping;
+static uint32_t rand_state;
+
+static char directory[] = "/tmp/two-sim-XXXXXX";
+static char file[sizeof(directory) + 16];
+
+// xorshift32, deterministic across platforms
+static uint32_t next_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static int send_frame(client_t *c,
+                      uint8_t type,
+                      uint8_t flags,
+                      uint32_t stream_id,
+                      uint8_t *payload,
+                      int len)
+{
+    uint8_t frame[9 + 64];
+    frame_header_t header = {
+        .length = len, .type = type, .flags = flags, .stream_id = stream_id
+    };
+
+    frame_header_to_bytes(&header, frame);
+    if (sim_conn_write(c->conn, frame, 9) < 9 ||
+        (len > 0 && sim_conn_write(c->conn, payload, len) < len)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int send_window_update(client_t *c, uint32_t stream_id, int increment)
+{
+    uint8_t payload[4];
+    buffer_put_u31(payload, increment);
+    return send_frame(c, FRAME_WINDOW_UPDATE_TYPE, 0, stream_id, payload, 4);
+}
+
+static int send_request(client_t *c)
+{
+    header_list_t headers;
+    uint8_t block[64];
+
+    header_list_reset(&headers);
+    header_list_add(&headers, ":method", "GET");
+    header_list_add(&headers, ":scheme", "http");
+    header_list_add(&headers, ":path", c->b->path);
+    header_list_add(&headers, ":authority", "localhost");
+
+    int len = hpack_encode(&c->encoder, &headers, block, sizeof(block));
+    if (len < 0) {
+        return -1;
+    }
+
+    c->stream_id += 2;
+    c->inflight = 1;
+    c->start_us = sim_time_us();
+    return send_frame(c,
+                      FRAME_HEADERS_TYPE,
+                      FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                      c->stream_id,
+                      block,
+                      len);
+}
+
+static void session_end(client_t *c)
+{
+    // requests in flight are lost
+    groups[c->group].errors += c->inflight;
+    c->inflight = 0;
+
+    sim_conn_close(c->conn);
+    c->conn    = NULL;
+    c->wake_us = sim_time_us() + c->b->think_ms * 1000;
+}
+
+static int session_start(client_t *c)
+{
+    const behaviour_t *b = scenario->groups[c->group].behaviour;
+    c->requests_left     = b != NULL ? b->requests : 1 + (int)(next_rand() % 10);
+    c->b                 = b != NULL ? b : mixed[next_rand() % MIXED];
+
+    c->conn = sim_conn_open();
+    if (c->conn == NULL) {
+        groups[c->group].refused++;
+        c->wake_us = sim_time_us() + BENCH_SIM_BACKOFF_MS * 1000;
+        return -1;
+    }
+
+    c->stream_id = (uint32_t)-1;
+    c->completed = 0;
+    c->owed      = 0;
+    c->buflen    = 0;
+    hpack_init(&c->encoder, HPACK_MAX_DYNAMIC_TABLE_SIZE);
+
+    uint8_t settings[6];
+    buffer_put_u16(settings, 0x4); // INITIAL_WINDOW_SIZE
+    buffer_put_u32(settings + 2, c->b->window);
+
+    if (sim_conn_write(c->conn, (uint8_t *)HTTP2_PREFACE, 24) < 24 ||
+        send_frame(c, FRAME_SETTINGS_TYPE, 0, 0, settings, 6) < 0 ||
+        (c->b->window > 65535 &&
+         send_window_update(c, 0, c->b->window - 65535) < 0) ||
+        send_request(c) < 0) {
+        session_end(c);
+        return -1;
+    }
+    return 0;
+}
+
+static int complete(client_t *c, uint32_t stream_id, int error)
+{
+    if (!c->inflight || stream_id != c->stream_id) {
+        return 0;
+    }
+
+    group_stats_t *g = &groups[c->group];
+    metrics_hist_add(&g->latency, (uint32_t)(sim_time_us() - c->start_us));
+    g->requests++;
+    g->errors += error;
+    c->inflight = 0;
+    c->completed++;
+
+    if (--c->requests_left > 0) {
+        return send_request(c);
+    }
+    return -1;
+}
+
+static int handle_frame(client_t *c, frame_header_t *header, uint8_t *payload)
+{
+    switch (header->type) {
+        case FRAME_SETTINGS_TYPE:
+            if (header->flags & FRAME_FLAGS_ACK) {
+                return 0;
+            }
+            return send_frame(
+              c, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK, 0, NULL, 0);
+        case FRAME_PING_TYPE:
+            if (header->flags & FRAME_FLAGS_ACK) {
+                return 0;
+            }
+            return send_frame(
+              c, FRAME_PING_TYPE, FRAME_FLAGS_ACK, 0, payload, 8);
+        case FRAME_HEADERS_TYPE:
+            if (header->flags & FRAME_FLAGS_END_STREAM) {
+                return complete(c, header->stream_id, 0);
+            }
+            return 0;
+        case FRAME_DATA_TYPE:
+            c->bytes += header->length;
+            groups[c->group].bytes += header->length;
+            c->owed += header->length;
+            if (header->flags & FRAME_FLAGS_END_STREAM) {
+                return complete(c, header->stream_id, 0);
+            }
+            return 0;
+        case FRAME_RST_STREAM_TYPE:
+            return complete(c, header->stream_id, 1);
+        case FRAME_GOAWAY_TYPE:
+            // the server is full if it closes before any request
+            if (c->completed == 0) {
+                groups[c->group].refused++;
+                c->inflight = 0;
+            }
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+static int client_read(client_t *c)
+{
+    int len = BENCH_SIM_BUF_SIZE - c->buflen;
+    if (c->b->read_rate > 0 && c->b->read_rate < len) {
+        len = c->b->read_rate;
+    }
+    c->buflen += sim_conn_read(c->conn, c->buf + c->buflen, len);
+
+    int offset = 0;
+    while (c->buflen - offset >= 9) {
+        frame_header_t header;
+        frame_parse_header(&header, c->buf + offset, 9);
+        if (header.length > BENCH_SIM_BUF_SIZE - 9) {
+            return -1;
+        }
+        if (c->buflen - offset < 9 + (int)header.length) {
+            break;
+        }
+        if (handle_frame(c, &header, c->buf + offset + 9) < 0) {
+            return -1;
+        }
+        offset += 9 + header.length;
+    }
+
+    memmove(c->buf, c->buf + offset, c->buflen - offset);
+    c->buflen -= offset;
+    return 0;
+}
+
+// return the window for the received DATA
+static int client_window(client_t *c)
+{
+    int grant = c->owed;
+    if (c->b->window_rate > 0 && c->b->window_rate < grant) {
+        grant = c->b->window_rate;
+    }
+    if (grant == 0) {
+        return 0;
+    }
+
+    c->owed -= grant;
+    if (send_window_update(c, 0, grant) < 0 ||
+        (c->inflight && send_window_update(c, c->stream_id, grant) < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void client_step(client_t *c)
+{
+    if (c->conn == NULL) {
+        if (sim_time_us() < c->wake_us || session_start(c) < 0) {
+            return;
+        }
+    }
+
+    if (client_read(c) < 0 || client_window(c) < 0 ||
+        sim_conn_ended(c->conn)) {
+        session_end(c);
+    }
+}
+
+static void tick(void)
+{
+    if (stopping) {
+        return;
+    }
+
+    if (sim_time_us() >= end_us) {
+        // requests in flight at the end are not counted
+        for (int i = 0; i < nclients; i++) {
+            if (clients[i].conn != NULL) {
+                clients[i].inflight = 0;
+                session_end(&clients[i]);
+            }
+        }
+        stopping = 1;
+        two_server_stop(NULL);
+        return;
+    }
+
+    for (int i = 0; i < nclients; i++) {
+        client_step(&clients[i]);
+    }
+}
+
+static int hello(char *method, char *uri, char *response, unsigned int maxlen)
+{
+    (void)method;
+    (void)uri;
+    return snprintf(response, maxlen, "Hello, World!!!\n");
+}
+
+// index of fairness between 1/n and 1 (all clients got the same bytes)
+static double jain(int group)
+{
+    double sum = 0, squares = 0;
+    int n = 0;
+    for (int i = 0; i < nclients; i++) {
+        if (clients[i].group == group) {
+            sum += clients[i].bytes;
+            squares += (double)clients[i].bytes * clients[i].bytes;
+            n++;
+        }
+    }
+    return squares > 0 ? sum * sum / (n * squares) : 1;
+}
+
+static void run(const scenario_t *s, uint32_t seed)
+{
+    scenario   = s;
+    rand_state = seed;
+    end_us     = (uint64_t)s->duration_ms * 1000;
+    stopping   = 0;
+    nclients   = 0;
+    memset(groups, 0, sizeof(groups));
+    memset(clients, 0, sizeof(clients));
+
+    for (int g = 0; g < BENCH_SIM_MAX_GROUPS; g++) {
+        for (int i = 0; i < s->groups[g].clients; i++) {
+            clients[nclients].group = g;
+            // spread the first connections over the first millisecond
+            clients[nclients].wake_us = next_rand() % 1000;
+            nclients++;
+        }
+    }
+
+    metrics_reset();
+    sim_init(BENCH_SIM_TICK_US, tick);
+    two_server_start(BENCH_SIM_PORT);
+
+    double seconds = s->duration_ms / 1000.0;
+    for (int g = 0; g < BENCH_SIM_MAX_GROUPS && s->groups[g].clients > 0;
+         g++) {
+        group_stats_t *st = &groups[g];
+        const behaviour_t *b = s->groups[g].behaviour;
+        printf("%-8s %-7s %7d %8u %9.1f %9.1f %7.2f %7.2f %6u %7u %8.3f\n",
+               s->name,
+               b != NULL ? b->name : "mixed",
+               s->groups[g].clients,
+               st->requests,
+               st->requests / seconds,
+               st->bytes / seconds / 1024,
+               metrics_hist_quantile(&st->latency, 500) / 1000.0,
+               metrics_hist_quantile(&st->latency, 990) / 1000.0,
+               st->errors,
+               st->refused,
+               jain(g));
+    }
+}
+
+static int create_file(void)
+{
+    if (mkdtemp(directory) == NULL) {
+        return -1;
+    }
+    snprintf(file, sizeof(file), "%s/big.bin", directory);
+
+    FILE *f = fopen(file, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < BENCH_SIM_FILE_SIZE; i++) {
+        fputc('a' + i % 26, f);
+    }
+    fclose(f);
+
+    // the entity tag depends on the modification time
+    struct utimbuf times = { 1000000000, 1000000000 };
+    return utime(file, &times);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    if (seed == 0) {
+        seed = 1;
+    }
+
+    if (create_file() < 0) {
+        perror("failed to create the response file");
+        return 1;
+    }
+    two_register_resource("GET", "/", "text/plain", hello);
+    two_register_directory("/files", directory);
+
+    printf("%-8s %-7s %7s %8s %9s %9s %7s %7s %6s %7s %8s\n",
+           "scenario",
+           "group",
+           "clients",
+           "requests",
+           "req/s",
+           "KiB/s",
+           "p50 ms",
+           "p99 ms",
+           "errors",
+           "refused",
+           "fairness");
+
+    sim_stats_t totals[SCENARIOS];
+    uint32_t buffers[SCENARIOS][3];
+
+    clock_t start = clock();
+    for (unsigned int i = 0; i < SCENARIOS; i++) {
+        run(&scenarios[i], seed);
+        totals[i]     = *sim_stats();
+        buffers[i][0] = metrics.counters[METRICS_READ_BUF_MAX];
+        buffers[i][1] = metrics.counters[METRICS_WRITE_BUF_MAX];
+        buffers[i][2] = metrics.counters[METRICS_WRITE_OPS_MAX];
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("\n%-8s %10s %11s %11s %10s %9s %12s\n",
+           "scenario",
+           "iterations",
+           "connections",
+           "read buffer",
+           "write buf",
+           "write ops",
+           "unread bytes");
+    for (unsigned int i = 0; i < SCENARIOS; i++) {
+        printf("%-8s %10lu %11u %11u %10u %9u %12u\n",
+               scenarios[i].name,
+               (unsigned long)totals[i].ticks,
+               totals[i].conns_max,
+               buffers[i][0],
+               buffers[i][1],
+               buffers[i][2],
+               totals[i].unread_max);
+    }
+    printf("\nseed %lu, tick %d us, %.2f s of cpu time\n",
+           (unsigned long)seed,
+           BENCH_SIM_TICK_US,
+           elapsed);
+
+    unlink(file);
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,378 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static sim_conn_t conns[SIM_MAX_CONNS];
+static sim_stats_t stats;
+
+static sim_tick_cb tick_cb;
+static unsigned int tick_us;
+static uint64_t now_us;
+
+static int listening;
+static int backlog;
+static uint32_t seq;
+
+// get the open connection for the descriptor or NULL
+static sim_conn_t *conn_get(int fd)
+{
+    int i = fd - SIM_LISTEN_FD - 1;
+    if (i < 0 || i >= SIM_MAX_CONNS || conns[i].state != SIM_CONN_OPEN) {
+        return NULL;
+    }
+    return &conns[i];
+}
+
+// release the slot once both ends are closed
+static void conn_release(sim_conn_t *conn)
+{
+    if (conn->client_closed && conn->server_closed) {
+        conn->state = SIM_CONN_FREE;
+    }
+}
+
+static int conn_count(sim_conn_state_t state)
+{
+    int count = 0;
+    for (int i = 0; i < SIM_MAX_CONNS; i++) {
+        count += conns[i].state == state;
+    }
+    return count;
+}
+
+void sim_init(unsigned int tick, sim_tick_cb cb)
+{
+    memset(conns, 0, sizeof(conns));
+    memset(&stats, 0, sizeof(stats));
+    tick_cb   = cb;
+    tick_us   = tick;
+    now_us    = 0;
+    listening = 0;
+    backlog   = 0;
+    seq       = 0;
+}
+
+uint64_t sim_time_us(void)
+{
+    return now_us;
+}
+
+const sim_stats_t *sim_stats(void)
+{
+    return &stats;
+}
+
+sim_conn_t *sim_conn_open(void)
+{
+    if (!listening || conn_count(SIM_CONN_PENDING) >= backlog) {
+        stats.refused++;
+        return NULL;
+    }
+
+    for (int i = 0; i < SIM_MAX_CONNS; i++) {
+        sim_conn_t *conn = &conns[i];
+        if (conn->state != SIM_CONN_FREE) {
+            continue;
+        }
+
+        memset(conn, 0, sizeof(sim_conn_t));
+        cbuf_init(&conn->in, conn->in_buf, SIM_PIPE_SIZE);
+        cbuf_init(&conn->out, conn->out_buf, SIM_PIPE_SIZE);
+        conn->state = SIM_CONN_PENDING;
+        conn->seq   = seq++;
+
+        int used = SIM_MAX_CONNS - conn_count(SIM_CONN_FREE);
+        if (used > (int)stats.conns_max) {
+            stats.conns_max = used;
+        }
+        return conn;
+    }
+
+    stats.refused++;
+    return NULL;
+}
+
+int sim_conn_write(sim_conn_t *conn, const uint8_t *buf, int len)
+{
+    if (conn->client_closed) {
+        return -1;
+    }
+
+    // as with TCP, writes succeed until the client learns
+    // about the close
+    if (conn->server_closed) {
+        return len;
+    }
+    return cbuf_push(&conn->in, (uint8_t *)buf, len);
+}
+
+int sim_conn_read(sim_conn_t *conn, uint8_t *buf, int len)
+{
+    return cbuf_pop(&conn->out, buf, len);
+}
+
+int sim_conn_unread(sim_conn_t *conn)
+{
+    return cbuf_len(&conn->out);
+}
+
+int sim_conn_ended(sim_conn_t *conn)
+{
+    return conn->server_closed && cbuf_len(&conn->out) == 0;
+}
+
+void sim_conn_close(sim_conn_t *conn)
+{
+    conn->client_closed = 1;
+    cbuf_end(&conn->in);
+    conn_release(conn);
+}
+
+/////////////////////////////////////////////////////
+// System calls
+/////////////////////////////////////////////////////
+
+int sim_socket(int domain, int type, int protocol)
+{
+    (void)domain;
+    (void)type;
+    (void)protocol;
+    return SIM_LISTEN_FD;
+}
+
+int sim_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    (void)fd;
+    (void)addr;
+    (void)len;
+    return 0;
+}
+
+int sim_listen(int fd, int size)
+{
+    (void)fd;
+    listening = 1;
+    backlog   = size;
+    return 0;
+}
+
+int sim_accept(int fd, struct sockaddr *addr, socklen_t *len)
+{
+    return sim_accept4(fd, addr, len, 0);
+}
+
+int sim_accept4(int fd, struct sockaddr *addr, socklen_t *len, int flags)
+{
+    (void)addr;
+    (void)len;
+    (void)flags;
+    if (fd != SIM_LISTEN_FD || !listening) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // oldest pending connection
+    sim_conn_t *next = NULL;
+    for (int i = 0; i < SIM_MAX_CONNS; i++) {
+        if (conns[i].state == SIM_CONN_PENDING &&
+            (next == NULL || conns[i].seq < next->seq)) {
+            next = &conns[i];
+        }
+    }
+
+    if (next == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    next->state = SIM_CONN_OPEN;
+    return SIM_LISTEN_FD + 1 + (int)(next - conns);
+}
+
+int sim_setsockopt(int fd,
+                   int level,
+                   int name,
+                   const void *value,
+                   socklen_t len)
+{
+    (void)fd;
+    (void)level;
+    (void)name;
+    (void)value;
+    (void)len;
+    return 0;
+}
+
+int sim_getsockopt(int fd, int level, int name, void *value, socklen_t *len)
+{
+    (void)fd;
+    (void)level;
+    (void)name;
+    memset(value, 0, *len);
+    return 0;
+}
+
+int sim_fcntl(int fd, int cmd, ...)
+{
+    (void)fd;
+    (void)cmd;
+    return 0;
+}
+
+int sim_select(int nfds,
+               fd_set *read_fds,
+               fd_set *write_fds,
+               fd_set *except_fds,
+               struct timeval *timeout)
+{
+    (void)except_fds;
+    (void)timeout;
+
+    if (tick_cb != NULL) {
+        tick_cb();
+    }
+    now_us += tick_us;
+    stats.ticks++;
+
+    int pending = conn_count(SIM_CONN_PENDING) > 0;
+    int ready   = 0;
+    for (int fd = 0; fd < nfds; fd++) {
+        sim_conn_t *conn = conn_get(fd);
+        if (read_fds != NULL && FD_ISSET(fd, read_fds)) {
+            int readable = fd == SIM_LISTEN_FD
+                             ? listening && pending
+                             : conn != NULL && (cbuf_len(&conn->in) > 0 ||
+                                                conn->client_closed);
+            if (readable) {
+                ready++;
+            } else {
+                FD_CLR(fd, read_fds);
+            }
+        }
+        if (write_fds != NULL && FD_ISSET(fd, write_fds)) {
+            if (conn != NULL &&
+                cbuf_len(&conn->out) < cbuf_maxlen(&conn->out)) {
+                ready++;
+            } else {
+                FD_CLR(fd, write_fds);
+            }
+        }
+    }
+    return ready;
+}
+
+ssize_t sim_recv(int fd, void *buf, size_t len, int flags)
+{
+    (void)flags;
+    sim_conn_t *conn = conn_get(fd);
+    if (conn == NULL || conn->server_closed) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (cbuf_len(&conn->in) == 0) {
+        if (conn->client_closed) {
+            return 0;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+
+    int count = cbuf_pop(&conn->in, buf, len);
+    stats.bytes_in += count;
+    return count;
+}
+
+ssize_t sim_send(int fd, const void *buf, size_t len, int flags)
+{
+    (void)flags;
+    sim_conn_t *conn = conn_get(fd);
+    if (conn == NULL || conn->server_closed) {
+        errno = EBADF;
+        return -1;
+    }
+    if (conn->client_closed) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    int count = cbuf_push(&conn->out, (uint8_t *)buf, len);
+    if (count == 0 && len > 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    stats.bytes_out += count;
+    if (cbuf_len(&conn->out) > (int)stats.unread_max) {
+        stats.unread_max = cbuf_len(&conn->out);
+    }
+    return count;
+}
+
+ssize_t sim_sendfile(int fd, int in_fd, off_t *offset, size_t count)
+{
+    sim_conn_t *conn = conn_get(fd);
+    if (conn == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // only read what fits in the connection
+    static uint8_t buf[SIM_PIPE_SIZE];
+    size_t space = cbuf_maxlen(&conn->out) - cbuf_len(&conn->out);
+    if (count > space) {
+        count = space;
+    }
+    if (count == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    ssize_t len = pread(in_fd, buf, count, *offset);
+    if (len <= 0) {
+        return len;
+    }
+
+    ssize_t written = sim_send(fd, buf, len, 0);
+    if (written > 0) {
+        *offset += written;
+    }
+    return written;
+}
+
+int sim_shutdown(int fd, int how)
+{
+    (void)how;
+    sim_conn_t *conn = conn_get(fd);
+    if (conn != NULL) {
+        cbuf_end(&conn->out);
+    }
+    return 0;
+}
+
+int sim_close(int fd)
+{
+    if (fd == SIM_LISTEN_FD) {
+        listening = 0;
+        return 0;
+    }
+
+    sim_conn_t *conn = conn_get(fd);
+    if (conn == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    conn->server_closed = 1;
+    cbuf_end(&conn->out);
+    conn_release(conn);
+    return 0;
+}
+
+int sim_gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+    tv->tv_sec  = now_us / 1000000;
+    tv->tv_usec = now_us % 1000000;
+    return 0;
+}
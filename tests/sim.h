@@ -0,0 +1,131 @@
+/**
+ * Simulated network and clock for the event loop
+ *
+ * In-memory replacement of the socket and time calls used by event.c.
+ * Building event.c with -DEVENT_IO_H=\"sim_io.h\" maps those calls to the
+ * sim_* functions below, so the server runs unchanged inside a single
+ * process against clients driven by the caller.
+ *
+ * Each call to select() is one iteration of the event loop: it runs the
+ * tick callback, where clients read and write their end of the connections,
+ * and then moves the virtual clock forward by a fixed step. Given the same
+ * client behaviour a run always produces the same results.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "cbuf.h"
+
+// Maximum number of connections, pending or open
+#ifndef SIM_MAX_CONNS
+#define SIM_MAX_CONNS (64)
+#endif
+
+// Bytes buffered on each direction of a connection,
+// as the kernel socket buffers
+#ifndef SIM_PIPE_SIZE
+#define SIM_PIPE_SIZE (16384)
+#endif
+
+// Descriptor of the listening socket, connections use the following ones
+#define SIM_LISTEN_FD (3)
+
+typedef enum
+{
+    SIM_CONN_FREE,
+    SIM_CONN_PENDING, // waiting in the backlog
+    SIM_CONN_OPEN
+} sim_conn_state_t;
+
+typedef struct
+{
+    sim_conn_state_t state;
+    uint32_t seq; // connection order, the backlog is FIFO
+
+    int client_closed; // the client end was closed
+    int server_closed; // the server descriptor was closed
+
+    cbuf_t in;  // client to server
+    cbuf_t out; // server to client
+    uint8_t in_buf[SIM_PIPE_SIZE];
+    uint8_t out_buf[SIM_PIPE_SIZE];
+} sim_conn_t;
+
+// High-water marks and totals of a run
+typedef struct
+{
+    uint64_t ticks;
+    uint64_t bytes_in;  // read by the server
+    uint64_t bytes_out; // written by the server
+    uint32_t conns_max; // pending and open connections
+    uint32_t unread_max; // bytes written by the server not read by a client
+    uint32_t refused;   // connections rejected because the backlog was full
+} sim_stats_t;
+
+// Called on every event loop iteration, before the clock moves forward
+typedef void (*sim_tick_cb)(void);
+
+// Reset all connections and statistics. The clock starts at 0
+// and moves by tick_us microseconds on every loop iteration
+void sim_init(unsigned int tick_us, sim_tick_cb tick);
+
+// Virtual time in microseconds
+uint64_t sim_time_us(void);
+
+// Statistics since the last sim_init()
+const sim_stats_t *sim_stats(void);
+
+// Queue a new connection in the listening socket backlog. Returns
+// NULL if the server is not listening or the backlog is full
+sim_conn_t *sim_conn_open(void);
+
+// Write up to len bytes to the server. Returns the number of bytes
+// written or -1 if the client end is closed. Bytes written after the
+// server closed the connection are discarded
+int sim_conn_write(sim_conn_t *conn, const uint8_t *buf, int len);
+
+// Read up to len bytes sent by the server
+int sim_conn_read(sim_conn_t *conn, uint8_t *buf, int len);
+
+// Number of bytes sent by the server not yet read
+int sim_conn_unread(sim_conn_t *conn);
+
+// Return 1 if the server closed the connection and
+// all its data has been read
+int sim_conn_ended(sim_conn_t *conn);
+
+// Close the client end. The connection must not be used afterwards
+void sim_conn_close(sim_conn_t *conn);
+
+// Replacements for the system calls, see sim_io.h
+int sim_socket(int domain, int type, int protocol);
+int sim_bind(int fd, const struct sockaddr *addr, socklen_t len);
+int sim_listen(int fd, int backlog);
+int sim_accept(int fd, struct sockaddr *addr, socklen_t *len);
+int sim_accept4(int fd, struct sockaddr *addr, socklen_t *len, int flags);
+int sim_setsockopt(int fd,
+                   int level,
+                   int name,
+                   const void *value,
+                   socklen_t len);
+int sim_getsockopt(int fd, int level, int name, void *value, socklen_t *len);
+int sim_fcntl(int fd, int cmd, ...);
+int sim_select(int nfds,
+               fd_set *read_fds,
+               fd_set *write_fds,
+               fd_set *except_fds,
+               struct timeval *timeout);
+ssize_t sim_recv(int fd, void *buf, size_t len, int flags);
+ssize_t sim_send(int fd, const void *buf, size_t len, int flags);
+ssize_t sim_sendfile(int fd, int in_fd, off_t *offset, size_t count);
+int sim_shutdown(int fd, int how);
+int sim_close(int fd);
+int sim_gettimeofday(struct timeval *tv, void *tz);
+
+#endif /* SIM_H */
@@ -0,0 +1,26 @@
+/**
+ * Event loop backend for the simulator, included by event.c
+ * when built with -DEVENT_IO_H=\"sim_io.h\"
+ */
+#ifndef SIM_IO_H
+#define SIM_IO_H
+
+#include "sim.h"
+
+#define socket       sim_socket
+#define bind         sim_bind
+#define listen       sim_listen
+#define accept       sim_accept
+#define accept4      sim_accept4
+#define setsockopt   sim_setsockopt
+#define getsockopt   sim_getsockopt
+#define fcntl        sim_fcntl
+#define select       sim_select
+#define recv         sim_recv
+#define send         sim_send
+#define sendfile     sim_sendfile
+#define shutdown     sim_shutdown
+#define close        sim_close
+#define gettimeofday sim_gettimeofday
+
+#endif /* SIM_IO_H */
@@ -137,11 +137,88 @@ void test_peek_buffer(void)
       7, cbuf_len(&cbuf), "Buffer length must not change with peek");
 }
 
+void test_non_power_of_two_size(void)
+{
+    uint8_t buf[6], readbuf[6];
+    cbuf_t cbuf;
+
+    cbuf_init(&cbuf, buf, 6);
+
+    TEST_ASSERT_EQUAL(4, cbuf_push(&cbuf, (uint8_t *)"abcd", 4));
+    TEST_ASSERT_EQUAL(3, cbuf_pop(&cbuf, readbuf, 3));
+
+    // the write wraps around the end of the buffer
+    TEST_ASSERT_EQUAL(5, cbuf_push(&cbuf, (uint8_t *)"efghi", 5));
+    TEST_ASSERT_EQUAL_STRING_LEN("ghidef", buf, 6);
+    TEST_ASSERT_EQUAL(0, cbuf_push(&cbuf, (uint8_t *)"j", 1));
+
+    TEST_ASSERT_EQUAL(6, cbuf_peek(&cbuf, readbuf, 6));
+    TEST_ASSERT_EQUAL_STRING_LEN("defghi", readbuf, 6);
+
+    // the read wraps around as well
+    TEST_ASSERT_EQUAL(4, cbuf_pop(&cbuf, readbuf, 4));
+    TEST_ASSERT_EQUAL_STRING_LEN("defg", readbuf, 4);
+    TEST_ASSERT_EQUAL(2, cbuf_pop(&cbuf, readbuf, 6));
+    TEST_ASSERT_EQUAL_STRING_LEN("hi", readbuf, 2);
+    TEST_ASSERT_EQUAL(0, cbuf_len(&cbuf));
+}
+
+void test_reserve_and_commit(void)
+{
+    uint8_t buf[8], readbuf[8];
+    cbuf_t cbuf;
+
+    cbuf_init(&cbuf, buf, 8);
+
+    // reserved bytes are written in place
+    uint8_t *ptr = cbuf_reserve(&cbuf, 4);
+    TEST_ASSERT_EQUAL_PTR(buf, ptr);
+    memcpy(ptr, "abcd", 4);
+    TEST_ASSERT_EQUAL_MESSAGE(
+      0, cbuf_len(&cbuf), "Reserved bytes are not added before commit");
+    TEST_ASSERT_EQUAL(4, cbuf_commit(&cbuf, 4));
+    TEST_ASSERT_EQUAL(4, cbuf_len(&cbuf));
+
+    TEST_ASSERT_EQUAL(3, cbuf_pop(&cbuf, readbuf, 3));
+    TEST_ASSERT_EQUAL_STRING_LEN("abc", readbuf, 3);
+
+    // not enough free space
+    TEST_ASSERT_NULL(cbuf_reserve(&cbuf, 8));
+
+    // only the run up to the end of the memory can be reserved
+    TEST_ASSERT_EQUAL(4, cbuf_contiguous(&cbuf));
+    TEST_ASSERT_NULL(cbuf_reserve(&cbuf, 6));
+    ptr = cbuf_reserve(&cbuf, 4);
+    TEST_ASSERT_EQUAL_PTR(buf + 4, ptr);
+    memcpy(ptr, "efgh", 4);
+    cbuf_commit(&cbuf, 4);
+
+    // then the free space at the beginning, up to the read index
+    TEST_ASSERT_EQUAL(3, cbuf_contiguous(&cbuf));
+    ptr = cbuf_reserve(&cbuf, 3);
+    TEST_ASSERT_EQUAL_PTR(buf, ptr);
+    memcpy(ptr, "ijk", 3);
+    cbuf_commit(&cbuf, 3);
+    TEST_ASSERT_EQUAL(0, cbuf_contiguous(&cbuf));
+    TEST_ASSERT_NULL(cbuf_reserve(&cbuf, 1));
+
+    TEST_ASSERT_EQUAL(8, cbuf_pop(&cbuf, readbuf, 8));
+    TEST_ASSERT_EQUAL_STRING_LEN("defghijk", readbuf, 8);
+
+    // empty buffers start over
+    TEST_ASSERT_EQUAL_PTR(buf, cbuf_reserve(&cbuf, 8));
+
+    cbuf_end(&cbuf);
+    TEST_ASSERT_NULL(cbuf_reserve(&cbuf, 1));
+}
+
 int main(void)
 {
     UNIT_TESTS_BEGIN();
     UNIT_TEST(test_write_after_end_buffer);
     UNIT_TEST(test_write_and_read);
     UNIT_TEST(test_peek_buffer);
+    UNIT_TEST(test_non_power_of_two_size);
+    UNIT_TEST(test_reserve_and_commit);
     UNIT_TESTS_END();
 }
@@ -14,11 +14,40 @@ void test_content_type(void)
     TEST_ASSERT_EQUAL(NULL, content_type_allowed("application/binary"));
 }
 
+void test_content_type_from_path(void)
+{
+    TEST_ASSERT_EQUAL_STRING("text/html",
+                             content_type_from_path("/index.html"));
+    TEST_ASSERT_EQUAL_STRING("application/javascript",
+                             content_type_from_path("/js/app.JS"));
+    TEST_ASSERT_EQUAL_STRING("application/octet-stream",
+                             content_type_from_path("/fw.bin"));
+    TEST_ASSERT_EQUAL_STRING("application/octet-stream",
+                             content_type_from_path("/a.d/README"));
+
+    // values point to the allowed list
+    TEST_ASSERT_EQUAL_PTR(content_type_allowed("text/css"),
+                          content_type_from_path("/style.css"));
+}
+
+void test_content_encoding(void)
+{
+    TEST_ASSERT_EQUAL_STRING("gzip", content_encoding_allowed("gzip"));
+    TEST_ASSERT_EQUAL_STRING("gzip", content_encoding_allowed("GZIP"));
+    TEST_ASSERT_EQUAL_STRING("br", content_encoding_allowed("br"));
+
+    TEST_ASSERT_EQUAL(NULL, content_encoding_allowed("gzipx"));
+    TEST_ASSERT_EQUAL(NULL, content_encoding_allowed("identity"));
+    TEST_ASSERT_EQUAL(NULL, content_encoding_allowed(NULL));
+}
+
 int main(void)
 {
     UNITY_BEGIN();
 
     UNIT_TEST(test_content_type);
+    UNIT_TEST(test_content_type_from_path);
+    UNIT_TEST(test_content_encoding);
 
     return UNITY_END();
 }
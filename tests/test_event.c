@@ -1,4 +1,6 @@
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -14,7 +16,7 @@ FAKE_VALUE_FUNC(int, socket, int, int, int);
 FAKE_VALUE_FUNC(int, bind, int, const struct sockaddr *, socklen_t);
 FAKE_VALUE_FUNC(int, listen, int, int);
 FAKE_VALUE_FUNC(int, close, int);
-FAKE_VALUE_FUNC(int, accept, int, struct sockaddr *, socklen_t *);
+FAKE_VALUE_FUNC(int, accept4, int, struct sockaddr *, socklen_t *, int);
 FAKE_VALUE_FUNC(int, setsockopt, int, int, int, const void *, socklen_t);
 FAKE_VALUE_FUNC(int,
                 select,
@@ -25,6 +27,7 @@ FAKE_VALUE_FUNC(int,
                 struct timeval *);
 FAKE_VALUE_FUNC(ssize_t, recv, int, void *, size_t, int);
 FAKE_VALUE_FUNC(ssize_t, send, int, const void *, size_t, int);
+FAKE_VALUE_FUNC(ssize_t, sendfile, int, int, off_t *, size_t);
 FAKE_VOID_FUNC(cbuf_init, cbuf_t *, uint8_t *, int);
 FAKE_VALUE_FUNC(int, cbuf_push, cbuf_t *, uint8_t *, int);
 FAKE_VALUE_FUNC(int, cbuf_peek, cbuf_t *, uint8_t *, int);
@@ -33,6 +36,9 @@ FAKE_VALUE_FUNC(int, cbuf_len, cbuf_t *);
 FAKE_VALUE_FUNC(int, cbuf_maxlen, cbuf_t *);
 FAKE_VOID_FUNC(cbuf_end, cbuf_t *);
 FAKE_VALUE_FUNC(int, cbuf_has_ended, cbuf_t *);
+FAKE_VALUE_FUNC(uint8_t *, cbuf_reserve, cbuf_t *, int);
+FAKE_VALUE_FUNC(int, cbuf_commit, cbuf_t *, int);
+FAKE_VALUE_FUNC(int, cbuf_contiguous, cbuf_t *);
 
 /* List of fakes used by this unit tester */
 #define FFF_FAKES_LIST(FAKE)                                                   \
@@ -40,10 +46,11 @@ FAKE_VALUE_FUNC(int, cbuf_has_ended, cbuf_t *);
     FAKE(bind)                                                                 \
     FAKE(listen)                                                               \
     FAKE(close)                                                                \
-    FAKE(accept)                                                               \
+    FAKE(accept4)                                                              \
     FAKE(setsockopt)                                                           \
     FAKE(recv)                                                                 \
     FAKE(send)                                                                 \
+    FAKE(sendfile)                                                             \
     FAKE(cbuf_init)                                                            \
     FAKE(cbuf_push)                                                            \
     FAKE(cbuf_peek)                                                            \
@@ -52,6 +59,9 @@ FAKE_VALUE_FUNC(int, cbuf_has_ended, cbuf_t *);
     FAKE(cbuf_end)                                                             \
     FAKE(cbuf_has_ended)                                                       \
     FAKE(cbuf_maxlen)                                                          \
+    FAKE(cbuf_reserve)                                                         \
+    FAKE(cbuf_commit)                                                          \
+    FAKE(cbuf_contiguous)                                                      \
     FAKE(select)
 
 int fake_cbuf_len;
@@ -249,6 +259,21 @@ int test_cbuf_push(cbuf_t *cb, uint8_t *dst, int size)
     return 0;
 }
 
+uint8_t *test_cbuf_reserve(cbuf_t *cb, int size)
+{
+    static uint8_t reserved[32];
+    if (fake_cbuf_ended || size > 32 - fake_cbuf_len) {
+        return NULL;
+    }
+    return reserved;
+}
+
+int test_cbuf_commit(cbuf_t *cb, int size)
+{
+    fake_cbuf_len += size;
+    return size;
+}
+
 int test_cbuf_peek(cbuf_t *cb, uint8_t *dst, int size)
 {
     TEST_ASSERT_GREATER_OR_EQUAL(size, fake_cbuf_len);
@@ -399,6 +424,37 @@ void test_event_listen_no_sockets_available(void)
       "server socket should be unused after loop finish");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// test_event_listen_sockopts
+//////////////////////////////////////////////////////////////////////////
+void test_event_listen_sockopts(void)
+{
+    event_loop_t loop;
+
+    event_loop_init(&loop);
+
+    // only TCP_NODELAY is set by default
+    TEST_ASSERT_EQUAL(1, loop.sockopts.nodelay);
+    TEST_ASSERT_EQUAL(0, loop.sockopts.fastopen);
+
+    event_sockopts_t opts = { .nodelay = 1, .fastopen = 4, .sndbuf = 8192 };
+    event_loop_sockopts(&loop, &opts);
+
+    event_sock_t *sock = event_sock_create(&loop);
+    select_fake.custom_fake = select_with_no_activity;
+    socket_fake.return_val  = 1;
+    TEST_ASSERT_EQUAL(0, event_listen(sock, 8888, test_event_listen_ok_cb));
+
+    // SO_REUSEADDR and the options different from 0
+    TEST_ASSERT_EQUAL(4, setsockopt_fake.call_count);
+    TEST_ASSERT_EQUAL(TCP_NODELAY, setsockopt_fake.arg2_history[1]);
+    TEST_ASSERT_EQUAL(SO_SNDBUF, setsockopt_fake.arg2_history[2]);
+    TEST_ASSERT_EQUAL(TCP_FASTOPEN, setsockopt_fake.arg2_history[3]);
+
+    event_close(sock, close_s1_cb);
+    event_loop(&loop);
+}
+
 //////////////////////////////////////////////////////////////////////////
 // test_event_accept
 //////////////////////////////////////////////////////////////////////////
@@ -410,9 +466,9 @@ event_sock_t *test_event_accept_listen_cb(event_sock_t *server)
     event_sock_t *client = event_sock_create(server->loop);
 
     // set accept return value
-    accept_fake.return_val = 2;
+    accept4_fake.return_val = 2;
     TEST_ASSERT_EQUAL(0, event_accept(server, client));
-    TEST_ASSERT_EQUAL(1, accept_fake.call_count);
+    TEST_ASSERT_EQUAL(1, accept4_fake.call_count);
     TEST_ASSERT_EQUAL(2, client->descriptor);
     TEST_ASSERT_EQUAL(EVENT_SOCK_CONNECTED, client->state);
 
@@ -454,6 +510,60 @@ void test_event_accept(void)
                               "all sockets should be unused after loop finish");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// test_event_accept_batch
+//////////////////////////////////////////////////////////////////////////
+int accept4_two_clients(int s, struct sockaddr *addr, socklen_t *len, int f)
+{
+    TEST_ASSERT_EQUAL(SOCK_NONBLOCK | SOCK_CLOEXEC, f);
+    if (accept4_fake.call_count <= 2) {
+        return accept4_fake.call_count + 1;
+    }
+
+    // the backlog is empty
+    errno = EAGAIN;
+    return -1;
+}
+
+event_sock_t *test_event_accept_batch_listen_cb(event_sock_t *server)
+{
+    event_sock_t *client = event_sock_create(server->loop);
+    if (event_accept(server, client) < 0) {
+        event_close(client, test_event_listen_on_close);
+        event_close(server, close_s1_cb);
+        return NULL;
+    }
+
+    event_close(client, test_event_listen_on_close);
+    return client;
+}
+
+void test_event_accept_batch(void)
+{
+    event_loop_t loop;
+
+    event_loop_init(&loop);
+
+    event_sock_t *sock = event_sock_create(&loop);
+
+    // set fake functions
+    int (*select_fakes[])(
+      int, fd_set *, fd_set *, fd_set *, struct timeval *) = {
+        select_with_read_on_s1_fake, select_with_no_activity
+    };
+    SET_CUSTOM_FAKE_SEQ(select, select_fakes, 2);
+    socket_fake.return_val   = 1;
+    accept4_fake.custom_fake = accept4_two_clients;
+
+    event_listen(sock, 8888, test_event_accept_batch_listen_cb);
+    event_loop(&loop);
+
+    // all pending connections are accepted on a single notification
+    TEST_ASSERT_EQUAL(1, select_fake.call_count);
+    TEST_ASSERT_EQUAL(3, accept4_fake.call_count);
+    TEST_ASSERT_EQUAL(EVENT_MAX_SOCKETS, event_sock_unused(&loop));
+}
+
 //////////////////////////////////////////////////////////////////////////
 // test_event_read
 //////////////////////////////////////////////////////////////////////////
@@ -485,7 +595,7 @@ event_sock_t *test_event_read_listen_cb(event_sock_t *server)
     event_sock_t *client = event_sock_create(server->loop);
 
     // set accept return value
-    accept_fake.return_val = 2;
+    accept4_fake.return_val = 2;
     TEST_ASSERT_EQUAL(0, event_accept(server, client));
     TEST_ASSERT_EQUAL(2, client->descriptor);
 
@@ -527,6 +637,8 @@ void test_event_read(void)
     cbuf_len_fake.custom_fake       = test_cbuf_len;
     cbuf_maxlen_fake.custom_fake    = test_cbuf_maxlen;
     cbuf_push_fake.custom_fake      = test_cbuf_push;
+    cbuf_reserve_fake.custom_fake   = test_cbuf_reserve;
+    cbuf_commit_fake.custom_fake    = test_cbuf_commit;
     cbuf_end_fake.custom_fake       = test_cbuf_end;
     cbuf_has_ended_fake.custom_fake = test_cbuf_has_ended;
 
@@ -541,12 +653,97 @@ void test_event_read(void)
     // start loop
     event_loop(&loop);
 
-    TEST_ASSERT_EQUAL(3, select_fake.call_count);
+    // the remaining bytes are passed to the next callback
+    // on the same iteration
+    TEST_ASSERT_EQUAL(2, select_fake.call_count);
     TEST_ASSERT_EQUAL_MESSAGE(EVENT_MAX_SOCKETS,
                               event_sock_unused(&loop),
                               "all sockets should be unused after loop finish");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// test_event_read_partial
+//////////////////////////////////////////////////////////////////////////
+event_sock_t *partial_client;
+int partial_read_count;
+
+int test_event_read_partial_cb(struct event_sock *sock,
+                               int size,
+                               uint8_t *bytes)
+{
+    // wait for the rest of the message
+    partial_read_count++;
+    return 0;
+}
+
+int select_and_close_partial(int nfds,
+                             fd_set *read_set,
+                             fd_set *write_set,
+                             fd_set *except_set,
+                             struct timeval *tv)
+{
+    // the callback is not notified again without new data
+    TEST_ASSERT_EQUAL(1, partial_read_count);
+    event_close(partial_client, close_s2_cb);
+    return select_with_no_activity(nfds, read_set, write_set, except_set, tv);
+}
+
+event_sock_t *test_event_read_partial_listen_cb(event_sock_t *server)
+{
+    partial_client = event_sock_create(server->loop);
+
+    accept4_fake.return_val = 2;
+    TEST_ASSERT_EQUAL(0, event_accept(server, partial_client));
+
+    event_read_start(partial_client, buf, 32, test_event_read_partial_cb);
+    event_close(server, close_s1_cb);
+
+    return partial_client;
+}
+
+void test_event_read_partial(void)
+{
+    event_loop_t loop;
+
+    event_loop_init(&loop);
+
+    event_sock_t *sock = event_sock_create(&loop);
+    TEST_ASSERT_NOT_EQUAL(NULL, sock);
+
+    // read on the first two iterations, then wait
+    int (*select_fakes[])(int,
+                          fd_set *,
+                          fd_set *,
+                          fd_set *,
+                          struct timeval *) = { select_with_read_on_s1_fake,
+                                                select_with_read_on_s2_fake,
+                                                select_with_no_activity,
+                                                select_with_no_activity,
+                                                select_and_close_partial };
+    SET_CUSTOM_FAKE_SEQ(select, select_fakes, 5);
+
+    socket_fake.return_val = 1;
+
+    cbuf_peek_fake.custom_fake      = test_cbuf_peek;
+    cbuf_pop_fake.custom_fake       = test_cbuf_pop;
+    cbuf_len_fake.custom_fake       = test_cbuf_len;
+    cbuf_maxlen_fake.custom_fake    = test_cbuf_maxlen;
+    cbuf_push_fake.custom_fake      = test_cbuf_push;
+    cbuf_has_ended_fake.custom_fake = test_cbuf_has_ended;
+
+    ssize_t (*recv_fakes[])(int, void *, size_t, int) = { recv_hello_world,
+                                                          recv_nothing };
+    SET_CUSTOM_FAKE_SEQ(recv, recv_fakes, 2);
+
+    partial_read_count = 0;
+    event_listen(sock, 8888, test_event_read_partial_listen_cb);
+    event_loop(&loop);
+
+    TEST_ASSERT_EQUAL(5, select_fake.call_count);
+    TEST_ASSERT_EQUAL(1, partial_read_count);
+    TEST_ASSERT_EQUAL(EVENT_MAX_SOCKETS, event_sock_unused(&loop));
+}
+
 //////////////////////////////////////////////////////////////////////////
 // test_event_write
 //////////////////////////////////////////////////////////////////////////
@@ -559,6 +756,15 @@ void test_event_write_hello_world_cb(struct event_sock *client, int status)
     event_close(client, close_s2_cb);
 }
 
+static int writable_count;
+
+void test_event_write_writable_cb(struct event_sock *client)
+{
+    // ", World!" is still waiting in the buffer
+    TEST_ASSERT_EQUAL(32 - 8, event_write_space(client));
+    writable_count++;
+}
+
 event_sock_t *test_event_write_listen_cb(event_sock_t *server)
 {
     TEST_ASSERT_EQUAL(1, server->descriptor);
@@ -573,10 +779,25 @@ event_sock_t *test_event_write_listen_cb(event_sock_t *server)
     event_write_enable(client, buf, 32);
 
     // call write
-    event_write(client,
-                13,
-                (unsigned char *)"Hello, World!",
-                test_event_write_hello_world_cb);
+    TEST_ASSERT_EQUAL(13,
+                      event_write(client,
+                                  13,
+                                  (unsigned char *)"Hello, World!",
+                                  test_event_write_hello_world_cb));
+
+    // writes that do not fit are not queued
+    TEST_ASSERT_EQUAL(32 - 13, event_write_space(client));
+    TEST_ASSERT_EQUAL(
+      -1,
+      event_write(
+        client, 20, (unsigned char *)buf, test_event_write_hello_world_cb));
+    event_write_wait(client, test_event_write_writable_cb);
+
+    // only the free space before the end of the buffer can be
+    // reserved, while copied writes can wrap around
+    cbuf_contiguous_fake.return_val = 4;
+    TEST_ASSERT_EQUAL(4, event_write_contiguous(client));
+    TEST_ASSERT_EQUAL(32 - 13, event_write_space(client));
 
     // close sockets
     event_close(server, close_s1_cb);
@@ -605,7 +826,7 @@ void test_event_write(void)
     socket_fake.return_val = 1;
 
     // set accept return value
-    accept_fake.return_val = 2;
+    accept4_fake.return_val = 2;
 
     // buffer responses
     cbuf_peek_fake.custom_fake      = test_cbuf_peek;
@@ -613,6 +834,8 @@ void test_event_write(void)
     cbuf_len_fake.custom_fake       = test_cbuf_len;
     cbuf_maxlen_fake.custom_fake    = test_cbuf_maxlen;
     cbuf_push_fake.custom_fake      = test_cbuf_push;
+    cbuf_reserve_fake.custom_fake   = test_cbuf_reserve;
+    cbuf_commit_fake.custom_fake    = test_cbuf_commit;
     cbuf_end_fake.custom_fake       = test_cbuf_end;
     cbuf_has_ended_fake.custom_fake = test_cbuf_has_ended;
 
@@ -622,11 +845,15 @@ void test_event_write(void)
     SET_CUSTOM_FAKE_SEQ(send, send_fakes, 2);
 
     // configure sock as server socket
+    writable_count = 0;
     event_listen(sock, 8888, test_event_write_listen_cb);
 
     // start loop
     event_loop(&loop);
 
+    // notified once, when the buffer drained below half
+    TEST_ASSERT_EQUAL(1, writable_count);
+
     TEST_ASSERT_EQUAL(3, select_fake.call_count);
     TEST_ASSERT_EQUAL_MESSAGE(EVENT_MAX_SOCKETS,
                               event_sock_unused(&loop),
@@ -636,6 +863,304 @@ void test_event_write(void)
 // test_event_sock_create
 //////////////////////////////////////////////////////////////////////////
 
+//////////////////////////////////////////////////////////////////////////
+// test_event_sendfile
+//////////////////////////////////////////////////////////////////////////
+
+ssize_t send_hello_only(int s, const void *src, size_t len, int flags)
+{
+    TEST_ASSERT_EQUAL(2, s);
+
+    // file bytes are not sent from the buffer
+    TEST_ASSERT_EQUAL(5, len);
+
+    // the frame header is corked until the file is sent
+    TEST_ASSERT_EQUAL(MSG_DONTWAIT | MSG_MORE, flags);
+    return 5;
+}
+
+ssize_t sendfile_all(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    TEST_ASSERT_EQUAL(2, out_fd);
+    TEST_ASSERT_EQUAL(7, in_fd);
+    TEST_ASSERT_EQUAL(100, *offset);
+    TEST_ASSERT_EQUAL(20, count);
+    return 20;
+}
+
+void test_event_sendfile_hello_cb(struct event_sock *client, int status)
+{
+    TEST_ASSERT_EQUAL(0, status);
+
+    // the file has not been sent yet
+    TEST_ASSERT_EQUAL(0, sendfile_fake.call_count);
+}
+
+void test_event_sendfile_cb(struct event_sock *client, int status)
+{
+    TEST_ASSERT_EQUAL(0, status);
+    TEST_ASSERT_EQUAL(1, send_fake.call_count);
+
+    event_close(client, close_s2_cb);
+}
+
+event_sock_t *test_event_sendfile_listen_cb(event_sock_t *server)
+{
+    event_sock_t *client = event_sock_create(server->loop);
+    TEST_ASSERT_EQUAL(0, event_accept(server, client));
+
+    event_write_enable(client, buf, 32);
+
+    // buffered bytes are sent before the file
+    event_write(
+      client, 5, (unsigned char *)"Hello", test_event_sendfile_hello_cb);
+    int res = event_sendfile(client, 7, 100, 20, test_event_sendfile_cb);
+    TEST_ASSERT_EQUAL(20, res);
+
+    event_close(server, close_s1_cb);
+
+    return client;
+}
+
+void test_event_sendfile(void)
+{
+    event_loop_t loop;
+
+    event_loop_init(&loop);
+
+    event_sock_t *sock = event_sock_create(&loop);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    int (*select_fakes[])(
+      int, fd_set *, fd_set *, fd_set *, struct timeval *) = {
+        select_with_read_on_s1_fake,
+        select_with_write_on_s2_fake,
+        select_with_write_on_s2_fake
+    };
+    SET_CUSTOM_FAKE_SEQ(select, select_fakes, 3);
+
+    socket_fake.return_val = 1;
+    accept4_fake.return_val = 2;
+
+    cbuf_peek_fake.custom_fake      = test_cbuf_peek;
+    cbuf_pop_fake.custom_fake       = test_cbuf_pop;
+    cbuf_len_fake.custom_fake       = test_cbuf_len;
+    cbuf_maxlen_fake.custom_fake    = test_cbuf_maxlen;
+    cbuf_push_fake.custom_fake      = test_cbuf_push;
+    cbuf_reserve_fake.custom_fake   = test_cbuf_reserve;
+    cbuf_commit_fake.custom_fake    = test_cbuf_commit;
+    cbuf_end_fake.custom_fake       = test_cbuf_end;
+    cbuf_has_ended_fake.custom_fake = test_cbuf_has_ended;
+
+    send_fake.custom_fake     = send_hello_only;
+    sendfile_fake.custom_fake = sendfile_all;
+
+    event_listen(sock, 8888, test_event_sendfile_listen_cb);
+    event_loop(&loop);
+
+    TEST_ASSERT_EQUAL(1, send_fake.call_count);
+    TEST_ASSERT_EQUAL(1, sendfile_fake.call_count);
+    TEST_ASSERT_EQUAL(EVENT_MAX_SOCKETS, event_sock_unused(&loop));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// test_event_write_coalesce
+//////////////////////////////////////////////////////////////////////////
+
+// the read and write buffers keep their own contents, data is kept
+// at the beginning of the memory
+void linear_cbuf_init(cbuf_t *cb, uint8_t *mem, int maxlen)
+{
+    cb->ptr    = mem;
+    cb->maxlen = maxlen;
+    cb->len    = 0;
+    cb->state  = CBUF_OPEN;
+}
+
+int linear_cbuf_push(cbuf_t *cb, uint8_t *src, int len)
+{
+    if (cb->state != CBUF_OPEN || len > cb->maxlen - cb->len) {
+        len = cb->state != CBUF_OPEN ? 0 : cb->maxlen - cb->len;
+    }
+    memcpy(cb->ptr + cb->len, src, len);
+    cb->len += len;
+    return len;
+}
+
+int linear_cbuf_peek(cbuf_t *cb, uint8_t *dst, int len)
+{
+    len = len < cb->len ? len : cb->len;
+    if (dst != NULL) {
+        memcpy(dst, cb->ptr, len);
+    }
+    return len;
+}
+
+int linear_cbuf_pop(cbuf_t *cb, uint8_t *dst, int len)
+{
+    len = linear_cbuf_peek(cb, dst, len);
+    memmove(cb->ptr, cb->ptr + len, cb->len - len);
+    cb->len -= len;
+    return len;
+}
+
+int linear_cbuf_len(cbuf_t *cb)
+{
+    return cb->len;
+}
+
+int linear_cbuf_maxlen(cbuf_t *cb)
+{
+    return cb->maxlen;
+}
+
+int linear_cbuf_has_ended(cbuf_t *cb)
+{
+    return cb->state == CBUF_ENDED;
+}
+
+void linear_cbuf_end(cbuf_t *cb)
+{
+    cb->state = CBUF_ENDED;
+}
+
+int select_with_read_write_on_s2_fake(int nfds,
+                                      fd_set *read_set,
+                                      fd_set *write_set,
+                                      fd_set *except_set,
+                                      struct timeval *tv)
+{
+    select_with_read_on_s2_fake(nfds, read_set, write_set, except_set, tv);
+    FD_SET(2, write_set);
+    return 0;
+}
+
+// sizes of the writes queued by each read callback
+static int coalesce_writes[2];
+static int coalesce_reads;
+static uint8_t coalesce_write_buf[32];
+
+#define COALESCE_HIGH_WATER                                                    \
+    (EVENT_WRITE_HIGH_WATER > 0 ? EVENT_WRITE_HIGH_WATER : 32 * 3 / 4)
+
+static int sent_len[4];
+
+ssize_t send_record(int s, const void *src, size_t len, int flags)
+{
+    TEST_ASSERT_EQUAL(2, s);
+    TEST_ASSERT_LESS_THAN(4, send_fake.call_count);
+    sent_len[send_fake.call_count - 1] = len;
+    return len;
+}
+
+void test_event_write_coalesce_cb(struct event_sock *sock, int status)
+{
+    TEST_ASSERT_EQUAL(0, status);
+
+    // close once the replies to both reads are sent
+    if (coalesce_reads == 2 &&
+        linear_cbuf_len(&sock->write_event->data.write.buf) == 0) {
+        event_close(sock, close_s2_cb);
+    }
+}
+
+// "Hello" is read first, then ", World!"
+int test_event_write_coalesce_read_cb(struct event_sock *sock,
+                                      int size,
+                                      uint8_t *bytes)
+{
+    int len = coalesce_reads == 0 ? 5 : 8;
+    TEST_ASSERT_GREATER_OR_EQUAL(len, size);
+
+    // each frame is queued with its own write
+    int total = coalesce_writes[coalesce_reads++];
+    for (int i = 0; i < total; i += 4) {
+        TEST_ASSERT_EQUAL(4,
+                          event_write(sock,
+                                      4,
+                                      (uint8_t *)"abcd",
+                                      test_event_write_coalesce_cb));
+    }
+    return len;
+}
+
+event_sock_t *test_event_write_coalesce_listen_cb(event_sock_t *server)
+{
+    event_sock_t *client = event_sock_create(server->loop);
+    TEST_ASSERT_EQUAL(0, event_accept(server, client));
+
+    event_read_start(client, buf, 32, test_event_write_coalesce_read_cb);
+    event_write_enable(
+      client, coalesce_write_buf, sizeof(coalesce_write_buf));
+    event_close(server, close_s1_cb);
+
+    return client;
+}
+
+void test_event_write_coalesce_loop(int first, int second)
+{
+    event_loop_t loop;
+
+    event_loop_init(&loop);
+
+    event_sock_t *sock = event_sock_create(&loop);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    int (*select_fakes[])(
+      int, fd_set *, fd_set *, fd_set *, struct timeval *) = {
+        select_with_read_on_s1_fake, select_with_read_write_on_s2_fake
+    };
+    SET_CUSTOM_FAKE_SEQ(select, select_fakes, 2);
+
+    socket_fake.return_val  = 1;
+    accept4_fake.return_val = 2;
+
+    cbuf_init_fake.custom_fake      = linear_cbuf_init;
+    cbuf_peek_fake.custom_fake      = linear_cbuf_peek;
+    cbuf_pop_fake.custom_fake       = linear_cbuf_pop;
+    cbuf_len_fake.custom_fake       = linear_cbuf_len;
+    cbuf_maxlen_fake.custom_fake    = linear_cbuf_maxlen;
+    cbuf_push_fake.custom_fake      = linear_cbuf_push;
+    cbuf_end_fake.custom_fake       = linear_cbuf_end;
+    cbuf_has_ended_fake.custom_fake = linear_cbuf_has_ended;
+
+    ssize_t (*recv_fakes[])(int, void *, size_t, int) = { recv_hello_world,
+                                                          recv_nothing };
+    SET_CUSTOM_FAKE_SEQ(recv, recv_fakes, 2);
+    send_fake.custom_fake = send_record;
+
+    coalesce_reads     = 0;
+    coalesce_writes[0] = first;
+    coalesce_writes[1] = second;
+
+    event_listen(sock, 8888, test_event_write_coalesce_listen_cb);
+    event_loop(&loop);
+
+    // both read callbacks ran on the same iteration
+    TEST_ASSERT_EQUAL(2, coalesce_reads);
+    TEST_ASSERT_EQUAL(2, select_fake.call_count);
+    TEST_ASSERT_EQUAL(EVENT_MAX_SOCKETS, event_sock_unused(&loop));
+}
+
+void test_event_write_coalesce(void)
+{
+    // the writes queued by the read callbacks leave in a single send()
+    test_event_write_coalesce_loop(12, 8);
+    TEST_ASSERT_EQUAL(1, send_fake.call_count);
+    TEST_ASSERT_EQUAL(20, sent_len[0]);
+}
+
+void test_event_write_high_water(void)
+{
+    // the buffer is flushed after the callback that reaches the high
+    // water mark, the rest is sent at the end of the iteration
+    int first = (COALESCE_HIGH_WATER + 3) / 4 * 4;
+    test_event_write_coalesce_loop(first, 4);
+    TEST_ASSERT_EQUAL(2, send_fake.call_count);
+    TEST_ASSERT_EQUAL(first, sent_len[0]);
+    TEST_ASSERT_EQUAL(4, sent_len[1]);
+}
+
 void test_event_sock_create(void)
 {
     event_loop_t loop;
@@ -654,6 +1179,9 @@ void test_event_sock_create(void)
       0,
       event_sock_unused(&loop),
       "only EVENT_MAX_SOCKETS can be created with event_sock_create");
+    TEST_ASSERT_NULL_MESSAGE(
+      event_sock_create(&loop),
+      "event_sock_create should return NULL if no sockets are available");
 }
 
 int main(void)
@@ -662,8 +1190,14 @@ int main(void)
     UNIT_TEST(test_event_sock_create);
     UNIT_TEST(test_event_listen);
     UNIT_TEST(test_event_listen_no_sockets_available);
+    UNIT_TEST(test_event_listen_sockopts);
     UNIT_TEST(test_event_accept);
+    UNIT_TEST(test_event_accept_batch);
     UNIT_TEST(test_event_read);
+    UNIT_TEST(test_event_read_partial);
     UNIT_TEST(test_event_write);
+    UNIT_TEST(test_event_sendfile);
+    UNIT_TEST(test_event_write_coalesce);
+    UNIT_TEST(test_event_write_high_water);
     UNIT_TESTS_END();
 }
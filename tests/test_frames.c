@@ -13,11 +13,19 @@ FAKE_VOID_FUNC(buffer_put_u31, uint8_t *, uint32_t);
 FAKE_VOID_FUNC(buffer_put_u24, uint8_t *, uint32_t);
 FAKE_VOID_FUNC(buffer_put_u16, uint8_t *, uint16_t);
 FAKE_VOID_FUNC(buffer_put_u8, uint8_t *, uint8_t);
+FAKE_VALUE_FUNC(uint8_t *, event_write_reserve, event_sock_t *, unsigned int);
 FAKE_VALUE_FUNC(int,
-                event_write,
+                event_write_commit,
                 event_sock_t *,
                 unsigned int,
-                uint8_t *,
+                event_write_cb);
+FAKE_VALUE_FUNC(int, event_write_contiguous, event_sock_t *);
+FAKE_VALUE_FUNC(int,
+                event_sendfile,
+                event_sock_t *,
+                int,
+                off_t,
+                unsigned int,
                 event_write_cb);
 FAKE_VALUE_FUNC(int,
                 hpack_encode,
@@ -26,13 +34,18 @@ FAKE_VALUE_FUNC(int,
                 uint8_t *,
                 uint32_t);
 
+static uint8_t write_buf[HTTP2_SOCK_WRITE_SIZE];
+
 #define FFF_FAKES_LIST(FAKE)                                                   \
     FAKE(buffer_put_u32)                                                       \
     FAKE(buffer_put_u31)                                                       \
     FAKE(buffer_put_u24)                                                       \
     FAKE(buffer_put_u16)                                                       \
     FAKE(buffer_put_u8)                                                        \
-    FAKE(event_write)                                                          \
+    FAKE(event_write_reserve)                                                  \
+    FAKE(event_write_commit)                                                   \
+    FAKE(event_write_contiguous)                                               \
+    FAKE(event_sendfile)                                                       \
     FAKE(hpack_encode)
 
 void setUp()
@@ -42,6 +55,10 @@ void setUp()
 
     /* reset common FFF internal structures */
     FFF_RESET_HISTORY();
+
+    // frames are encoded in the write buffer
+    event_write_reserve_fake.return_val    = write_buf;
+    event_write_contiguous_fake.return_val = sizeof(write_buf);
 }
 
 void test_frame_header_to_bytes(void)
@@ -90,7 +107,7 @@ void test_send_ping_frame(void)
     TEST_ASSERT_EQUAL(0, buffer_put_u31_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 8, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 8, event_write_commit_fake.arg1_val);
 }
 
 void test_send_goaway_frame(void)
@@ -114,7 +131,7 @@ void test_send_goaway_frame(void)
     TEST_ASSERT_EQUAL(0x9, buffer_put_u32_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 8, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 8, event_write_commit_fake.arg1_val);
 }
 
 void test_send_settings_frame(void)
@@ -149,7 +166,7 @@ void test_send_settings_frame(void)
     TEST_ASSERT_EQUAL(6, buffer_put_u32_fake.arg1_history[5]);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 36, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 36, event_write_commit_fake.arg1_val);
 }
 
 void test_send_settings_ack(void)
@@ -174,7 +191,7 @@ void test_send_settings_ack(void)
     TEST_ASSERT_EQUAL(0, buffer_put_u32_fake.call_count);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9, event_write_commit_fake.arg1_val);
 }
 
 void test_send_headers_frame(void)
@@ -191,6 +208,9 @@ void test_send_headers_frame(void)
     // headers type
     TEST_ASSERT_EQUAL(FRAME_HEADERS_TYPE, buffer_put_u8_fake.arg1_history[0]);
 
+    // hpack is encoded after the frame header in the write buffer
+    TEST_ASSERT_EQUAL_PTR(write_buf + 9, hpack_encode_fake.arg2_val);
+
     // always send end_headers flag
     TEST_ASSERT_EQUAL(FRAME_FLAGS_END_HEADERS,
                       buffer_put_u8_fake.arg1_history[1]);
@@ -199,7 +219,7 @@ void test_send_headers_frame(void)
     TEST_ASSERT_EQUAL(11, buffer_put_u31_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 17, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 17, event_write_commit_fake.arg1_val);
 }
 
 void test_send_headers_end_stream(void)
@@ -224,7 +244,7 @@ void test_send_headers_end_stream(void)
     TEST_ASSERT_EQUAL(11, buffer_put_u31_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 17, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 17, event_write_commit_fake.arg1_val);
 }
 
 void test_send_headers_hpack_error(void)
@@ -239,7 +259,7 @@ void test_send_headers_hpack_error(void)
     TEST_ASSERT_EQUAL(-3, res);
 
     // check that write is never called
-    TEST_ASSERT_EQUAL(0, event_write_fake.call_count);
+    TEST_ASSERT_EQUAL(0, event_write_commit_fake.call_count);
 }
 
 void test_send_window_update_frame(void)
@@ -263,7 +283,7 @@ void test_send_window_update_frame(void)
     TEST_ASSERT_EQUAL(137, buffer_put_u31_fake.arg1_history[1]);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 4, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 4, event_write_commit_fake.arg1_val);
 }
 
 void test_send_rst_stream_frame(void)
@@ -287,7 +307,7 @@ void test_send_rst_stream_frame(void)
     TEST_ASSERT_EQUAL(0x9, buffer_put_u32_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 4, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 4, event_write_commit_fake.arg1_val);
 }
 
 void test_send_data_frame(void)
@@ -311,7 +331,7 @@ void test_send_data_frame(void)
     TEST_ASSERT_EQUAL(11, buffer_put_u31_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 127, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 127, event_write_commit_fake.arg1_val);
 }
 
 void test_send_data_end_stream(void)
@@ -336,7 +356,60 @@ void test_send_data_end_stream(void)
     TEST_ASSERT_EQUAL(11, buffer_put_u31_fake.arg1_val);
 
     // total write size is header + frame size
-    TEST_ASSERT_EQUAL(9 + 127, event_write_fake.arg1_val);
+    TEST_ASSERT_EQUAL(9 + 127, event_write_commit_fake.arg1_val);
+}
+
+void test_send_data_frame_no_space(void)
+{
+    uint8_t data[127];
+    memset(data, 0, 127);
+
+    // the frame is not queued if it does not fit
+    event_write_reserve_fake.return_val = NULL;
+    TEST_ASSERT_EQUAL(-1, send_data_frame(NULL, data, 127, 11, 0, NULL));
+    TEST_ASSERT_EQUAL(9 + 127, event_write_reserve_fake.arg1_val);
+    TEST_ASSERT_EQUAL(0, event_write_commit_fake.call_count);
+}
+
+void test_send_data_frame_file(void)
+{
+    event_sendfile_fake.return_val = 1000;
+
+    // send 1000 bytes from offset 24 of fd 7
+    int res = send_data_frame_file(NULL, 7, 24, 1000, 11, 1, NULL);
+    TEST_ASSERT_EQUAL(9 + 1000, res);
+
+    // length is the size read from the file
+    TEST_ASSERT_EQUAL(1000, buffer_put_u24_fake.arg1_val);
+    TEST_ASSERT_EQUAL(FRAME_DATA_TYPE, buffer_put_u8_fake.arg1_history[0]);
+    TEST_ASSERT_EQUAL(FRAME_FLAGS_END_STREAM,
+                      buffer_put_u8_fake.arg1_history[1]);
+
+    // only the header is copied to the write buffer, the
+    // file operation notifies the callback
+    TEST_ASSERT_EQUAL(9, event_write_commit_fake.arg1_val);
+    TEST_ASSERT_NULL(event_write_commit_fake.arg2_val);
+    TEST_ASSERT_EQUAL(1, event_sendfile_fake.call_count);
+    TEST_ASSERT_EQUAL(7, event_sendfile_fake.arg1_val);
+    TEST_ASSERT_EQUAL(24, event_sendfile_fake.arg2_val);
+    TEST_ASSERT_EQUAL(1000, event_sendfile_fake.arg3_val);
+}
+
+void test_send_data_frame_file_header_error(void)
+{
+    // not enough contiguous space for the frame header
+    event_write_contiguous_fake.return_val = 4;
+
+    int res = send_data_frame_file(NULL, 7, 0, 1000, 11, 0, NULL);
+    TEST_ASSERT_EQUAL(-1, res);
+    TEST_ASSERT_EQUAL(0, event_write_reserve_fake.call_count);
+    TEST_ASSERT_EQUAL(0, event_sendfile_fake.call_count);
+
+    // a header without payload is never queued
+    event_write_contiguous_fake.return_val = sizeof(write_buf);
+    res = send_data_frame_file(NULL, 7, 0, 0, 11, 1, NULL);
+    TEST_ASSERT_EQUAL(-1, res);
+    TEST_ASSERT_EQUAL(0, event_write_commit_fake.call_count);
 }
 
 int main(void)
@@ -354,5 +427,8 @@ int main(void)
     UNIT_TEST(test_send_rst_stream_frame);
     UNIT_TEST(test_send_data_frame);
     UNIT_TEST(test_send_data_end_stream);
+    UNIT_TEST(test_send_data_frame_no_space);
+    UNIT_TEST(test_send_data_frame_file);
+    UNIT_TEST(test_send_data_frame_file_header_error);
     return UNITY_END();
 }
@@ -49,6 +49,8 @@ FAKE_VALUE_FUNC(int,
                 hpack_tables_find_index_name,
                 hpack_dynamic_table_t *,
                 char *);
+FAKE_VALUE_FUNC(int, hpack_tables_static_find_index, char *, char *);
+FAKE_VALUE_FUNC(int, hpack_tables_static_find_index_name, char *);
 FAKE_VALUE_FUNC(int8_t,
                 hpack_tables_dynamic_table_add_entry,
                 hpack_dynamic_table_t *,
@@ -70,6 +72,8 @@ FAKE_VALUE_FUNC(http_header_t *,
     FAKE(hpack_utils_encoded_integer_size)                                     \
     FAKE(hpack_tables_find_index)                                              \
     FAKE(hpack_tables_find_index_name)                                         \
+    FAKE(hpack_tables_static_find_index)                                       \
+    FAKE(hpack_tables_static_find_index_name)                                  \
     FAKE(hpack_tables_dynamic_table_add_entry)                                 \
     FAKE(hpack_tables_dynamic_table_resize)                                    \
     FAKE(hpack_huffman_encode)                                                 \
@@ -799,6 +803,41 @@ void test_encode_literal_header_field_indexed_name_error(void)
     TEST_ASSERT_EQUAL(-1, rc);
 }
 
+void test_encode_static_indexed_header_field(void)
+{
+    uint8_t encoded_buffer[] = { 0 };
+
+    hpack_tables_static_find_index_fake.return_val   = 8;
+    hpack_utils_find_prefix_size_fake.return_val     = 7;
+    hpack_utils_encoded_integer_size_fake.return_val = 1;
+
+    int rc = hpack_encoder_encode_static(":status", "200", encoded_buffer, 1);
+    TEST_ASSERT_EQUAL(1, rc);
+    TEST_ASSERT_EQUAL(0x88, encoded_buffer[0]);
+
+    // the dynamic table is never used
+    TEST_ASSERT_EQUAL(0, hpack_tables_find_index_fake.call_count);
+    TEST_ASSERT_EQUAL(0, hpack_tables_dynamic_table_add_entry_fake.call_count);
+}
+
+void test_encode_content_length(void)
+{
+    uint8_t expected_encoded[] = { 0x0f, 0x0d, 0x03, '5', '1', '2' };
+    uint8_t encoded_buffer[6];
+
+    memset(encoded_buffer, 0, 6);
+    hpack_utils_encoded_integer_size_fake.return_val = 2;
+    int rc = hpack_encoder_encode_content_length(512, encoded_buffer, 6);
+    TEST_ASSERT_EQUAL(6, rc);
+    for (int i = 0; i < rc; i++) {
+        TEST_ASSERT_EQUAL(expected_encoded[i], encoded_buffer[i]);
+    }
+
+    // buffer too small
+    rc = hpack_encoder_encode_content_length(512, encoded_buffer, 5);
+    TEST_ASSERT_LESS_THAN(0, rc);
+}
+
 #if HPACK_INCLUDE_DYNAMIC_TABLE
 void test_encode_dynamic_size_update(void)
 {
@@ -845,6 +884,8 @@ int main(void)
     UNIT_TEST(test_encode_literal_header_field_indexed_name);
     UNIT_TEST(test_encode_literal_header_field_indexed_name_error);
     UNIT_TEST(test_encode_indexed_header_field);
+    UNIT_TEST(test_encode_static_indexed_header_field);
+    UNIT_TEST(test_encode_content_length);
 #if HPACK_INCLUDE_DYNAMIC_TABLE
     UNIT_TEST(test_encode_dynamic_size_update);
 #endif
@@ -5,6 +5,8 @@
 
 extern int hpack_tables_find_index(hpack_dynamic_table_t *dynamic_table, char *name, char *value);
 extern int hpack_tables_find_index_name(hpack_dynamic_table_t *dynamic_table, char *name);
+extern int hpack_tables_static_find_index(char *name, char *value);
+extern int hpack_tables_static_find_index_name(char *name);
 extern const hpack_static_table_t hpack_static_table;
 extern int8_t hpack_tables_static_find_entry_name_and_value(uint8_t index, char *name, char *value);
 extern int8_t hpack_tables_static_find_entry_name(uint8_t index, char *name);
@@ -275,6 +277,20 @@ void test_hpack_tables_find_index_name_error(void)
 
 }
 
+void test_hpack_tables_static_find_index(void)
+{
+    TEST_ASSERT_EQUAL(8, hpack_tables_static_find_index(":status", "200"));
+    TEST_ASSERT_EQUAL(13, hpack_tables_static_find_index(":status", "404"));
+    TEST_ASSERT_EQUAL(61,
+                      hpack_tables_static_find_index("www-authenticate", ""));
+    TEST_ASSERT_EQUAL(-2, hpack_tables_static_find_index(":status", "201"));
+
+    TEST_ASSERT_EQUAL(28,
+                      hpack_tables_static_find_index_name("content-length"));
+    TEST_ASSERT_EQUAL(31, hpack_tables_static_find_index_name("content-type"));
+    TEST_ASSERT_EQUAL(-2, hpack_tables_static_find_index_name("content"));
+}
+
 void test_hpack_tables_static_find_entry_name_and_value(void)
 {
     char *expected_name[] = { ":authority", ":method", ":method", "accept-encoding", ":status", "content-range", "if-unmodified-since" };
@@ -689,6 +705,7 @@ int main(void)
     UNIT_TEST(test_hpack_tables_find_index_error);
     UNIT_TEST(test_hpack_tables_find_index_name);
     UNIT_TEST(test_hpack_tables_find_index_name_error);
+    UNIT_TEST(test_hpack_tables_static_find_index);
     UNIT_TEST(test_hpack_tables_static_find_entry_name_and_value);
     UNIT_TEST(test_hpack_tables_static_find_entry_name);
     UNIT_TEST(test_hpack_tables_find_entry);
@@ -8,6 +8,8 @@ extern int waiting_for_settings(event_sock_t *sock, int size, uint8_t *buf);
 extern int receiving(event_sock_t *sock, int size, uint8_t *buf);
 extern void http2_on_client_close(event_sock_t *sock);
 extern void on_settings_sent(event_sock_t *sock, int status);
+extern void on_stream_send_complete(event_sock_t *sock, int status);
+extern void http2_on_writable(event_sock_t *sock);
 extern int receiving(event_sock_t *client, int size, uint8_t *buf);
 
 DEFINE_FFF_GLOBALS;
@@ -24,11 +26,16 @@ FAKE_VOID_FUNC(event_timer_stop, event_t *);
 FAKE_VALUE_FUNC(int, event_close, event_sock_t *, event_close_cb);
 FAKE_VALUE_FUNC(int, event_read, event_sock_t *, event_read_cb);
 FAKE_VALUE_FUNC(int, event_read_stop, event_sock_t *);
+FAKE_VALUE_FUNC(int, close, int);
 FAKE_VALUE_FUNC(event_t *,
                 event_timer_set,
                 event_sock_t *,
                 unsigned int,
                 event_timer_cb);
+FAKE_VALUE_FUNC(uint32_t, event_time_ms);
+FAKE_VALUE_FUNC(int, event_write_space, event_sock_t *);
+FAKE_VALUE_FUNC(int, event_write_contiguous, event_sock_t *);
+FAKE_VOID_FUNC(event_write_wait, event_sock_t *, event_writable_cb);
 
 // hpack fakes
 FAKE_VOID_FUNC(hpack_init, hpack_dynamic_table_t *, uint32_t);
@@ -41,6 +48,17 @@ FAKE_VALUE_FUNC(int,
                 uint8_t *,
                 int,
                 header_list_t *);
+FAKE_VALUE_FUNC(int,
+                hpack_encode_static,
+                char *,
+                char *,
+                uint8_t *,
+                uint32_t);
+FAKE_VALUE_FUNC(int,
+                hpack_encode_content_length,
+                uint32_t,
+                uint8_t *,
+                uint32_t);
 
 // frame fakes
 FAKE_VALUE_FUNC(int, frame_header_to_bytes, frame_header_t *, uint8_t *);
@@ -63,6 +81,12 @@ FAKE_VALUE_FUNC(int,
                 uint8_t *,
                 int,
                 event_write_cb);
+FAKE_VALUE_FUNC(int,
+                send_window_update_frame,
+                event_sock_t *,
+                uint32_t,
+                uint32_t,
+                event_write_cb);
 FAKE_VALUE_FUNC(int,
                 send_rst_stream_frame,
                 event_sock_t *,
@@ -70,10 +94,10 @@ FAKE_VALUE_FUNC(int,
                 uint32_t,
                 event_write_cb);
 FAKE_VALUE_FUNC(int,
-                send_headers_frame,
+                send_header_block_frame,
                 event_sock_t *,
-                header_list_t *,
-                hpack_dynamic_table_t *,
+                uint8_t *,
+                uint32_t,
                 uint32_t,
                 uint8_t,
                 event_write_cb);
@@ -85,6 +109,15 @@ FAKE_VALUE_FUNC(int,
                 uint32_t,
                 uint8_t,
                 event_write_cb);
+FAKE_VALUE_FUNC(int,
+                send_data_frame_file,
+                event_sock_t *,
+                int,
+                off_t,
+                uint32_t,
+                uint32_t,
+                uint8_t,
+                event_write_cb);
 
 // header list fakes
 FAKE_VALUE_FUNC(char *, header_list_get, header_list_t *, const char *);
@@ -103,6 +136,15 @@ FAKE_VALUE_FUNC(http_header_t *,
 // buffer fakes
 FAKE_VALUE_FUNC(uint32_t, buffer_get_u31, uint8_t *);
 
+// trace fakes
+FAKE_VOID_FUNC(trace_frame,
+               uint8_t,
+               uint8_t,
+               uint8_t,
+               uint8_t,
+               uint32_t,
+               uint32_t);
+
 // http fakes
 FAKE_VOID_FUNC(http_handle_request,
                http_request_t *,
@@ -113,28 +155,38 @@ FAKE_VOID_FUNC(http_handle_request,
     FAKE(event_read_start)                                                     \
     FAKE(event_write_enable)                                                   \
     FAKE(event_close)                                                          \
+    FAKE(close)                                                                \
     FAKE(event_read_stop)                                                      \
     FAKE(event_read)                                                           \
     FAKE(event_timer_reset)                                                    \
     FAKE(event_timer_stop)                                                     \
     FAKE(event_timer_set)                                                      \
+    FAKE(event_time_ms)                                                        \
+    FAKE(event_write_space)                                                    \
+    FAKE(event_write_contiguous)                                               \
+    FAKE(event_write_wait)                                                     \
     FAKE(hpack_init)                                                           \
     FAKE(hpack_dynamic_change_max_size)                                        \
     FAKE(hpack_decode)                                                         \
+    FAKE(hpack_encode_static)                                                  \
+    FAKE(hpack_encode_content_length)                                          \
     FAKE(frame_header_to_bytes)                                                \
     FAKE(frame_parse_header)                                                   \
     FAKE(send_goaway_frame)                                                    \
     FAKE(send_settings_frame)                                                  \
     FAKE(send_ping_frame)                                                      \
+    FAKE(send_window_update_frame)                                             \
     FAKE(send_rst_stream_frame)                                                \
-    FAKE(send_headers_frame)                                                   \
+    FAKE(send_header_block_frame)                                              \
     FAKE(send_data_frame)                                                      \
+    FAKE(send_data_frame_file)                                                 \
     FAKE(buffer_get_u31)                                                       \
     FAKE(header_list_reset)                                                    \
     FAKE(header_list_count)                                                    \
     FAKE(header_list_all)                                                      \
     FAKE(header_list_set)                                                      \
     FAKE(header_list_get)                                                      \
+    FAKE(trace_frame)                                                          \
     FAKE(http_handle_request)
 
 void setUp()
@@ -144,6 +196,10 @@ void setUp()
 
     /* reset common FFF internal structures */
     FFF_RESET_HISTORY();
+
+    // the write buffer is empty by default
+    event_write_space_fake.return_val      = HTTP2_SOCK_WRITE_SIZE;
+    event_write_contiguous_fake.return_val = HTTP2_SOCK_WRITE_SIZE;
 }
 
 uint32_t read_u31(uint8_t *bytes)
@@ -260,8 +316,10 @@ void test_settings_sent(void)
 
     on_settings_sent(&client, 0);
 
-    // check that ack timer has been set
-    TEST_ASSERT_EQUAL(1, event_timer_set_fake.call_count);
+    // check that ack timer has been set after the preface timer
+    TEST_ASSERT_EQUAL(2, event_timer_set_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_PREFACE_TIMEOUT,
+                      event_timer_set_fake.arg1_history[0]);
     TEST_ASSERT_EQUAL(HTTP2_SETTINGS_WAIT, event_timer_set_fake.arg1_val);
 
     // close client
@@ -855,6 +913,9 @@ void test_recv_settings_ack(void)
     // "send" preface to trigger the server sending settings
     TEST_ASSERT_EQUAL(24, waiting_for_preface(&client, 24, buf));
 
+    // the preface timer is stopped
+    TEST_ASSERT_EQUAL(1, event_timer_stop_fake.call_count);
+
     // simulate write callback call
     // TODO: it does not hurt if the server sets the timer immediately after
     // calling event_write and it prevents having to do this in testing
@@ -883,17 +944,32 @@ void test_recv_settings_ack(void)
     TEST_ASSERT_EQUAL(9, receiving(&client, 9, res));
 
     // the server should stop the ACK timer
-    TEST_ASSERT_EQUAL(1, event_timer_stop_fake.call_count);
+    TEST_ASSERT_EQUAL(2, event_timer_stop_fake.call_count);
 
     // close client
     http2_on_client_close(&client);
 }
 
+void test_http_handle_request(http_request_t *req,
+                              http_response_t *res,
+                              unsigned int maxlen)
+{
+    (void)req;
+    (void)maxlen;
+    res->status         = 200;
+    res->content_type   = "text/plain";
+    res->content_length = 0;
+}
+
 void test_handle_get_request(void)
 {
     event_sock_t client;
     http2_new_client(&client);
 
+    // respond with 200 and text/plain
+    http_handle_request_fake.custom_fake = test_http_handle_request;
+    hpack_encode_static_fake.return_val  = 1;
+
     // use custom header parsing function
     frame_parse_header_fake.custom_fake = parse_header;
 
@@ -925,16 +1001,729 @@ void test_handle_get_request(void)
     // check that http api is called
     TEST_ASSERT_EQUAL(1, http_handle_request_fake.call_count);
 
+    // :status and content-type are encoded into the header cache
+    TEST_ASSERT_EQUAL(2, hpack_encode_static_fake.call_count);
+    TEST_ASSERT_EQUAL(1, hpack_encode_content_length_fake.call_count);
+
     // check that headers frame is sent
-    TEST_ASSERT_EQUAL(1, send_headers_frame_fake.call_count);
-    TEST_ASSERT_EQUAL(1, send_headers_frame_fake.arg3_val); // stream_id == 1
+    TEST_ASSERT_EQUAL(1, send_header_block_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, send_header_block_frame_fake.arg3_val); // stream_id
     TEST_ASSERT_EQUAL(
-      1, send_headers_frame_fake.arg4_val); // no data so the stream is closing
+      1,
+      send_header_block_frame_fake.arg4_val); // no data so the stream closes
 
     // close client
     http2_on_client_close(&client);
 }
 
+void test_http_handle_request_400(http_request_t *req,
+                                  http_response_t *res,
+                                  unsigned int maxlen)
+{
+    (void)req;
+    (void)maxlen;
+    res->status         = 200;
+    res->content_type   = "text/plain";
+    res->content_length = 400;
+}
+
+void test_handle_get_request_paced(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    http_handle_request_fake.custom_fake    = test_http_handle_request_400;
+    hpack_encode_static_fake.return_val     = 1;
+    send_header_block_frame_fake.return_val = 10;
+    send_data_frame_fake.return_val         = 1;
+
+    frame_parse_header_fake.custom_fake = parse_header;
+    header_list_get_fake.custom_fake    = test_header_list_get;
+    header_list_count_fake.return_val   = 2;
+
+    uint8_t headers[9 + 1] = { 0,
+                               0,
+                               1,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                               0x80,
+                               0,
+                               0,
+                               1,
+                               75 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, headers));
+
+    // DATA is limited to the space left in the write buffer
+    event_write_space_fake.return_val = 200;
+    on_stream_send_complete(&client, 0);
+    TEST_ASSERT_EQUAL(1, send_data_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(200 - 9 - 34, send_data_frame_fake.arg2_val);
+    TEST_ASSERT_EQUAL(0, send_data_frame_fake.arg4_val);
+
+    // wait until the buffer drains
+    event_write_space_fake.return_val = 20;
+    on_stream_send_complete(&client, 0);
+    TEST_ASSERT_EQUAL(1, send_data_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, event_write_wait_fake.call_count);
+
+    // the frame is encoded in place, so it is also limited to the
+    // space left before the end of the buffer
+    event_write_space_fake.return_val      = HTTP2_SOCK_WRITE_SIZE;
+    event_write_contiguous_fake.return_val = 100;
+    event_write_wait_fake.arg1_val(&client);
+    TEST_ASSERT_EQUAL(2, send_data_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(100 - 9, send_data_frame_fake.arg2_val);
+    event_write_contiguous_fake.return_val = HTTP2_SOCK_WRITE_SIZE;
+
+    // the rest of the response is sent once writable
+    on_stream_send_complete(&client, 0);
+    TEST_ASSERT_EQUAL(3, send_data_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(400 - 157 - 91, send_data_frame_fake.arg2_val);
+    TEST_ASSERT_EQUAL(1, send_data_frame_fake.arg4_val);
+
+    http2_on_client_close(&client);
+}
+
+void test_http_handle_request_file(http_request_t *req,
+                                   http_response_t *res,
+                                   unsigned int maxlen)
+{
+    (void)req;
+    (void)maxlen;
+    res->status         = 200;
+    res->content_type   = "text/html";
+    res->content_length = 20000;
+    res->fd             = 5;
+}
+
+void test_handle_get_request_file(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    // respond with a file larger than max_frame_size
+    http_handle_request_fake.custom_fake = test_http_handle_request_file;
+    hpack_encode_static_fake.return_val  = 1;
+    send_header_block_frame_fake.return_val = 10;
+    send_data_frame_file_fake.return_val    = 9;
+
+    frame_parse_header_fake.custom_fake = parse_header;
+    header_list_get_fake.custom_fake    = test_header_list_get;
+    header_list_count_fake.return_val   = 2;
+
+    uint8_t headers[9 + 1] = { 0,
+                               0,
+                               1,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                               0x80,
+                               0,
+                               0,
+                               3,
+                               75 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, headers));
+
+    // the stream stays open for the file data
+    TEST_ASSERT_EQUAL(1, send_header_block_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(0, send_header_block_frame_fake.arg4_val);
+
+    // after the headers, the first chunk is limited by max_frame_size
+    on_stream_send_complete(&client, 0);
+    TEST_ASSERT_EQUAL(1, send_data_frame_file_fake.call_count);
+    TEST_ASSERT_EQUAL(5, send_data_frame_file_fake.arg1_val);
+    TEST_ASSERT_EQUAL(0, send_data_frame_file_fake.arg2_val);
+    TEST_ASSERT_EQUAL(16384, send_data_frame_file_fake.arg3_val);
+    TEST_ASSERT_EQUAL(0, send_data_frame_file_fake.arg5_val);
+
+    // only one chunk is queued at a time
+    on_stream_send_complete(&client, 0);
+    TEST_ASSERT_EQUAL(1, send_data_frame_file_fake.call_count);
+
+    // the last chunk ends the stream
+    send_data_frame_file_fake.arg6_val(&client, 0);
+    TEST_ASSERT_EQUAL(2, send_data_frame_file_fake.call_count);
+    TEST_ASSERT_EQUAL(16384, send_data_frame_file_fake.arg2_val);
+    TEST_ASSERT_EQUAL(20000 - 16384, send_data_frame_file_fake.arg3_val);
+    TEST_ASSERT_EQUAL(1, send_data_frame_file_fake.arg5_val);
+    TEST_ASSERT_EQUAL(0, close_fake.call_count);
+
+    // the file is closed once it is sent
+    send_data_frame_file_fake.arg6_val(&client, 0);
+    TEST_ASSERT_EQUAL(1, close_fake.call_count);
+    TEST_ASSERT_EQUAL(5, close_fake.arg0_val);
+
+    http2_on_client_close(&client);
+    TEST_ASSERT_EQUAL(1, close_fake.call_count);
+}
+
+void test_handle_get_request_file_encode_error(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    // the response file is opened but the headers cannot be encoded
+    http_handle_request_fake.custom_fake = test_http_handle_request_file;
+    hpack_encode_static_fake.return_val  = 1;
+    hpack_encode_content_length_fake.return_val = -1;
+
+    frame_parse_header_fake.custom_fake = parse_header;
+    header_list_get_fake.custom_fake    = test_header_list_get;
+    header_list_count_fake.return_val   = 2;
+
+    uint8_t headers[9 + 1] = { 0,
+                               0,
+                               1,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                               0x80,
+                               0,
+                               0,
+                               3,
+                               75 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, headers));
+    TEST_ASSERT_EQUAL(0, send_header_block_frame_fake.call_count);
+    test_http2_error(&client, HTTP2_INTERNAL_ERROR);
+
+    // the file is closed with the connection
+    TEST_ASSERT_EQUAL(0, close_fake.call_count);
+    http2_on_client_close(&client);
+    TEST_ASSERT_EQUAL(1, close_fake.call_count);
+    TEST_ASSERT_EQUAL(5, close_fake.arg0_val);
+}
+
+void test_handle_headers_no_stream_buffer(void)
+{
+    event_sock_t client1, client2;
+    http2_new_client(&client1);
+    http2_new_client(&client2);
+
+    http_handle_request_fake.custom_fake = test_http_handle_request;
+    hpack_encode_static_fake.return_val  = 1;
+    frame_parse_header_fake.custom_fake  = parse_header;
+    header_list_get_fake.custom_fake     = test_header_list_get;
+    header_list_count_fake.return_val    = 2;
+
+    uint8_t headers[9 + 1] = { 0,
+                               0,
+                               1,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS,
+                               0x80,
+                               0,
+                               0,
+                               1,
+                               75 };
+
+    // the first client keeps the only stream buffer
+    TEST_ASSERT_EQUAL(10, receiving(&client1, 10, headers));
+    TEST_ASSERT_EQUAL(0, hpack_decode_fake.call_count);
+
+    // the stream for the second client is refused, but
+    // the header block is still decoded
+    headers[4] = FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM;
+    TEST_ASSERT_EQUAL(10, receiving(&client2, 10, headers));
+    TEST_ASSERT_EQUAL(1, hpack_decode_fake.call_count);
+    TEST_ASSERT_EQUAL(0, http_handle_request_fake.call_count);
+    TEST_ASSERT_EQUAL(1, send_rst_stream_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_REFUSED_STREAM,
+                      send_rst_stream_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(1, send_rst_stream_frame_fake.arg2_val);
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+
+    // the buffer returns to the pool when the first client closes
+    http2_on_client_close(&client1);
+    headers[8] = 3;
+    TEST_ASSERT_EQUAL(10, receiving(&client2, 10, headers));
+    TEST_ASSERT_EQUAL(1, http_handle_request_fake.call_count);
+    TEST_ASSERT_EQUAL(1, send_header_block_frame_fake.call_count);
+
+    http2_on_client_close(&client2);
+}
+
+void test_receive_data_window_update(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    // the local initial window size applies after the settings ack
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+
+    // open stream 1 without end stream
+    uint8_t frame[9 + 100] = { 0,    0, 1, FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS,
+                               0x80, 0, 0, 1 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, frame));
+
+    // data frame larger than the available bytes
+    memset(frame, 0, sizeof(frame));
+    frame[1] = 0x01; // length 400
+    frame[2] = 0x90;
+    frame[3] = FRAME_DATA_TYPE;
+    frame[8] = 1;
+    TEST_ASSERT_EQUAL(109, receiving(&client, 109, frame));
+
+    // the remaining payload is discarded as it arrives
+    TEST_ASSERT_EQUAL(100, receiving(&client, 100, frame + 9));
+    TEST_ASSERT_EQUAL(100, receiving(&client, 100, frame + 9));
+    TEST_ASSERT_EQUAL(100, receiving(&client, 100, frame + 9));
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(0, send_rst_stream_frame_fake.call_count);
+
+    // a PING is sent to measure the bandwidth-delay product
+    TEST_ASSERT_EQUAL(1, send_ping_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(0, send_ping_frame_fake.arg2_val);
+
+    // more than half of the stream window was used, so it is returned,
+    // the connection window update is coalesced
+    TEST_ASSERT_EQUAL(1, send_window_update_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(400, send_window_update_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(1, send_window_update_frame_fake.arg2_val);
+
+    // the data received in a round trip used most of the window,
+    // so it grows to twice the size of the sample
+    uint8_t ping[9 + 8] = { 0, 0, 8, FRAME_PING_TYPE, FRAME_FLAGS_ACK,
+                            0, 0, 0, 0 };
+    memcpy(ping + 9, "two-ping", 8);
+    TEST_ASSERT_EQUAL(17, receiving(&client, 17, ping));
+    TEST_ASSERT_EQUAL(800, ctx->recv_window_size);
+    TEST_ASSERT_EQUAL(3, send_window_update_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(400, send_window_update_frame_fake.arg1_history[1]);
+    TEST_ASSERT_EQUAL(0, send_window_update_frame_fake.arg2_history[1]);
+    TEST_ASSERT_EQUAL(800 - HTTP2_INITIAL_WINDOW_SIZE,
+                      send_window_update_frame_fake.arg1_history[2]);
+
+    http2_on_client_close(&client);
+}
+
+void test_receive_data_window_update_write_full(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    ctx->state = HTTP2_READY;
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+
+    uint8_t frame[9 + 100] = { 0,    0, 1, FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS,
+                               0x80, 0, 0, 1 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, frame));
+    int32_t recv_window = ctx->stream.recv_window;
+
+    // the window updates do not fit in the write buffer
+    send_window_update_frame_fake.return_val = -1;
+    memset(frame, 0, sizeof(frame));
+    frame[1] = 0x01; // length 400
+    frame[2] = 0x90;
+    frame[3] = FRAME_DATA_TYPE;
+    frame[8] = 1;
+    TEST_ASSERT_EQUAL(109, receiving(&client, 109, frame));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(100, receiving(&client, 100, frame + 9));
+    }
+    TEST_ASSERT_EQUAL(recv_window - 400, ctx->stream.recv_window);
+    TEST_ASSERT_EQUAL(http2_on_writable, event_write_wait_fake.arg1_val);
+
+    // they are sent once the buffer drains
+    send_window_update_frame_fake.return_val = 13;
+    unsigned int sent = send_window_update_frame_fake.call_count;
+    event_write_wait_fake.arg1_val(&client);
+    TEST_ASSERT_EQUAL(sent + 1, send_window_update_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(400, send_window_update_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(1, send_window_update_frame_fake.arg2_val);
+    TEST_ASSERT_EQUAL(recv_window, ctx->stream.recv_window);
+
+    http2_on_client_close(&client);
+}
+
+void test_recv_ping_write_full(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+    ctx->state                          = HTTP2_READY;
+
+    // the ACK does not fit, so the PING is not consumed
+    uint8_t ping[9 + 8] = { 0, 0, 8, FRAME_PING_TYPE, 0, 0, 0, 0, 0 };
+    memcpy(ping + 9, "ping-ack", 8);
+    send_ping_frame_fake.return_val = -1;
+    TEST_ASSERT_EQUAL(0, receiving(&client, 17, ping));
+    TEST_ASSERT_EQUAL(1, event_write_wait_fake.call_count);
+    TEST_ASSERT_EQUAL(http2_on_writable, event_write_wait_fake.arg1_val);
+
+    // and is processed again once the write buffer drains
+    send_ping_frame_fake.return_val = 17;
+    event_write_wait_fake.arg1_val(&client);
+    TEST_ASSERT_EQUAL(1, event_read_fake.call_count);
+    TEST_ASSERT_EQUAL(receiving, event_read_fake.arg1_val);
+    TEST_ASSERT_EQUAL(17, receiving(&client, 17, ping));
+    TEST_ASSERT_EQUAL(2, send_ping_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, send_ping_frame_fake.arg2_val);
+
+    http2_on_client_close(&client);
+}
+
+void test_goaway_write_full(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+    ctx->state           = HTTP2_READY;
+
+    // the connection is closed if the GOAWAY does not fit
+    send_goaway_frame_fake.return_val = -1;
+    http2_error(ctx, HTTP2_PROTOCOL_ERROR);
+    TEST_ASSERT_EQUAL(1, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_CLOSED, ctx->state);
+
+    http2_on_client_close(&client);
+}
+
+void test_keepalive_ping(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    // the connection timer starts after the settings ack
+    ctx->state = HTTP2_READY;
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+    TEST_ASSERT_EQUAL(3, event_timer_set_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_TIMER_TICK, event_timer_set_fake.arg1_val);
+    event_timer_cb on_timer = event_timer_set_fake.arg2_val;
+
+    // a stream is open so the idle deadline does not apply
+    ctx->stream.state = HTTP2_STREAM_OPEN;
+
+    // a PING is sent once the connection was idle for the interval
+    int ticks = HTTP2_PING_INTERVAL / HTTP2_TIMER_TICK;
+    for (int i = 0; i < ticks - 1; i++) {
+        TEST_ASSERT_EQUAL(0, on_timer(&client));
+    }
+    TEST_ASSERT_EQUAL(0, send_ping_frame_fake.call_count);
+
+    event_time_ms_fake.return_val = 1000;
+    TEST_ASSERT_EQUAL(0, on_timer(&client));
+    TEST_ASSERT_EQUAL(1, send_ping_frame_fake.call_count);
+
+    // the ack gives the round trip time
+    uint8_t ping[9 + 8] = { 0, 0, 8, FRAME_PING_TYPE, FRAME_FLAGS_ACK,
+                            0, 0, 0, 0 };
+    memcpy(ping + 9, "two-ping", 8);
+    event_time_ms_fake.return_val = 1040;
+    TEST_ASSERT_EQUAL(17, receiving(&client, 17, ping));
+    TEST_ASSERT_EQUAL(40, ctx->rtt);
+
+    // the ack counts as activity, so the next ping waits
+    // for another interval
+    for (int i = 0; i < ticks; i++) {
+        TEST_ASSERT_EQUAL(0, on_timer(&client));
+    }
+    TEST_ASSERT_EQUAL(2, send_ping_frame_fake.call_count);
+
+    // the peer did not reply within the timeout
+    uint32_t reaped = http2_get_reap_counts()->ping;
+    for (int i = 0; i < HTTP2_PING_TIMEOUT / HTTP2_TIMER_TICK - 1; i++) {
+        TEST_ASSERT_EQUAL(0, on_timer(&client));
+    }
+    TEST_ASSERT_EQUAL(0, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(1, on_timer(&client));
+    TEST_ASSERT_EQUAL(1, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->ping);
+
+    http2_on_client_close(&client);
+}
+
+void test_new_client_refused(void)
+{
+    event_sock_t clients[HTTP2_MAX_CLIENTS];
+    for (int i = 0; i < HTTP2_MAX_CLIENTS; i++) {
+        TEST_ASSERT_NOT_NULL(http2_new_client(&clients[i]));
+    }
+
+    // the server is full, so the client is told to retry
+    event_sock_t client;
+    uint32_t reaped = http2_get_reap_counts()->refused;
+    TEST_ASSERT_NULL(http2_new_client(&client));
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->refused);
+    TEST_ASSERT_EQUAL(1, send_settings_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(0, send_settings_frame_fake.arg1_val); // not an ack
+    TEST_ASSERT_EQUAL(1, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_REFUSED_STREAM, send_goaway_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.arg2_val);
+
+    // data sent by the client is discarded
+    event_read_cb on_read = event_read_start_fake.arg3_val;
+    TEST_ASSERT_EQUAL(24, on_read(&client, 24, (uint8_t *)"PRI"));
+
+    // the connection is closed once GOAWAY is sent
+    TEST_ASSERT_EQUAL(0, event_close_fake.call_count);
+    send_goaway_frame_fake.arg3_val(&client, 0);
+    TEST_ASSERT_EQUAL(1, event_close_fake.call_count);
+
+    // the refusal buffer is released on close
+    event_close_fake.arg1_val(&client);
+    TEST_ASSERT_NULL(http2_new_client(&client));
+    TEST_ASSERT_EQUAL(2, send_goaway_frame_fake.call_count);
+    event_close_fake.arg1_val(&client);
+
+    for (int i = 0; i < HTTP2_MAX_CLIENTS; i++) {
+        http2_on_client_close(&clients[i]);
+    }
+}
+
+void test_preface_timeout(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    TEST_ASSERT_EQUAL(1, event_timer_set_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_PREFACE_TIMEOUT, event_timer_set_fake.arg1_val);
+
+    // the connection is closed without GOAWAY
+    uint32_t reaped = http2_get_reap_counts()->preface;
+    TEST_ASSERT_EQUAL(1, event_timer_set_fake.arg2_val(&client));
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->preface);
+
+    http2_on_client_close(&client);
+}
+
+void test_headers_timeout(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    ctx->state = HTTP2_READY;
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+    event_timer_cb on_timer = event_timer_set_fake.arg2_val;
+
+    // header block without END_HEADERS
+    uint8_t headers[9 + 1] = { 0, 0, 1, FRAME_HEADERS_TYPE, 0, 0, 0, 0, 1 };
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, headers));
+
+    // the CONTINUATION frame never arrives
+    uint32_t reaped = http2_get_reap_counts()->headers;
+    for (int i = 0; i < HTTP2_HEADERS_TIMEOUT / HTTP2_TIMER_TICK - 1; i++) {
+        TEST_ASSERT_EQUAL(0, on_timer(&client));
+    }
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, on_timer(&client));
+    TEST_ASSERT_EQUAL(1, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_ENHANCE_YOUR_CALM, send_goaway_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->headers);
+
+    http2_on_client_close(&client);
+}
+
+void test_idle_timeout(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    ctx->state = HTTP2_READY;
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+    event_timer_cb on_timer = event_timer_set_fake.arg2_val;
+
+    // the client replies to keepalive pings but opens no streams
+    uint8_t ping[9 + 8] = { 0, 0, 8, FRAME_PING_TYPE, FRAME_FLAGS_ACK,
+                            0, 0, 0, 0 };
+    memcpy(ping + 9, "two-ping", 8);
+    uint32_t reaped = http2_get_reap_counts()->idle;
+    for (int i = 0; i < HTTP2_IDLE_TIMEOUT / HTTP2_TIMER_TICK - 1; i++) {
+        unsigned int pings = send_ping_frame_fake.call_count;
+        TEST_ASSERT_EQUAL(0, on_timer(&client));
+        if (send_ping_frame_fake.call_count > pings) {
+            TEST_ASSERT_EQUAL(17, receiving(&client, 17, ping));
+        }
+    }
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(1, on_timer(&client));
+    TEST_ASSERT_EQUAL(1, send_goaway_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_NO_ERROR, send_goaway_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->idle);
+
+    http2_on_client_close(&client);
+}
+
+void test_closing_timeout(void)
+{
+    event_sock_t client;
+    http2_context_t *ctx = http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+
+    ctx->state = HTTP2_READY;
+    on_settings_sent(&client, 0);
+    uint8_t ack[9] = { 0, 0, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK,
+                       0, 0, 0, 0 };
+    TEST_ASSERT_EQUAL(9, receiving(&client, 9, ack));
+    event_timer_cb on_timer = event_timer_set_fake.arg2_val;
+
+    // the GOAWAY is queued but never sent
+    http2_error(ctx, HTTP2_PROTOCOL_ERROR);
+    TEST_ASSERT_EQUAL(HTTP2_CLOSING, ctx->state);
+
+    uint32_t reaped = http2_get_reap_counts()->closing;
+    TEST_ASSERT_EQUAL(0, on_timer(&client));
+    TEST_ASSERT_EQUAL(0, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(1, on_timer(&client));
+    TEST_ASSERT_EQUAL(1, event_close_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_CLOSED, ctx->state);
+    TEST_ASSERT_EQUAL(reaped + 1, http2_get_reap_counts()->closing);
+
+    http2_on_client_close(&client);
+}
+
+void test_handle_get_request_cached_headers(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake         = parse_header;
+    header_list_get_fake.custom_fake            = test_header_list_get;
+    header_list_count_fake.return_val           = 2;
+    http_handle_request_fake.custom_fake        = test_http_handle_request;
+    hpack_encode_static_fake.return_val         = 1;
+    hpack_encode_content_length_fake.return_val = 3;
+
+    uint8_t headers[9 + 1] = { 0,
+                               0,
+                               1,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                               0x80,
+                               0,
+                               0,
+                               1,
+                               75 };
+
+    TEST_ASSERT_EQUAL(10, receiving(&client, 10, headers));
+
+    // the header block prefix was encoded by the previous request
+    TEST_ASSERT_EQUAL(0, hpack_encode_static_fake.call_count);
+    TEST_ASSERT_EQUAL(1, hpack_encode_content_length_fake.call_count);
+
+    // prefix (2 bytes) + content-length (3 bytes)
+    TEST_ASSERT_EQUAL(1, send_header_block_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(5, send_header_block_frame_fake.arg2_val);
+
+    http2_on_client_close(&client);
+}
+
+void test_recv_priority(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake = parse_header;
+    buffer_get_u31_fake.custom_fake     = read_u31;
+
+    // valid priority for an idle stream is ignored
+    uint8_t priority[9 + 5] = { 0, 0, 5, FRAME_PRIORITY_TYPE, 0, 0, 0, 0, 3,
+                                0, 0, 0, 1, 15 };
+    TEST_ASSERT_EQUAL(14, receiving(&client, 14, priority));
+    TEST_ASSERT_EQUAL(0, send_rst_stream_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+
+    // a stream cannot depend on itself
+    priority[12] = 3;
+    TEST_ASSERT_EQUAL(14, receiving(&client, 14, priority));
+    TEST_ASSERT_EQUAL(1, send_rst_stream_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_PROTOCOL_ERROR,
+                      send_rst_stream_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(3, send_rst_stream_frame_fake.arg2_val);
+
+    // wrong size is a stream error
+    priority[2] = 4;
+    TEST_ASSERT_EQUAL(13, receiving(&client, 13, priority));
+    TEST_ASSERT_EQUAL(2, send_rst_stream_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_FRAME_SIZE_ERROR,
+                      send_rst_stream_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+
+    // priority for stream 0 is a connection error
+    priority[2] = 5;
+    priority[8] = 0;
+    TEST_ASSERT_EQUAL(14, receiving(&client, 14, priority));
+    test_http2_error(&client, HTTP2_PROTOCOL_ERROR);
+
+    http2_on_client_close(&client);
+}
+
+void test_recv_headers_depending_on_itself(void)
+{
+    event_sock_t client;
+    http2_new_client(&client);
+
+    frame_parse_header_fake.custom_fake  = parse_header;
+    buffer_get_u31_fake.custom_fake      = read_u31;
+    http_handle_request_fake.custom_fake = test_http_handle_request;
+
+    uint8_t headers[9 + 6] = { 0,
+                               0,
+                               6,
+                               FRAME_HEADERS_TYPE,
+                               FRAME_FLAGS_END_HEADERS |
+                                 FRAME_FLAGS_END_STREAM |
+                                 FRAME_FLAGS_PRIORITY,
+                               0,
+                               0,
+                               0,
+                               1,
+                               0,
+                               0,
+                               0,
+                               1,
+                               15,
+                               0x82 };
+
+    // the header block is decoded before resetting the stream
+    TEST_ASSERT_EQUAL(15, receiving(&client, 15, headers));
+    TEST_ASSERT_EQUAL(1, hpack_decode_fake.call_count);
+    TEST_ASSERT_EQUAL(1, hpack_decode_fake.arg2_val);
+    TEST_ASSERT_EQUAL(0, http_handle_request_fake.call_count);
+    TEST_ASSERT_EQUAL(1, send_rst_stream_frame_fake.call_count);
+    TEST_ASSERT_EQUAL(HTTP2_PROTOCOL_ERROR,
+                      send_rst_stream_frame_fake.arg1_val);
+    TEST_ASSERT_EQUAL(1, send_rst_stream_frame_fake.arg2_val);
+    TEST_ASSERT_EQUAL(0, send_goaway_frame_fake.call_count);
+
+    // the priority fields do not fit in the frame
+    headers[2]  = 4;
+    headers[8]  = 3;
+    headers[12] = 1;
+    TEST_ASSERT_EQUAL(13, receiving(&client, 13, headers));
+    test_http2_error(&client, HTTP2_PROTOCOL_ERROR);
+
+    http2_on_client_close(&client);
+}
+
 int main(void)
 
 {
@@ -959,5 +1748,22 @@ int main(void)
     UNIT_TEST(test_recv_unexpected_settings_ack);
     UNIT_TEST(test_recv_settings_ack);
     UNIT_TEST(test_handle_get_request);
+    UNIT_TEST(test_handle_get_request_cached_headers);
+    UNIT_TEST(test_handle_get_request_paced);
+    UNIT_TEST(test_handle_get_request_file);
+    UNIT_TEST(test_handle_get_request_file_encode_error);
+    UNIT_TEST(test_handle_headers_no_stream_buffer);
+    UNIT_TEST(test_receive_data_window_update);
+    UNIT_TEST(test_receive_data_window_update_write_full);
+    UNIT_TEST(test_recv_ping_write_full);
+    UNIT_TEST(test_goaway_write_full);
+    UNIT_TEST(test_recv_priority);
+    UNIT_TEST(test_recv_headers_depending_on_itself);
+    UNIT_TEST(test_keepalive_ping);
+    UNIT_TEST(test_new_client_refused);
+    UNIT_TEST(test_preface_timeout);
+    UNIT_TEST(test_headers_timeout);
+    UNIT_TEST(test_idle_timeout);
+    UNIT_TEST(test_closing_timeout);
     return UNITY_END();
 }
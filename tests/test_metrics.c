@@ -0,0 +1,206 @@
+#include <string.h>
+
+#include "metrics.h"
+#include "unit.h"
+
+void setUp(void)
+{
+    metrics_reset();
+}
+
+void test_metrics_counters(void)
+{
+    METRICS_INC(ACCEPTS);
+    METRICS_INC(ACCEPTS);
+    METRICS_INC(CONNECTIONS);
+    METRICS_DEC(CONNECTIONS);
+    METRICS_ADD(BYTES_IN, 100);
+
+    TEST_ASSERT_EQUAL(2, metrics.counters[METRICS_ACCEPTS]);
+    TEST_ASSERT_EQUAL(0, metrics.counters[METRICS_CONNECTIONS]);
+    TEST_ASSERT_EQUAL(100, metrics.counters[METRICS_BYTES_IN]);
+
+    // gauges only keep the largest value
+    METRICS_MAX(WRITE_BUF_MAX, 300);
+    METRICS_MAX(WRITE_BUF_MAX, 200);
+    TEST_ASSERT_EQUAL(300, metrics.counters[METRICS_WRITE_BUF_MAX]);
+
+    // unknown frame types are ignored
+    METRICS_FRAME_IN(0x4);
+    METRICS_FRAME_OUT(0x0);
+    METRICS_FRAME_OUT(0xa);
+    TEST_ASSERT_EQUAL(1, metrics.frames_in[0x4]);
+    TEST_ASSERT_EQUAL(1, metrics.frames_out[0x0]);
+}
+
+void test_metrics_latency(void)
+{
+    metrics_latency(50);
+    metrics_latency(100);
+    metrics_latency(101);
+    metrics_latency(200000);
+
+    TEST_ASSERT_EQUAL(2, metrics.latency_buckets[0]);
+    TEST_ASSERT_EQUAL(1, metrics.latency_buckets[1]);
+    TEST_ASSERT_EQUAL(1, metrics.latency_buckets[METRICS_LATENCY_BUCKETS - 1]);
+    TEST_ASSERT_EQUAL(200251, metrics.latency_sum);
+}
+
+void test_metrics_prometheus(void)
+{
+    char response[512];
+
+    METRICS_INC(ACCEPTS);
+    METRICS_FRAME_IN(0x1);
+    metrics_latency(500);
+
+    int len = metrics_prometheus_handler("GET", "/metrics", response, 512);
+    TEST_ASSERT_EQUAL(strlen(response), len);
+
+    // counters with a 0 value are omitted
+    TEST_ASSERT_NOT_NULL(strstr(response, "two_accepts_total 1\n"));
+    TEST_ASSERT_NULL(strstr(response, "two_rejects_total"));
+    TEST_ASSERT_NOT_NULL(
+      strstr(response, "two_frames_in_total{type=\"HEADERS\"} 1\n"));
+    TEST_ASSERT_NULL(strstr(response, "two_frames_out_total"));
+
+    // buckets are cumulative
+    TEST_ASSERT_NOT_NULL(
+      strstr(response, "two_handler_latency_us_bucket{le=\"100\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(
+      strstr(response, "two_handler_latency_us_bucket{le=\"1000\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(
+      strstr(response, "two_handler_latency_us_bucket{le=\"+Inf\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "two_handler_latency_us_sum 500\n"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "two_handler_latency_us_count 1\n"));
+}
+
+void test_metrics_prometheus_cut(void)
+{
+    char response[32];
+
+    METRICS_INC(ACCEPTS);
+    METRICS_INC(REJECTS);
+
+    // only the first line fits
+    int len = metrics_prometheus_handler("GET", "/metrics", response, 32);
+    TEST_ASSERT_EQUAL(20, len);
+    TEST_ASSERT_EQUAL_STRING("two_accepts_total 1\n", response);
+}
+
+void test_metrics_cbor(void)
+{
+    uint8_t response[128];
+
+    METRICS_ADD(BYTES_IN, 300);
+    METRICS_FRAME_IN(0x4);
+
+    int len = metrics_cbor_handler("GET", "/metrics", (char *)response, 128);
+    TEST_ASSERT_GREATER_THAN(0, len);
+
+    // map with the counters, 3 arrays and the latency sum
+    TEST_ASSERT_EQUAL_HEX8(0xa0 | 22, response[0]);
+
+    // accepts: 0
+    TEST_ASSERT_EQUAL_HEX8(0x00, response[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, response[2]);
+
+    // bytes in: 300
+    uint8_t bytes_in[] = { METRICS_BYTES_IN, 0x19, 0x01, 0x2c };
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(bytes_in, response + 7, 4);
+
+    // received frames after the counters
+    uint8_t frames_in[] = { METRICS_KEY_FRAMES_IN, 0x8a, 0, 0, 0, 0, 1, 0,
+                            0,                     0,    0, 0 };
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(
+      frames_in, response + 11 + 2 * (METRICS_COUNTERS - 4), 12);
+
+    // latency sum is the last value
+    TEST_ASSERT_EQUAL_HEX8(METRICS_KEY_LATENCY_SUM, response[len - 2]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, response[len - 1]);
+
+    // fail if the map does not fit
+    TEST_ASSERT_EQUAL(
+      -1, metrics_cbor_handler("GET", "/metrics", (char *)response, 16));
+}
+
+void test_metrics_hist(void)
+{
+    metrics_hist_t hist;
+    memset(&hist, 0, sizeof(metrics_hist_t));
+
+    TEST_ASSERT_EQUAL(0, metrics_hist_quantile(&hist, 500));
+
+    // values below 4 are exact
+    metrics_hist_add(&hist, 3);
+    TEST_ASSERT_EQUAL(3, metrics_hist_quantile(&hist, 500));
+
+    // 100 is in [96, 111], 1000 in [896, 1023]
+    for (int i = 0; i < 98; i++) {
+        metrics_hist_add(&hist, 100);
+    }
+    metrics_hist_add(&hist, 1000);
+    TEST_ASSERT_EQUAL(100, hist.count);
+    TEST_ASSERT_EQUAL(111, metrics_hist_quantile(&hist, 500));
+    TEST_ASSERT_EQUAL(111, metrics_hist_quantile(&hist, 990));
+    TEST_ASSERT_EQUAL(1023, metrics_hist_quantile(&hist, 999));
+
+    // large values go to the last bucket
+    metrics_hist_add(&hist, 0xffffffff);
+    TEST_ASSERT_EQUAL(1, hist.buckets[METRICS_HIST_BUCKETS - 1]);
+    TEST_ASSERT_EQUAL(1 << METRICS_HIST_MAX_BITS,
+                      metrics_hist_quantile(&hist, 1000));
+}
+
+void test_metrics_phases(void)
+{
+    char response[256];
+
+    uint32_t start    = metrics_clock_us() - 1000;
+    uint32_t stamps[] = { start, start + 10, start + 20, start + 120,
+                          start + 200 };
+
+    metrics_route(1, "/index");
+    metrics_phases(1, stamps);
+
+    TEST_ASSERT_EQUAL(11,
+                      metrics_phase_quantile(1, METRICS_PHASE_REQUEST, 500));
+    TEST_ASSERT_EQUAL(11, metrics_phase_quantile(1, METRICS_PHASE_DECODE, 500));
+    TEST_ASSERT_EQUAL(
+      111, metrics_phase_quantile(1, METRICS_PHASE_HANDLER, 500));
+    TEST_ASSERT_EQUAL(95, metrics_phase_quantile(1, METRICS_PHASE_QUEUE, 500));
+    TEST_ASSERT_GREATER_OR_EQUAL(
+      1000, metrics_phase_quantile(1, METRICS_PHASE_TOTAL, 500));
+
+    // other routes are empty
+    TEST_ASSERT_EQUAL(0, metrics_phase_quantile(0, METRICS_PHASE_TOTAL, 500));
+
+    // unknown routes are ignored
+    metrics_phases(-1, stamps);
+    metrics_phases(METRICS_ROUTES, stamps);
+    TEST_ASSERT_EQUAL(
+      0, metrics_phase_quantile(-1, METRICS_PHASE_TOTAL, 500));
+
+    int len = metrics_phases_handler("GET", "/phases", response, 256);
+    TEST_ASSERT_EQUAL(strlen(response), len);
+    TEST_ASSERT_EQUAL(
+      0, strncmp(response, "route phase count p50 p99 p999\n", 31));
+    TEST_ASSERT_NOT_NULL(strstr(response, "/index handler 1 111 111 111\n"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "/index queue 1 95 95 95\n"));
+    TEST_ASSERT_NOT_NULL(strstr(response, "/index total 1 "));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    UNIT_TEST(test_metrics_counters);
+    UNIT_TEST(test_metrics_latency);
+    UNIT_TEST(test_metrics_prometheus);
+    UNIT_TEST(test_metrics_prometheus_cut);
+    UNIT_TEST(test_metrics_cbor);
+    UNIT_TEST(test_metrics_hist);
+    UNIT_TEST(test_metrics_phases);
+
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+
+#include "fff.h"
+#include "frames.h"
+#include "trace.h"
+#include "unit.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint32_t, event_time_ms);
+
+#define FFF_FAKES_LIST(FAKE) FAKE(event_time_ms)
+
+// lines received by the dump callback
+static char lines[8][96];
+static int lines_count;
+
+void dump_cb(const char *line)
+{
+    strcpy(lines[lines_count++], line);
+}
+
+void setUp(void)
+{
+    /* Register resets */
+    FFF_FAKES_LIST(RESET_FAKE);
+
+    /* reset common FFF internal structures */
+    FFF_RESET_HISTORY();
+
+    trace_reset();
+    lines_count = 0;
+}
+
+void test_trace_format(void)
+{
+    char buf[96];
+    trace_entry_t entry = {
+        .time      = 1500,
+        .stream_id = 3,
+        .length    = 12,
+        .conn      = 1,
+        .dir       = TRACE_RECV,
+        .type      = FRAME_HEADERS_TYPE,
+        .flags     = FRAME_FLAGS_END_HEADERS,
+    };
+
+    trace_format(&entry, buf, 96);
+    TEST_ASSERT_EQUAL_STRING(
+      "1500 <-|1| HEADERS (length: 12, flags: 0x4, stream_id: 3)", buf);
+
+    entry.dir  = TRACE_DROP;
+    entry.type = 0xb;
+    trace_format(&entry, buf, 96);
+    TEST_ASSERT_EQUAL_STRING(
+      "1500 X-|1| 0xb (length: 12, flags: 0x4, stream_id: 3)", buf);
+
+    entry.dir  = TRACE_RECV;
+    entry.type = TRACE_PREFACE;
+    trace_format(&entry, buf, 96);
+    TEST_ASSERT_EQUAL_STRING("1500 <-|1| HTTP2_PREFACE", buf);
+}
+
+void test_trace_dump(void)
+{
+    event_time_ms_fake.return_val = 10;
+    TRACE_FRAME(RECV, 0, FRAME_SETTINGS_TYPE, 0, 0, 0);
+    TRACE_FRAME(SEND, 0, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK, 0, 0);
+
+    trace_dump(dump_cb);
+    TEST_ASSERT_EQUAL(2, lines_count);
+    TEST_ASSERT_EQUAL_STRING(
+      "10 <-|0| SETTINGS (length: 0, flags: 0x0, stream_id: 0)", lines[0]);
+    TEST_ASSERT_EQUAL_STRING(
+      "10 ->|0| SETTINGS (length: 0, flags: 0x1, stream_id: 0)", lines[1]);
+}
+
+void test_trace_dump_full(void)
+{
+    // the trace has 4 entries, the first 2 frames are overwritten
+    for (unsigned int i = 0; i < 6; i++) {
+        event_time_ms_fake.return_val = i;
+        TRACE_FRAME(SEND, 0, FRAME_DATA_TYPE, 0, 10, 1);
+    }
+
+    trace_dump(dump_cb);
+    TEST_ASSERT_EQUAL(4, lines_count);
+    TEST_ASSERT_EQUAL_STRING(
+      "2 ->|0| DATA (length: 10, flags: 0x0, stream_id: 1)", lines[0]);
+    TEST_ASSERT_EQUAL_STRING(
+      "5 ->|0| DATA (length: 10, flags: 0x0, stream_id: 1)", lines[3]);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    UNIT_TEST(test_trace_format);
+    UNIT_TEST(test_trace_dump);
+    UNIT_TEST(test_trace_dump_full);
+
+    return UNITY_END();
+}
@@ -1,3 +1,7 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "fff.h"
 #include "http.h"
 #include "two.h"
@@ -9,6 +13,8 @@ typedef struct
     char *method;
     char *content_type;
     two_resource_handler_t handler;
+    two_resource_validator_t validator;
+    uint8_t variants;
 } two_resource_t;
 
 extern char *http_get_method(char *method);
@@ -19,9 +25,14 @@ extern two_resource_t *find_resource(char *method, char *path);
 
 DEFINE_FFF_GLOBALS;
 FAKE_VALUE_FUNC(char *, content_type_allowed, char *);
+FAKE_VALUE_FUNC(char *, content_encoding_allowed, char *);
+FAKE_VALUE_FUNC(char *, content_type_from_path, char *);
 
 /* List of fakes used by this unit tester */
-#define FFF_FAKES_LIST(FAKE) FAKE(content_type_allowed)
+#define FFF_FAKES_LIST(FAKE)                                                   \
+    FAKE(content_type_allowed)                                                 \
+    FAKE(content_encoding_allowed)                                             \
+    FAKE(content_type_from_path)
 
 void setUp(void)
 {
@@ -77,6 +88,25 @@ int hello_world(char *method, char *uri, char *response, unsigned int maxlen)
     return len;
 }
 
+static int hello_world_calls = 0;
+int counting_hello_world(char *method, char *uri, char *response,
+                         unsigned int maxlen)
+{
+    hello_world_calls++;
+    return hello_world(method, uri, response, maxlen);
+}
+
+int hello_world_validator(char *method, char *uri, char *etag,
+                          unsigned int maxlen)
+{
+    (void)method;
+    (void)uri;
+    (void)maxlen;
+
+    strcpy(etag, "v1");
+    return 2;
+}
+
 void test_http_get_method(void)
 {
     TEST_ASSERT_EQUAL_STRING("GET", http_get_method("GET"));
@@ -250,6 +280,253 @@ void test_http_handle_request(void)
     TEST_ASSERT_EQUAL(0, res.content_length);
 }
 
+void test_http_etag_match(void)
+{
+    TEST_ASSERT_EQUAL(1, http_etag_match("\"v1\"", "\"v1\""));
+    TEST_ASSERT_EQUAL(1, http_etag_match("*", "\"v1\""));
+    TEST_ASSERT_EQUAL(1, http_etag_match("\"a\", W/\"v1\"", "\"v1\""));
+    TEST_ASSERT_EQUAL(1, http_etag_match("\"v1\"", "W/\"v1\""));
+    TEST_ASSERT_EQUAL(1, http_etag_match("\"a,b\",\"v1\"", "\"v1\""));
+    TEST_ASSERT_EQUAL(0, http_etag_match("\"v2\"", "\"v1\""));
+    TEST_ASSERT_EQUAL(0, http_etag_match("\"v\"", "\"v1\""));
+    TEST_ASSERT_EQUAL(0, http_etag_match("v1", "\"v1\""));
+    TEST_ASSERT_EQUAL(0, http_etag_match("\"v1", "\"v1\""));
+    TEST_ASSERT_EQUAL(0, http_etag_match("", "\"v1\""));
+}
+
+void test_http_handle_request_conditional(void)
+{
+    content_type_allowed_fake.custom_fake = content_type_text_plain;
+
+    TEST_ASSERT_EQUAL(0, two_register_resource("GET", "/etag", "text/plain",
+                                               counting_hello_world));
+
+    char content[32];
+    http_header_t headers[1] = { { .name  = "if-none-match",
+                                   .value = "\"nomatch\"" } };
+    http_response_t res = { .content = content };
+    http_request_t req  = { .method         = "GET",
+                           .path           = "/etag",
+                           .headers_length = 1,
+                           .headers        = headers };
+
+    // without validator the etag is computed from the content
+    hello_world_calls = 0;
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(15, res.content_length);
+    TEST_ASSERT_EQUAL(10, strlen(res.etag));
+    TEST_ASSERT_EQUAL(1, hello_world_calls);
+
+    // the same etag returns not modified
+    char etag[HTTP_MAX_ETAG_SIZE];
+    strcpy(etag, res.etag);
+    headers[0].value = etag;
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(304, res.status);
+    TEST_ASSERT_EQUAL(0, res.content_length);
+    TEST_ASSERT_EQUAL_STRING(etag, res.etag);
+
+    // with a validator the handler is not called
+    TEST_ASSERT_EQUAL(-1, two_register_validator("GET", "/none",
+                                                 hello_world_validator));
+    TEST_ASSERT_EQUAL(0, two_register_validator("GET", "/etag",
+                                                hello_world_validator));
+    headers[0].value  = "\"v1\"";
+    hello_world_calls = 0;
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(304, res.status);
+    TEST_ASSERT_EQUAL(0, res.content_length);
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", res.etag);
+    TEST_ASSERT_EQUAL(0, hello_world_calls);
+
+    // a different etag gets the full response
+    headers[0].value = "\"v0\"";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(15, res.content_length);
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", res.etag);
+    TEST_ASSERT_EQUAL(1, hello_world_calls);
+}
+
+void test_http_accept_encoding_q(void)
+{
+    TEST_ASSERT_EQUAL(1000, http_accept_encoding_q("gzip", "gzip"));
+    TEST_ASSERT_EQUAL(1000, http_accept_encoding_q("deflate, GZIP", "gzip"));
+    TEST_ASSERT_EQUAL(500, http_accept_encoding_q("br;q=0.5, gzip", "br"));
+    TEST_ASSERT_EQUAL(250, http_accept_encoding_q("br ; q=0.25", "br"));
+    TEST_ASSERT_EQUAL(0, http_accept_encoding_q("gzip;q=0", "gzip"));
+    TEST_ASSERT_EQUAL(0, http_accept_encoding_q("*, gzip;q=0.000", "gzip"));
+    TEST_ASSERT_EQUAL(800, http_accept_encoding_q("gzip, *;q=0.8", "br"));
+    TEST_ASSERT_EQUAL(-1, http_accept_encoding_q("gzip, deflate", "br"));
+    TEST_ASSERT_EQUAL(-1, http_accept_encoding_q("", "br"));
+    TEST_ASSERT_EQUAL(-1, http_accept_encoding_q("gzipx", "gzip"));
+}
+
+char *content_encoding_gzip_br(char *content_encoding)
+{
+    if (strcmp(content_encoding, "gzip") == 0 ||
+        strcmp(content_encoding, "br") == 0) {
+        return content_encoding;
+    }
+    return NULL;
+}
+
+void test_http_handle_request_variants(void)
+{
+    content_type_allowed_fake.custom_fake     = content_type_text_plain;
+    content_encoding_allowed_fake.custom_fake = content_encoding_gzip_br;
+
+    TEST_ASSERT_EQUAL(0, two_register_resource("GET", "/variant", "text/plain",
+                                               counting_hello_world));
+
+    // only registered resources and allowed encodings
+    TEST_ASSERT_EQUAL(
+      -1, two_register_variant("GET", "/none", "gzip", "gzipped", 7));
+    TEST_ASSERT_EQUAL(
+      -1, two_register_variant("GET", "/variant", "compress", "comp", 4));
+    TEST_ASSERT_EQUAL(
+      0, two_register_variant("GET", "/variant", "gzip", "gzipped", 7));
+    TEST_ASSERT_EQUAL(0,
+                      two_register_variant("GET", "/variant", "br", "br", 2));
+
+    char content[32];
+    http_header_t headers[1] = { { .name = "accept-encoding", .value = "" } };
+    http_response_t res      = { .content = content };
+    http_request_t req       = { .method         = "GET",
+                           .path           = "/variant",
+                           .headers_length = 1,
+                           .headers        = headers };
+
+    // no accepted variant gets the identity representation
+    hello_world_calls = 0;
+    headers[0].value  = "identity";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(15, res.content_length);
+    TEST_ASSERT_EQUAL(NULL, res.content_encoding);
+    TEST_ASSERT_EQUAL_STRING("accept-encoding", res.vary);
+    TEST_ASSERT_EQUAL(1, hello_world_calls);
+
+    // the smallest accepted variant is selected
+    headers[0].value = "gzip, br";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(2, res.content_length);
+    TEST_ASSERT_EQUAL_STRING("br", res.content_encoding);
+    TEST_ASSERT_EQUAL_STRING("accept-encoding", res.vary);
+    TEST_ASSERT_EQUAL(1, hello_world_calls);
+
+    headers[0].value = "gzip, br;q=0";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(7, res.content_length);
+    TEST_ASSERT_EQUAL_STRING("gzip", res.content_encoding);
+    TEST_ASSERT_EQUAL_MEMORY("gzipped", res.content, 7);
+
+    // variants that do not fit are ignored
+    http_handle_request(&req, &res, 4);
+    TEST_ASSERT_EQUAL(NULL, res.content_encoding);
+    TEST_ASSERT_EQUAL(2, hello_world_calls);
+
+    // re-registering the resource removes the variants
+    TEST_ASSERT_EQUAL(0, two_register_resource("GET", "/variant", "text/plain",
+                                               counting_hello_world));
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(NULL, res.content_encoding);
+    TEST_ASSERT_EQUAL(NULL, res.vary);
+}
+
+void write_file(char *dir, char *name, char *content)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    fputs(content, f);
+    fclose(f);
+}
+
+void remove_file(char *dir, char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    unlink(path);
+}
+
+void test_http_handle_request_directory(void)
+{
+    content_type_from_path_fake.return_val = "text/html";
+
+    char dir[] = "/tmp/two-test-XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    write_file(dir, "index.html", "<p>Hello</p>");
+    write_file(dir, "hello.txt", "Hello, World!!!");
+
+    TEST_ASSERT_EQUAL(-1, two_register_directory("static", dir));
+    TEST_ASSERT_EQUAL(0, two_register_directory("/static", dir));
+
+    char content[32];
+    http_header_t headers[1] = { { .name  = "if-none-match",
+                                   .value = "\"nomatch\"" } };
+    http_response_t res = { .content = content };
+    http_request_t req  = { .method         = "GET",
+                           .path           = "/static/hello.txt",
+                           .headers_length = 1,
+                           .headers        = headers };
+
+    // files are not limited by the response buffer
+    http_handle_request(&req, &res, 4);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(15, res.content_length);
+    TEST_ASSERT_EQUAL_STRING("text/html", res.content_type);
+    TEST_ASSERT_TRUE(res.fd >= 0);
+    TEST_ASSERT_TRUE(strlen(res.etag) > 2);
+    close(res.fd);
+
+    // a matching etag returns not modified without a file
+    char etag[HTTP_MAX_ETAG_SIZE];
+    strcpy(etag, res.etag);
+    headers[0].value = etag;
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(304, res.status);
+    TEST_ASSERT_EQUAL(-1, res.fd);
+
+    // directories are served through their index
+    req.path           = "/static/";
+    req.headers_length = 0;
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(12, res.content_length);
+    close(res.fd);
+
+    req.path = "/static";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(200, res.status);
+    TEST_ASSERT_EQUAL(12, res.content_length);
+    close(res.fd);
+
+    // missing files and paths outside the directory are not found
+    req.path = "/static/missing.txt";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(404, res.status);
+    TEST_ASSERT_EQUAL(-1, res.fd);
+
+    req.path = "/static/../etc/passwd";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(404, res.status);
+    TEST_ASSERT_EQUAL(-1, res.fd);
+
+    req.path = "/staticfile";
+    http_handle_request(&req, &res, 32);
+    TEST_ASSERT_EQUAL(404, res.status);
+    TEST_ASSERT_EQUAL(-1, res.fd);
+
+    remove_file(dir, "index.html");
+    remove_file(dir, "hello.txt");
+    rmdir(dir);
+}
+
 int main(void)
 {
     UNIT_TESTS_BEGIN();
@@ -261,6 +538,11 @@ int main(void)
     UNIT_TEST(test_resources);
     UNIT_TEST(test_http_error);
     UNIT_TEST(test_http_handle_request);
+    UNIT_TEST(test_http_etag_match);
+    UNIT_TEST(test_http_handle_request_conditional);
+    UNIT_TEST(test_http_accept_encoding_q);
+    UNIT_TEST(test_http_handle_request_variants);
+    UNIT_TEST(test_http_handle_request_directory);
 
     return UNIT_TESTS_END();
 }
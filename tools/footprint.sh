@@ -0,0 +1,231 @@
+#!/usr/bin/env bash
+#
+# Static RAM and stack footprint of the library for a build configuration
+#
+# Compiles the library sources with -fstack-usage (and -fcallgraph-info when
+# the compiler supports it) and reports
+#   - every statically allocated variable, from the symbol table
+#   - the largest stack frames
+#   - the worst case of the frames with variable length arrays, with the
+#     array bounds taken from the CONFIG_* macros of the build
+#   - the deepest call chain, counting the worst case VLA sizes
+#
+# usage: footprint.sh [-s] <dir> <source>...
+#
+# With -s only one summary line is printed (see `make footprint-sweep`).
+# CC, CFLAGS and NM are read from the environment, `make footprint` sets
+# them from the current build configuration
+set -e
+
+summary=0
+if [ "$1" = "-s" ]; then
+    summary=1
+    shift
+fi
+dir=$1
+shift
+
+CC=${CC:-cc}
+NM=${NM:-nm}
+
+mkdir -p "$dir"
+rm -f "$dir"/*.o "$dir"/*.su "$dir"/*.ci
+
+callgraph=-fcallgraph-info=su
+if ! $CC $callgraph -x c -c /dev/null -o "$dir/check.o" 2> /dev/null; then
+    callgraph=
+fi
+rm -f "$dir"/check.*
+
+for src in "$@"; do
+    $CC $CFLAGS -fstack-usage $callgraph -c "$src" \
+        -o "$dir/$(basename "${src%.c}").o"
+done
+
+# Worst case bytes of the variable length arrays of each function, as a
+# preprocessor expression. Update when adding a VLA to the library
+vlas="
+event_sock_read         HTTP2_SOCK_READ_SIZE        read buffer
+event_sock_handle_read  HTTP2_SOCK_READ_SIZE        read buffer
+event_read_stop         HTTP2_SOCK_READ_SIZE        read buffer
+event_sock_write        HTTP2_SOCK_WRITE_SIZE       write buffer
+header_list_add         HEADER_LIST_MAX_SIZE        header value
+handle_end_stream       HEADER_LIST_MAX_SIZE/3*2*__SIZEOF_POINTER__ headers
+hpack_encoder_encode    HEADER_LIST_MAX_SIZE/3*2*__SIZEOF_POINTER__ headers
+hpack_encoder_encode_huffman_string HEADER_LIST_MAX_SIZE*12 huffman words
+hpack_tables_dynamic_table_resize HPACK_MAX_DYNAMIC_TABLE_SIZE dynamic table
+http_open_file          HEADER_LIST_MAX_SIZE+12     path (without root dir)
+"
+
+# evaluate the bounds and configuration values with the preprocessor,
+# dropping integer suffixes and casts so the shell can compute them
+values=$(
+    {
+        echo '#include "http2.h"'
+        echo '#include "header_list.h"'
+        echo '#include "hpack/hpack.h"'
+        echo "FOOTPRINT clients HTTP2_MAX_CLIENTS"
+        echo "$vlas" | awk 'NF { print "FOOTPRINT", $1, $2 }'
+    } | $CC $CFLAGS -E -P -x c - |
+        sed -n -E -e 's/^FOOTPRINT //' \
+            -e 's/\((u?int[0-9]+_t|unsigned int|int)\)//g' \
+            -e 's/([0-9]+)[uUlL]+/\1/g' -e 'p'
+)
+eval_value() {
+    echo $(($(echo "$values" | awk -v k="$1" '$1 == k { $1 = ""; print }')))
+}
+
+clients=$(eval_value clients)
+vla_bounds=$(echo "$vlas" | awk 'NF { print $1 }' | while read -r f; do
+    echo "$f $(eval_value "$f")"
+done)
+
+# static variables: bss, data and small data
+statics=$(for obj in "$dir"/*.o; do
+    $NM -S -t d "$obj" |
+        awk -v o="$(basename "${obj%.o}").c" \
+            'NF == 4 && $3 ~ /^[bBdDsSgGcC]$/ {
+                sec = $3 ~ /[bBsScC]/ ? "bss" : "data"
+                printf "%d %s %s %s\n", $2, sec, $4, o
+            }'
+done | sort -k1,1nr -k3,3)
+
+static_total=$(echo "$statics" | awk '{ s += $1 } END { print s + 0 }')
+context=$(echo "$statics" | awk -v n="$clients" \
+    '$3 == "clients_list" { print int($1 / n) }')
+
+# frames from the .su files: function bytes qualifier file
+frames=$(cat "$dir"/*.su | awk -F'\t' '{
+    n = split($1, loc, ":")
+    file = loc[1]
+    sub(/.*\//, "", file)
+    printf "%s %d %s %s:%s\n", loc[n], $2, $3, file, loc[2]
+}')
+
+# deepest call chain from the callgraph, indirect calls may reach any
+# function whose address is taken in the sources
+stack_path=
+stack_max=
+if [ -n "$callgraph" ]; then
+    names=$(echo "$frames" | awk '{ print $1 }')
+    taken=$(for f in $names; do
+        if grep -qE "(^|[(,=])[[:space:]]*$f[[:space:]]*([,);]|$)" "$@"; then
+            echo "$f"
+        fi
+    done)
+    stack_path=$(cat "$dir"/*.ci | awk \
+        -v frames="$frames" -v vla="$vla_bounds" -v taken="$taken" '
+        function depth(f,    i, j, t, d, best, nx) {
+            if (f in memo) {
+                return memo[f]
+            }
+            if (f in active) {
+                return 0 # recursion is not followed
+            }
+            active[f] = 1
+            best = 0
+            for (i = 1; i <= nedges[f]; i++) {
+                t = edges[f, i]
+                if (t == "__indirect_call") {
+                    for (j in indirect) {
+                        d = depth(j)
+                        if (d > best) {
+                            best = d
+                            nx = j
+                        }
+                    }
+                }
+                else if (t in frame) {
+                    d = depth(t)
+                    if (d > best) {
+                        best = d
+                        nx = t
+                    }
+                }
+            }
+            delete active[f]
+            next_fn[f] = nx
+            memo[f] = frame[f] + bound[f] + best
+            return memo[f]
+        }
+        BEGIN {
+            n = split(frames, lines, "\n")
+            for (i = 1; i <= n; i++) {
+                split(lines[i], a, " ")
+                frame[a[1]] = a[2]
+            }
+            n = split(vla, lines, "\n")
+            for (i = 1; i <= n; i++) {
+                split(lines[i], a, " ")
+                bound[a[1]] = a[2]
+            }
+            n = split(taken, lines, "\n")
+            for (i = 1; i <= n; i++) {
+                indirect[lines[i]] = 1
+            }
+        }
+        /^edge:/ {
+            split($0, q, "\"")
+            if (!((q[2], q[4]) in seen)) {
+                seen[q[2], q[4]] = 1
+                edges[q[2], ++nedges[q[2]]] = q[4]
+            }
+        }
+        END {
+            for (f in frame) {
+                if (depth(f) > max || (depth(f) == max && f < root)) {
+                    max = depth(f)
+                    root = f
+                }
+            }
+            print max
+            for (f = root; f != ""; f = next_fn[f]) {
+                print f, frame[f] + bound[f], memo[f]
+            }
+        }')
+    stack_max=$(echo "$stack_path" | head -n 1)
+fi
+
+if [ $summary -eq 1 ]; then
+    printf "%8d %6d %8d %8s  %s\n" "$static_total" "$clients" "$context" \
+        "${stack_max:--}" "${DEFINES:-default}"
+    exit 0
+fi
+
+echo "Configuration: ${DEFINES:-default}"
+echo
+echo "Static RAM"
+printf "%8s  %-4s  %-32s %s\n" "bytes" "sect" "symbol" "file"
+echo "$statics" | awk '{ printf "%8d  %-4s  %-32s %s\n", $1, $2, $3, $4 }'
+printf "%8d  total\n" "$static_total"
+printf "%8d  per client (http2_context_t, %d clients)\n" "$context" "$clients"
+echo
+echo "Largest stack frames"
+printf "%8s  %-36s %s\n" "bytes" "function" "location"
+echo "$frames" | sort -k2,2nr -k1,1 | head -n 10 |
+    awk '{ printf "%8d  %-36s %s%s\n", $2, $1, $4,
+           $3 == "static" ? "" : " (" $3 ")" }'
+echo
+echo "Variable length arrays (worst case)"
+printf "%8s %8s %8s  %-36s %s\n" "frame" "array" "total" "function" "array of"
+echo "$vlas" | awk 'NF { print $1 }' | while read -r f; do
+    fr=$(echo "$frames" | awk -v f="$f" '$1 == f { print $2 }')
+    b=$(echo "$vla_bounds" | awk -v f="$f" '$1 == f { print $2 }')
+    what=$(echo "$vlas" | awk -v f="$f" '$1 == f { $1 = $2 = ""; print }')
+    if [ -n "$fr" ]; then
+        printf "%8d %8d %8d  %-36s%s\n" "$fr" "$b" $((fr + b)) "$f" "$what"
+    fi
+done
+echo "$frames" | awk '$3 ~ /^dynamic$/ { print $1 }' | while read -r f; do
+    if ! echo "$vla_bounds" | grep -q "^$f "; then
+        echo "warning: no bound known for the VLA in $f" >&2
+    fi
+done
+
+if [ -n "$stack_max" ]; then
+    echo
+    echo "Deepest call chain (recursion and libc not counted)"
+    printf "%8s %8s  %s\n" "frame" "depth" "function"
+    echo "$stack_path" | tail -n +2 |
+        awk '{ printf "%8d %8d  %s\n", $2, $3, $1 }'
+fi
@@ -0,0 +1,592 @@
+// HTTP/2 load generator for the two server
+//
+// Opens one or more connections to a local server and sends GET requests
+// following one of the request mixes below. Frames are built and parsed
+// with the frames and hpack modules of the library. At the end it reports
+// requests per second, latency percentiles, bytes per request and, if the
+// server pid is given, the server CPU time
+//
+// Request mixes
+//   seq    one request at a time on each connection
+//   pipe   up to -d streams in flight on each connection, bounded by
+//          the SETTINGS_MAX_CONCURRENT_STREAMS of the server
+//   large  sequential requests for a large response body
+//   hpack  sequential requests with browser-like headers and a
+//          different x-request-id value on every request
+//
+// Run `make bench` to start bin/basic and run all mixes against it
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "frames.h"
+#include "header_list.h"
+#include "hpack/hpack.h"
+
+#define BENCH_MAX_CONNS  (64)
+#define BENCH_MAX_DEPTH  (16)
+#define BENCH_READ_SIZE  (65536)
+#define BENCH_FRAME_SIZE (1024)
+#define BENCH_TIMEOUT    (5000)
+
+// windows announced to the server, data is never
+// buffered by the client so they only need to be large
+#define BENCH_WINDOW_SIZE (1 << 30)
+#define BENCH_WINDOW_INIT (65535)
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+typedef enum
+{
+    MIX_SEQ,
+    MIX_PIPE,
+    MIX_LARGE,
+    MIX_HPACK
+} mix_t;
+
+static const char *mix_names[] = { "seq", "pipe", "large", "hpack" };
+
+typedef struct
+{
+    uint32_t id;
+    double start;
+} bench_stream_t;
+
+typedef struct
+{
+    int fd;
+    int open;
+
+    uint32_t next_stream_id;
+    uint32_t max_streams;
+
+    bench_stream_t streams[BENCH_MAX_DEPTH];
+    int inflight;
+
+    // received DATA not yet returned to the connection window
+    uint32_t consumed;
+
+    hpack_dynamic_table_t encoder;
+    hpack_dynamic_table_t decoder;
+
+    uint8_t buf[BENCH_READ_SIZE];
+    int buflen;
+} bench_conn_t;
+
+// options
+static char *addr         = "127.0.0.1";
+static int port           = 8888;
+static int nconns         = 1;
+static long total         = 10000;
+static mix_t mix          = MIX_SEQ;
+static unsigned int depth = 8;
+static char *path         = NULL;
+static int server_pid     = -1;
+
+static bench_conn_t conns[BENCH_MAX_CONNS];
+
+// results
+static double *latencies;
+static long sent;
+static long done;
+static long lost;
+static long errors;
+static long refused;
+static uint64_t bytes_in;
+static uint64_t bytes_out;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-a addr] [-p port] [-c connections] [-n requests]\n"
+            "       [-m seq|pipe|large|hpack] [-d depth] [-u path] "
+            "[-s server_pid]\n",
+            name);
+    exit(1);
+}
+
+// read the user and system time of the process in seconds
+static double process_cpu(int pid)
+{
+    char file[64];
+    snprintf(file, sizeof(file), "/proc/%d/stat", pid);
+
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char stat[1024];
+    size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[len] = '\0';
+
+    // the process name may contain spaces
+    char *fields = strrchr(stat, ')');
+    unsigned long utime, stime;
+    if (fields == NULL ||
+        sscanf(fields + 1,
+               " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime,
+               &stime) != 2) {
+        return -1;
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int conn_write(bench_conn_t *conn, uint8_t *data, int len)
+{
+    int written = 0;
+    while (written < len) {
+        int rc = send(conn->fd, data + written, len - written, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += rc;
+    }
+    bytes_out += len;
+    return 0;
+}
+
+static int send_frame(bench_conn_t *conn,
+                      uint8_t type,
+                      uint8_t flags,
+                      uint32_t stream_id,
+                      uint8_t *payload,
+                      int len)
+{
+    uint8_t frame[BENCH_FRAME_SIZE];
+    frame_header_t header = {
+        .length = len, .type = type, .flags = flags, .stream_id = stream_id
+    };
+
+    frame_header_to_bytes(&header, frame);
+    if (len > 0) {
+        memcpy(frame + 9, payload, len);
+    }
+    return conn_write(conn, frame, 9 + len);
+}
+
+static int send_window_update(bench_conn_t *conn, uint32_t increment)
+{
+    uint8_t payload[4];
+    buffer_put_u31(payload, increment);
+    return send_frame(conn, FRAME_WINDOW_UPDATE_TYPE, 0, 0, payload, 4);
+}
+
+static int conn_open(bench_conn_t *conn)
+{
+    memset(conn, 0, sizeof(bench_conn_t));
+    conn->next_stream_id = 1;
+
+    // only one stream until the server settings are received
+    conn->max_streams = 1;
+
+    struct sockaddr_in sin = { .sin_family = AF_INET,
+                               .sin_port   = htons(port) };
+    if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+        fprintf(stderr, "invalid address %s\n", addr);
+        return -1;
+    }
+
+    if ((conn->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        connect(conn->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    hpack_init(&conn->encoder, HPACK_MAX_DYNAMIC_TABLE_SIZE);
+    hpack_init(&conn->decoder, HPACK_MAX_DYNAMIC_TABLE_SIZE);
+
+    // preface, settings with a large initial window and
+    // the increment for the connection window
+    uint8_t settings[12];
+    buffer_put_u16(settings, 0x2); // ENABLE_PUSH
+    buffer_put_u32(settings + 2, 0);
+    buffer_put_u16(settings + 6, 0x4); // INITIAL_WINDOW_SIZE
+    buffer_put_u32(settings + 8, BENCH_WINDOW_SIZE);
+
+    if (conn_write(conn, (uint8_t *)HTTP2_PREFACE, 24) < 0 ||
+        send_frame(conn, FRAME_SETTINGS_TYPE, 0, 0, settings, 12) < 0 ||
+        send_window_update(conn, BENCH_WINDOW_SIZE - BENCH_WINDOW_INIT) < 0) {
+        perror("write");
+        return -1;
+    }
+
+    conn->open = 1;
+    return 0;
+}
+
+static void conn_close(bench_conn_t *conn)
+{
+    // streams in flight are lost
+    errors += conn->inflight;
+    lost += conn->inflight;
+    conn->inflight = 0;
+
+    close(conn->fd);
+    conn->open = 0;
+}
+
+static int send_request(bench_conn_t *conn)
+{
+    char authority[64];
+    char request_id[32];
+    header_list_t headers;
+    uint8_t block[BENCH_FRAME_SIZE - 9];
+
+    snprintf(authority, sizeof(authority), "%s:%d", addr, port);
+    header_list_reset(&headers);
+    header_list_add(&headers, ":method", "GET");
+    header_list_add(&headers, ":scheme", "http");
+    header_list_add(&headers, ":path", path);
+    header_list_add(&headers, ":authority", authority);
+
+    // values must fit in HPACK_HEADER_VALUE_LEN of the server
+    if (mix == MIX_HPACK) {
+        snprintf(request_id, sizeof(request_id), "%016lx", (long)sent);
+        header_list_add(&headers, "user-agent", "two-bench/1.0");
+        header_list_add(
+          &headers, "accept", "text/html,application/xhtml+xml,*/*;q=0.8");
+        header_list_add(&headers, "accept-language", "en-US,en;q=0.5");
+        header_list_add(&headers, "accept-encoding", "gzip, deflate, br");
+        header_list_add(&headers, "cache-control", "no-cache");
+        header_list_add(&headers,
+                        "cookie",
+                        "session=4f2a9c1e7b3d5a8f0e6c2b9d1a7f3e5c; theme=dark");
+        header_list_add(&headers, "x-request-id", request_id);
+    }
+
+    int len = hpack_encode(&conn->encoder, &headers, block, sizeof(block));
+    if (len < 0) {
+        fprintf(stderr, "failed to encode request headers\n");
+        return -1;
+    }
+
+    uint32_t id = conn->next_stream_id;
+    if (send_frame(conn,
+                   FRAME_HEADERS_TYPE,
+                   FRAME_FLAGS_END_HEADERS | FRAME_FLAGS_END_STREAM,
+                   id,
+                   block,
+                   len) < 0) {
+        return -1;
+    }
+
+    bench_stream_t *stream = &conn->streams[conn->inflight++];
+    stream->id             = id;
+    stream->start          = now();
+    conn->next_stream_id += 2;
+    sent++;
+
+    return 0;
+}
+
+static void end_stream(bench_conn_t *conn, uint32_t id, int error)
+{
+    for (int i = 0; i < conn->inflight; i++) {
+        if (conn->streams[i].id == id) {
+            latencies[done++] = now() - conn->streams[i].start;
+            errors += error;
+            conn->streams[i] = conn->streams[--conn->inflight];
+            return;
+        }
+    }
+}
+
+static int handle_frame(bench_conn_t *conn,
+                        frame_header_t *header,
+                        uint8_t *payload)
+{
+    switch (header->type) {
+        case FRAME_SETTINGS_TYPE:
+            if (header->flags & FRAME_FLAGS_ACK) {
+                break;
+            }
+            for (unsigned int i = 0; i + 6 <= header->length; i += 6) {
+                if (buffer_get_u16(payload + i) == 0x3) {
+                    conn->max_streams = buffer_get_u32(payload + i + 2);
+                }
+            }
+            return send_frame(
+              conn, FRAME_SETTINGS_TYPE, FRAME_FLAGS_ACK, 0, NULL, 0);
+        case FRAME_PING_TYPE:
+            if (header->flags & FRAME_FLAGS_ACK) {
+                break;
+            }
+            return send_frame(
+              conn, FRAME_PING_TYPE, FRAME_FLAGS_ACK, 0, payload, 8);
+        case FRAME_HEADERS_TYPE: {
+            header_list_t headers;
+            header_list_reset(&headers);
+            if (hpack_decode(
+                  &conn->decoder, payload, header->length, &headers) < 0) {
+                fprintf(stderr, "failed to decode response headers\n");
+                return -1;
+            }
+
+            char *status = header_list_get(&headers, ":status");
+            int error    = status == NULL || atoi(status) >= 400;
+            if (header->flags & FRAME_FLAGS_END_STREAM) {
+                end_stream(conn, header->stream_id, error);
+            } else {
+                errors += error;
+            }
+            break;
+        }
+        case FRAME_DATA_TYPE:
+            // return the window in large increments
+            conn->consumed += header->length;
+            if (conn->consumed >= BENCH_WINDOW_SIZE / 2) {
+                if (send_window_update(conn, conn->consumed) < 0) {
+                    return -1;
+                }
+                conn->consumed = 0;
+            }
+            if (header->flags & FRAME_FLAGS_END_STREAM) {
+                end_stream(conn, header->stream_id, 0);
+            }
+            break;
+        case FRAME_RST_STREAM_TYPE:
+            end_stream(conn, header->stream_id, 1);
+            break;
+        case FRAME_GOAWAY_TYPE:
+            // the server is full if it closes before any stream
+            if (conn->next_stream_id == 1 ||
+                buffer_get_u31(payload) < conn->next_stream_id - 2) {
+                refused++;
+            }
+            return -1;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static int conn_read(bench_conn_t *conn)
+{
+    int rc = recv(conn->fd,
+                  conn->buf + conn->buflen,
+                  BENCH_READ_SIZE - conn->buflen,
+                  0);
+    if (rc <= 0) {
+        return -1;
+    }
+    conn->buflen += rc;
+    bytes_in += rc;
+
+    int offset = 0;
+    while (conn->buflen - offset >= 9) {
+        frame_header_t header;
+        frame_parse_header(&header, conn->buf + offset, 9);
+        if (header.length > BENCH_READ_SIZE - 9) {
+            fprintf(stderr, "frame too large (%u)\n", header.length);
+            return -1;
+        }
+        if (conn->buflen - offset < 9 + (int)header.length) {
+            break;
+        }
+        if (handle_frame(conn, &header, conn->buf + offset + 9) < 0) {
+            return -1;
+        }
+        offset += 9 + header.length;
+    }
+
+    memmove(conn->buf, conn->buf + offset, conn->buflen - offset);
+    conn->buflen -= offset;
+    return 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double p)
+{
+    long i = (long)(p * done + 0.5) - 1;
+    if (i < 0) {
+        i = 0;
+    }
+    if (i >= done) {
+        i = done - 1;
+    }
+    return latencies[i] * 1e6;
+}
+
+static void report(double elapsed, double server_cpu)
+{
+    printf("mix: %s, connections: %d, requests: %ld, errors: %ld (lost: %ld), "
+           "refused connections: %ld\n",
+           mix_names[mix],
+           nconns,
+           done,
+           errors,
+           lost,
+           refused);
+    if (done == 0) {
+        return;
+    }
+
+    qsort(latencies, done, sizeof(double), compare);
+    printf("time: %.3f s, requests/s: %.1f\n", elapsed, done / elapsed);
+    printf("latency (us): p50 %.0f, p90 %.0f, p99 %.0f, p999 %.0f, "
+           "max %.0f\n",
+           percentile(0.5),
+           percentile(0.9),
+           percentile(0.99),
+           percentile(0.999),
+           latencies[done - 1] * 1e6);
+    printf("bytes/request: out %.1f, in %.1f\n",
+           (double)bytes_out / done,
+           (double)bytes_in / done);
+    if (server_cpu >= 0) {
+        printf("server cpu: %.1f%%, %.1f us/request\n",
+               100 * server_cpu / elapsed,
+               1e6 * server_cpu / done);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:c:n:m:d:u:s:")) != -1) {
+        switch (opt) {
+            case 'a':
+                addr = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                nconns = atoi(optarg);
+                break;
+            case 'n':
+                total = atol(optarg);
+                break;
+            case 'm':
+                for (mix = MIX_SEQ; mix <= MIX_HPACK; mix++) {
+                    if (strcmp(optarg, mix_names[mix]) == 0) {
+                        break;
+                    }
+                }
+                if (mix > MIX_HPACK) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'u':
+                path = optarg;
+                break;
+            case 's':
+                server_pid = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (nconns < 1 || nconns > BENCH_MAX_CONNS || total < 1 || depth < 1 ||
+        depth > BENCH_MAX_DEPTH) {
+        usage(argv[0]);
+    }
+    if (path == NULL) {
+        path = (mix == MIX_LARGE) ? "/files/large.bin" : "/";
+    }
+    if (mix != MIX_PIPE) {
+        depth = 1;
+    }
+
+    if ((latencies = malloc(total * sizeof(double))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    double cpu_start = server_pid > 0 ? process_cpu(server_pid) : -1;
+    double start     = now();
+
+    int active = 0;
+    for (int i = 0; i < nconns; i++) {
+        if (conn_open(&conns[i]) == 0) {
+            active++;
+        }
+    }
+
+    struct pollfd fds[BENCH_MAX_CONNS];
+    while (done + lost < total && active > 0) {
+        for (int i = 0; i < nconns; i++) {
+            bench_conn_t *conn = &conns[i];
+            unsigned int limit = depth < conn->max_streams ? depth
+                                                           : conn->max_streams;
+            while (conn->open && sent < total &&
+                   (unsigned int)conn->inflight < limit) {
+                if (send_request(conn) < 0) {
+                    conn_close(conn);
+                    active--;
+                }
+            }
+            fds[i].fd     = conn->open ? conn->fd : -1;
+            fds[i].events = POLLIN;
+        }
+
+        int rc = poll(fds, nconns, BENCH_TIMEOUT);
+        if (rc < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (rc == 0) {
+            fprintf(stderr, "no response from the server\n");
+            break;
+        }
+
+        for (int i = 0; i < nconns; i++) {
+            if (conns[i].open && (fds[i].revents & (POLLIN | POLLHUP)) &&
+                conn_read(&conns[i]) < 0) {
+                conn_close(&conns[i]);
+                active--;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    for (int i = 0; i < nconns; i++) {
+        if (conns[i].open) {
+            conn_close(&conns[i]);
+        }
+    }
+
+    double server_cpu = -1;
+    if (cpu_start >= 0) {
+        server_cpu = process_cpu(server_pid) - cpu_start;
+    }
+
+    report(elapsed, server_cpu);
+    free(latencies);
+
+    return errors > 0;
+}